@@ -7,7 +7,7 @@
 using namespace sky360lib::bgs;
 
 CoreBgs::CoreBgs(size_t _numProcessesParallel)
-    : m_numProcessesParallel{_numProcessesParallel}, m_initialized{false}
+    : m_numProcessesParallel{_numProcessesParallel}, m_initialized{false}, m_inputFormat{InputFormat::Default}, m_maskFormat{MaskFormat::Bytes}, m_maskCleanupVotes{0}, m_trackDirtyRows{false}
 {
     if (_numProcessesParallel == DETECT_NUMBER_OF_THREADS)
     {
@@ -15,28 +15,136 @@ CoreBgs::CoreBgs(size_t _numProcessesParallel)
     }
 }
 
+CoreBgs::~CoreBgs()
+{
+    releaseModelBuffers();
+}
+
 void CoreBgs::apply(const cv::Mat &_image, cv::Mat &_fgmask)
 {
     if (!m_initialized)
     {
+        releaseModelBuffers();
         prepareParallel(_image);
         initialize(_image);
         m_initialized = true;
     }
-    if (_fgmask.empty())
+    cv::Mat byteMask;
+    if (m_maskFormat == MaskFormat::PackedBits)
+    {
+        _fgmask.create(_image.size().height, packedMaskWidth(_image.size().width), CV_8UC1);
+        // The fused kernels pack each row as they produce it, the other backends and the Bayer quads need the bytes first
+        if (!hasFusedMaskWriter() || isBayerInput(_image))
+        {
+            m_byteMask.create(_image.size(), CV_8UC1);
+            byteMask = m_byteMask;
+        }
+    }
+    else
     {
         _fgmask.create(_image.size(), CV_8UC1);
+        byteMask = _fgmask;
     }
 
     if (m_numProcessesParallel == 1)
     {
         //std::cout << "CoreBgs runing in the same thread" << std::endl;
-        process(_image, _fgmask, 0);
+        applySplit(_image, byteMask, _fgmask, 0);
     }
     else
     {
         //std::cout << "CoreBgs runing in " << m_numProcessesParallel << " threads" << std::endl;
-        applyParallel(_image, _fgmask);
+        std::for_each(
+            std::execution::par,
+            m_processSeq.begin(),
+            m_processSeq.end(),
+            [&](int np)
+            {
+                applySplit(_image, byteMask, _fgmask, np);
+            });
+    }
+    finishSeams(_image, byteMask, _fgmask);
+    joinDirtyRows();
+}
+
+void CoreBgs::setTrackDirtyRows(bool _trackDirtyRows)
+{
+    m_trackDirtyRows = _trackDirtyRows;
+    m_dirtyRows.clear();
+}
+
+void CoreBgs::setModelArena(std::shared_ptr<MappedArena> _modelArena)
+{
+    m_modelArena = std::move(_modelArena);
+    m_initialized = false;
+}
+
+void CoreBgs::evictModel()
+{
+    for (uint8_t *buffer : m_modelArenaBuffers)
+    {
+        m_modelArena->evict(buffer);
+    }
+}
+
+void CoreBgs::prefetchModel()
+{
+    for (uint8_t *buffer : m_modelArenaBuffers)
+    {
+        m_modelArena->prefetch(buffer);
+    }
+}
+
+uint8_t *CoreBgs::allocModelBuffer(size_t _size)
+{
+    if (m_modelArena != nullptr)
+    {
+        uint8_t *const buffer{m_modelArena->allocate(_size)};
+        if (buffer != nullptr)
+        {
+            m_modelArenaBuffers.push_back(buffer);
+            return buffer;
+        }
+        std::cerr << "CoreBgs: model arena allocation failed, using the heap" << std::endl;
+    }
+    m_modelHeapBuffers.push_back(std::make_unique_for_overwrite<uint8_t[]>(_size));
+    return m_modelHeapBuffers.back().get();
+}
+
+void CoreBgs::releaseModelBuffers()
+{
+    for (uint8_t *buffer : m_modelArenaBuffers)
+    {
+        m_modelArena->release(buffer);
+    }
+    m_modelArenaBuffers.clear();
+    m_modelHeapBuffers.clear();
+}
+
+void CoreBgs::setMaskCleanup(int _minVotes)
+{
+    m_maskCleanupVotes = std::clamp(_minVotes, 0, 9);
+    for (size_t i{0}; i < m_maskFilters.size(); ++i)
+    {
+        m_maskFilters[i].reset(m_imgSizesParallel[i]->width, m_maskCleanupVotes);
+    }
+}
+
+void CoreBgs::setMaskFormat(MaskFormat _maskFormat)
+{
+    m_maskFormat = _maskFormat;
+    if (m_maskFormat == MaskFormat::Bytes)
+    {
+        m_byteMask.release();
+    }
+}
+
+void CoreBgs::setInputFormat(InputFormat _inputFormat)
+{
+    if (_inputFormat != m_inputFormat)
+    {
+        m_inputFormat = _inputFormat;
+        m_initialized = false;
     }
 }
 
@@ -51,8 +159,17 @@ void CoreBgs::prepareParallel(const cv::Mat &_image)
 {
     m_imgSizesParallel.resize(m_numProcessesParallel);
     m_processSeq.resize(m_numProcessesParallel);
+    m_maskFilters.resize(m_numProcessesParallel);
+    m_maskWriters.resize(m_numProcessesParallel);
+    m_seamRows.resize((size_t)2 * _image.size().width);
+    m_dirtyRowsParallel.resize(m_numProcessesParallel);
     size_t y{0};
     size_t h{_image.size().height / m_numProcessesParallel};
+    if (isBayerInput(_image))
+    {
+        // Every split has to start on an even row so all of them see the same CFA phase
+        h &= ~(size_t)1;
+    }
     for (size_t i{0}; i < m_numProcessesParallel; ++i)
     {
         m_processSeq[i] = i;
@@ -64,22 +181,225 @@ void CoreBgs::prepareParallel(const cv::Mat &_image)
                                                 _image.channels(),
                                                 _image.elemSize1(),
                                                 y * _image.size().width);
+        m_maskFilters[i].reset(_image.size().width, m_maskCleanupVotes);
+        m_maskWriters[i].reset(_image.size().width);
         y += h;
     }
 }
 
-void CoreBgs::applyParallel(const cv::Mat &_image, cv::Mat &_fgmask)
+void CoreBgs::applySplit(const cv::Mat &_image, const cv::Mat &_byteMask, cv::Mat &_outputMask, int _numProcess)
+{
+    const ImgSize &imgSize{*m_imgSizesParallel[_numProcess]};
+    const int startY{(int)(imgSize.originalPixelPos / imgSize.width)};
+    const cv::Mat imgSplit(imgSize.height, imgSize.width, _image.type(),
+                           _image.data + (imgSize.originalPixelPos * imgSize.numChannels * imgSize.bytesPerPixel));
+    cv::Mat maskPartial{_byteMask.empty() ? cv::Mat{} : _byteMask.rowRange(startY, startY + imgSize.height)};
+    cv::Mat outputPartial{_outputMask.rowRange(startY, startY + imgSize.height)};
+    const bool packedOutput{m_maskFormat == MaskFormat::PackedBits};
+    const cv::Range innerRows{innerMaskRows(_image, imgSize.height)};
+
+    m_maskWriters[_numProcess].begin(maskPartial, outputPartial, maskFilter(_numProcess));
+    process(imgSplit, maskPartial, _numProcess);
+    if (!maskPartial.empty())
+    {
+        postProcessMask(_image, maskPartial, _numProcess);
+        if (packedOutput)
+        {
+            cv::Mat packedRows{outputPartial.rowRange(innerRows)};
+            packMask(maskPartial.rowRange(innerRows), packedRows);
+        }
+    }
+    // Packed rows are a eighth of the bytes to scan
+    collectDirtyRows(outputPartial, innerRows, _numProcess);
+}
+
+void CoreBgs::postProcessMask(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess)
+{
+    MaskRowFilter *const filter{maskFilter(_numProcess)};
+    if (filter != nullptr && !hasFusedMaskWriter())
+    {
+        for (int y{0}; y < _fgmask.rows; ++y)
+        {
+            filter->pushRow(_fgmask.ptr<uint8_t>(y));
+        }
+        filter->finish();
+    }
+    if (isBayerInput(_image))
+    {
+        cv::Mat innerRows{_fgmask.rowRange(innerMaskRows(_image, _fgmask.rows))};
+        fuseBayerQuads(innerRows);
+    }
+}
+
+cv::Range CoreBgs::innerMaskRows(const cv::Mat &_image, int _numRows) const
+{
+    if (m_maskCleanupVotes == 0)
+    {
+        return cv::Range(0, _numRows);
+    }
+    if (isBayerInput(_image))
+    {
+        // Whole quads, the splits start on even rows
+        const int start{std::min(2, _numRows)};
+        return cv::Range(start, std::max((_numRows - 1) & ~1, start));
+    }
+    const int start{std::min(1, _numRows)};
+    return cv::Range(start, std::max(_numRows - 1, start));
+}
+
+void CoreBgs::finishSeams(const cv::Mat &_image, const cv::Mat &_byteMask, cv::Mat &_outputMask)
+{
+    if (m_maskCleanupVotes == 0)
+    {
+        return;
+    }
+    const bool packedOutput{m_maskFormat == MaskFormat::PackedBits};
+    const int width{_image.size().width};
+    const MaskRowFilter *above{nullptr};
+    for (size_t np{0}; np < m_numProcessesParallel; ++np)
+    {
+        const int numRows{m_imgSizesParallel[np]->height};
+        if (numRows == 0)
+        {
+            continue;
+        }
+        const MaskRowFilter *below{nullptr};
+        for (size_t next{np + 1}; next < m_numProcessesParallel && below == nullptr; ++next)
+        {
+            if (m_imgSizesParallel[next]->height > 0)
+            {
+                below = &m_maskFilters[next];
+            }
+        }
+        const int startY{(int)(m_imgSizesParallel[np]->originalPixelPos / width)};
+        // Without a byte mask (fused kernels, packed output, no Bayer) only the first and last rows are rebuilt here
+        const auto seamRow = [&](int _y)
+        {
+            return _byteMask.empty() ? m_seamRows.data() + (_y == 0 ? 0 : width) : (uint8_t *)_byteMask.ptr<uint8_t>(startY + _y);
+        };
+
+        MaskRowFilter &filter{m_maskFilters[np]};
+        filter.filterFirstRow(above, below, seamRow(0));
+        if (numRows > 1)
+        {
+            filter.filterLastRow(below, seamRow(numRows - 1));
+        }
+        above = &filter;
+
+        const cv::Range innerRows{innerMaskRows(_image, numRows)};
+        if (isBayerInput(_image))
+        {
+            const cv::Mat maskPartial{_byteMask.rowRange(startY, startY + numRows)};
+            cv::Mat headRows{maskPartial.rowRange(0, innerRows.start)};
+            cv::Mat tailRows{maskPartial.rowRange(innerRows.end, numRows)};
+            fuseBayerQuads(headRows);
+            fuseBayerQuads(tailRows);
+        }
+
+        const auto finishRow = [&](int _y)
+        {
+            if (packedOutput)
+            {
+                packMaskRow(seamRow(_y), _outputMask.ptr<uint8_t>(startY + _y), width);
+            }
+            return m_trackDirtyRows && maskRowHasForeground(seamRow(_y), width);
+        };
+        std::vector<cv::Range> &dirtyRows{m_dirtyRowsParallel[np]};
+        for (int y{innerRows.start - 1}; y >= 0; --y)
+        {
+            if (finishRow(y))
+            {
+                if (!dirtyRows.empty() && dirtyRows.front().start == startY + y + 1)
+                {
+                    --dirtyRows.front().start;
+                }
+                else
+                {
+                    dirtyRows.insert(dirtyRows.begin(), cv::Range(startY + y, startY + y + 1));
+                }
+            }
+        }
+        for (int y{innerRows.end}; y < numRows; ++y)
+        {
+            if (finishRow(y))
+            {
+                if (!dirtyRows.empty() && dirtyRows.back().end == startY + y)
+                {
+                    ++dirtyRows.back().end;
+                }
+                else
+                {
+                    dirtyRows.emplace_back(startY + y, startY + y + 1);
+                }
+            }
+        }
+    }
+}
+
+void CoreBgs::collectDirtyRows(const cv::Mat &_fgmask, const cv::Range &_rows, int _numProcess)
 {
-    std::for_each(
-        std::execution::par,
-        m_processSeq.begin(),
-        m_processSeq.end(),
-        [&](int np)
+    if (!m_trackDirtyRows)
+    {
+        return;
+    }
+    std::vector<cv::Range> &dirtyRows{m_dirtyRowsParallel[_numProcess]};
+    dirtyRows.clear();
+    const int startY{(int)(m_imgSizesParallel[_numProcess]->originalPixelPos / m_imgSizesParallel[_numProcess]->width)};
+    for (int y{_rows.start}; y < _rows.end; ++y)
+    {
+        if (maskRowHasForeground(_fgmask.ptr<uint8_t>(y), _fgmask.cols))
         {
-            const cv::Mat imgSplit(m_imgSizesParallel[np]->height, m_imgSizesParallel[np]->width, _image.type(),
-                                   _image.data + (m_imgSizesParallel[np]->originalPixelPos * m_imgSizesParallel[np]->numChannels * m_imgSizesParallel[np]->bytesPerPixel));
-            cv::Mat maskPartial(m_imgSizesParallel[np]->height, m_imgSizesParallel[np]->width, _fgmask.type(),
-                                _fgmask.data + m_imgSizesParallel[np]->originalPixelPos);
-            process(imgSplit, maskPartial, np);
-        });
+            if (!dirtyRows.empty() && dirtyRows.back().end == startY + y)
+            {
+                ++dirtyRows.back().end;
+            }
+            else
+            {
+                dirtyRows.emplace_back(startY + y, startY + y + 1);
+            }
+        }
+    }
+}
+
+void CoreBgs::joinDirtyRows()
+{
+    if (!m_trackDirtyRows)
+    {
+        return;
+    }
+    m_dirtyRows.clear();
+    for (const auto &dirtyRows : m_dirtyRowsParallel)
+    {
+        for (const cv::Range &range : dirtyRows)
+        {
+            if (!m_dirtyRows.empty() && m_dirtyRows.back().end == range.start)
+            {
+                m_dirtyRows.back().end = range.end;
+            }
+            else
+            {
+                m_dirtyRows.push_back(range);
+            }
+        }
+    }
+}
+
+void CoreBgs::fuseBayerQuads(cv::Mat &_fgmask)
+{
+    const int width{_fgmask.cols};
+    for (int y{0}; y < _fgmask.rows; y += 2)
+    {
+        uint8_t *const row0{_fgmask.ptr<uint8_t>(y)};
+        uint8_t *const row1{(y + 1) < _fgmask.rows ? _fgmask.ptr<uint8_t>(y + 1) : row0};
+        int x{0};
+        for (; x < width - 1; x += 2)
+        {
+            const uint8_t quad{std::max(std::max(row0[x], row0[x + 1]), std::max(row1[x], row1[x + 1]))};
+            row0[x] = row0[x + 1] = row1[x] = row1[x + 1] = quad;
+        }
+        if (x < width)
+        {
+            row0[x] = row1[x] = std::max(row0[x], row1[x]);
+        }
+    }
 }
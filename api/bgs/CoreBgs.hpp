@@ -1,9 +1,14 @@
 #pragma once
 
 #include "coreUtils.hpp"
+#include "maskUtils.hpp"
+#include "MaskRowFilter.hpp"
+#include "MaskRowWriter.hpp"
+#include "MappedArena.hpp"
 
 #include <opencv2/core.hpp>
 
+#include <memory>
 #include <vector>
 
 namespace sky360lib::bgs
@@ -15,11 +20,51 @@ namespace sky360lib::bgs
         /// Will set the number fo threads to the number of avaible threads - 1
         static const size_t DETECT_NUMBER_OF_THREADS{0};
 
+        /// Layout of the frames passed to apply
+        enum class InputFormat
+        {
+            /// Mono or already debayered colour frames
+            Default,
+            /// Raw single channel colour filter array (Bayer) mosaic, each 2x2 quad is treated as one super-pixel
+            BayerCFA
+        };
+
         CoreBgs(size_t _numProcessesParallel = DETECT_NUMBER_OF_THREADS);
+        virtual ~CoreBgs();
 
         void apply(const cv::Mat &_image, cv::Mat &_fgmask);
         cv::Mat applyRet(const cv::Mat &_image);
 
+        /// Changing the input format restarts the background model on the next apply
+        void setInputFormat(InputFormat _inputFormat);
+        InputFormat getInputFormat() const { return m_inputFormat; }
+
+        /// Bytes (default) or one bit per pixel masks, see MaskFormat
+        void setMaskFormat(MaskFormat _maskFormat);
+        MaskFormat getMaskFormat() const { return m_maskFormat; }
+
+        /// Optional 3x3 neighbourhood vote on the mask (see MaskRowFilter), 0 disables it, 5 acts like a median filter
+        /// Vibe and WMV apply it inside their kernels as the rows are produced, the other backends right after each split
+        void setMaskCleanup(int _minVotes);
+        int getMaskCleanup() const { return m_maskCleanupVotes; }
+
+        /// When enabled apply records which mask rows have foreground, see getDirtyRows
+        void setTrackDirtyRows(bool _trackDirtyRows);
+        bool getTrackDirtyRows() const { return m_trackDirtyRows; }
+        /// Sorted, non overlapping row ranges of the last mask that have foreground, empty when the mask is all background.
+        /// Only filled when tracking is enabled, meant to be passed on to ConnectedBlobDetection::detect
+        const std::vector<cv::Range> &getDirtyRows() const { return m_dirtyRows; }
+
+        /// Places the background model in a file backed arena instead of the heap, the model restarts on the next apply.
+        /// Backends that keep their model on a device (OpenCL, Halide) ignore it
+        void setModelArena(std::shared_ptr<MappedArena> _modelArena);
+        /// Writes the model back to the arena file and drops it from memory, it is paged back in by the next apply
+        void evictModel();
+        /// Starts paging the model back in ahead of the next apply
+        void prefetchModel();
+        /// Approximate size of the model for each pixel of _image, used to size tiles against a memory budget
+        virtual size_t getModelBytesPerPixel(const cv::Mat &_image) const { return _image.elemSize(); }
+
         virtual void getBackgroundImage(cv::Mat &_bgImage) = 0;
 
     protected:
@@ -27,12 +72,55 @@ namespace sky360lib::bgs
         virtual void process(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess) = 0;
 
         void prepareParallel(const cv::Mat &_image);
-        void applyParallel(const cv::Mat &_image, cv::Mat &_fgmask);
+        /// Runs one split, _byteMask is empty when the fused kernels pack their rows straight into _outputMask
+        void applySplit(const cv::Mat &_image, const cv::Mat &_byteMask, cv::Mat &_outputMask, int _numProcess);
+        void postProcessMask(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess);
+        /// Rows of a split that are final once the split is processed. With the cleanup enabled the first and last rows
+        /// (and their Bayer quads) depend on the neighbouring splits and are finished by finishSeams
+        cv::Range innerMaskRows(const cv::Mat &_image, int _numRows) const;
+        /// Filters the first and last rows of every split with the real rows around them, after all splits are processed,
+        /// so the mask does not depend on the number of splits
+        void finishSeams(const cv::Mat &_image, const cv::Mat &_byteMask, cv::Mat &_outputMask);
+        /// Scans _rows of the split while they are still in cache
+        void collectDirtyRows(const cv::Mat &_fgmask, const cv::Range &_rows, int _numProcess);
+        void joinDirtyRows();
+
+        /// Backends that write their mask rows through maskWriter() while processing return true,
+        /// the others write the whole split to the mask passed to process
+        virtual bool hasFusedMaskWriter() const { return false; }
+        MaskRowWriter &maskWriter(int _numProcess) { return m_maskWriters[_numProcess]; }
+        /// Row filter of the split, nullptr when the cleanup is disabled
+        MaskRowFilter *maskFilter(int _numProcess) { return m_maskFilters[_numProcess].enabled() ? &m_maskFilters[_numProcess] : nullptr; }
+
+        /// Model storage that lives until the model is initialised again, taken from the arena when there is one
+        uint8_t *allocModelBuffer(size_t _size);
+        void releaseModelBuffers();
+
+        /// True when the frames are a raw mosaic and the models must keep the 2x2 quad phase
+        bool isBayerInput(const cv::Mat &_image) const { return m_inputFormat == InputFormat::BayerCFA && _image.channels() == 1; }
+        /// Writes the strongest response of each 2x2 quad to all of its sensels
+        static void fuseBayerQuads(cv::Mat &_fgmask);
 
         size_t m_numProcessesParallel;
         bool m_initialized;
+        InputFormat m_inputFormat;
+        MaskFormat m_maskFormat;
+        /// Byte mask the backends without a fused writer, and the Bayer quad fusion, need when the output is packed
+        cv::Mat m_byteMask;
+        int m_maskCleanupVotes;
+        std::vector<MaskRowFilter> m_maskFilters;
+        std::vector<MaskRowWriter> m_maskWriters;
+        /// Bytes of the first and last rows of a split in finishSeams, when the fused kernels only kept them packed
+        std::vector<uint8_t> m_seamRows;
+        bool m_trackDirtyRows;
+        std::vector<std::vector<cv::Range>> m_dirtyRowsParallel;
+        std::vector<cv::Range> m_dirtyRows;
+        std::shared_ptr<MappedArena> m_modelArena;
+        /// Model buffers taken from m_modelArena, the heap ones are owned by m_modelHeapBuffers
+        std::vector<uint8_t *> m_modelArenaBuffers;
+        std::vector<std::unique_ptr<uint8_t[]>> m_modelHeapBuffers;
         std::vector<size_t> m_processSeq;
         std::vector<std::unique_ptr<ImgSize>> m_imgSizesParallel;
     };
 
-}
\ No newline at end of file
+}
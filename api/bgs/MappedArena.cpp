@@ -0,0 +1,135 @@
+#include "MappedArena.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace sky360lib::bgs;
+
+static size_t pageSize()
+{
+    static const size_t size{(size_t)sysconf(_SC_PAGESIZE)};
+    return size;
+}
+
+MappedArena::MappedArena(const std::string &_backingFile)
+    : m_fd{-1}, m_fileSize{0}
+{
+    if (_backingFile.empty())
+    {
+        const char *tmpDir{std::getenv("TMPDIR")};
+        std::string pattern{std::string(tmpDir != nullptr ? tmpDir : "/tmp") + "/sky360_model_XXXXXX"};
+        m_fd = mkstemp(pattern.data());
+        if (m_fd >= 0)
+        {
+            unlink(pattern.c_str());
+        }
+    }
+    else
+    {
+        m_fd = open(_backingFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (m_fd >= 0)
+        {
+            unlink(_backingFile.c_str());
+        }
+    }
+    if (m_fd < 0)
+    {
+        std::cerr << "MappedArena: could not create the backing file: " << strerror(errno) << std::endl;
+    }
+}
+
+MappedArena::~MappedArena()
+{
+    for (const Mapping &mapping : m_mappings)
+    {
+        munmap(mapping.data, mapping.size);
+    }
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+uint8_t *MappedArena::allocate(size_t _size)
+{
+    if (m_fd < 0 || _size == 0)
+    {
+        return nullptr;
+    }
+    const size_t size{(_size + pageSize() - 1) & ~(pageSize() - 1)};
+    const size_t offset{m_fileSize};
+    if (ftruncate(m_fd, (off_t)(offset + size)) != 0)
+    {
+        std::cerr << "MappedArena: could not grow the backing file: " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    void *data{mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, (off_t)offset)};
+    if (data == MAP_FAILED)
+    {
+        std::cerr << "MappedArena: could not map the backing file: " << strerror(errno) << std::endl;
+        return nullptr;
+    }
+    m_fileSize = offset + size;
+    m_mappings.push_back({(uint8_t *)data, size, offset});
+    return (uint8_t *)data;
+}
+
+MappedArena::Mapping *MappedArena::findMapping(const uint8_t *_data)
+{
+    auto it{std::find_if(m_mappings.begin(), m_mappings.end(),
+                         [&](const Mapping &_mapping)
+                         { return _mapping.data == _data; })};
+    return it != m_mappings.end() ? &*it : nullptr;
+}
+
+void MappedArena::release(uint8_t *_data)
+{
+    Mapping *mapping{findMapping(_data)};
+    if (mapping == nullptr)
+    {
+        return;
+    }
+    munmap(mapping->data, mapping->size);
+#ifdef FALLOC_FL_PUNCH_HOLE
+    fallocate(m_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t)mapping->offset, (off_t)mapping->size);
+#endif
+    // Shrinking the file when the last allocation goes away
+    if (mapping->offset + mapping->size == m_fileSize)
+    {
+        m_fileSize = mapping->offset;
+        if (ftruncate(m_fd, (off_t)m_fileSize) != 0)
+        {
+            std::cerr << "MappedArena: could not shrink the backing file: " << strerror(errno) << std::endl;
+        }
+    }
+    *mapping = m_mappings.back();
+    m_mappings.pop_back();
+}
+
+void MappedArena::evict(uint8_t *_data)
+{
+    const Mapping *mapping{findMapping(_data)};
+    if (mapping == nullptr)
+    {
+        return;
+    }
+    // The pages have to be clean before the page cache lets go of them
+    msync(mapping->data, mapping->size, MS_SYNC);
+    madvise(mapping->data, mapping->size, MADV_DONTNEED);
+    posix_fadvise(m_fd, (off_t)mapping->offset, (off_t)mapping->size, POSIX_FADV_DONTNEED);
+}
+
+void MappedArena::prefetch(uint8_t *_data)
+{
+    const Mapping *mapping{findMapping(_data)};
+    if (mapping != nullptr)
+    {
+        madvise(mapping->data, mapping->size, MADV_WILLNEED);
+    }
+}
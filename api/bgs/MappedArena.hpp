@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace sky360lib::bgs
+{
+    /// Memory backed by a file through mmap, used to keep the background models that are not in use out of RAM.
+    /// Every allocation is its own page aligned mapping of the file, so it can be evicted and released on its own.
+    /// Not thread safe, the models allocate and evict from the thread calling apply
+    class MappedArena final
+    {
+    public:
+        /// The backing file is created (or truncated) and unlinked right away, so it never outlives the arena.
+        /// An empty path uses a temporary file in $TMPDIR or /tmp
+        explicit MappedArena(const std::string &_backingFile = "");
+        ~MappedArena();
+
+        MappedArena(const MappedArena &) = delete;
+        MappedArena &operator=(const MappedArena &) = delete;
+
+        /// Returns nullptr if the file could not be grown or mapped
+        uint8_t *allocate(size_t _size);
+        /// Unmaps the allocation and gives its disk space back
+        void release(uint8_t *_data);
+        /// Writes the allocation back to the file and drops its pages from the process and the page cache
+        void evict(uint8_t *_data);
+        /// Asks the kernel to start reading the allocation back
+        void prefetch(uint8_t *_data);
+
+        bool isOpen() const { return m_fd >= 0; }
+        size_t getFileSize() const { return m_fileSize; }
+
+    private:
+        struct Mapping
+        {
+            uint8_t *data;
+            size_t size;
+            size_t offset;
+        };
+
+        int m_fd;
+        size_t m_fileSize;
+        std::vector<Mapping> m_mappings;
+
+        Mapping *findMapping(const uint8_t *_data);
+    };
+}
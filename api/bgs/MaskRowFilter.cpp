@@ -0,0 +1,80 @@
+#include "MaskRowFilter.hpp"
+
+#include <climits>
+#include <cstring>
+
+using namespace sky360lib::bgs;
+
+void MaskRowFilter::reset(int _width, int _minVotes)
+{
+    m_width = _width;
+    m_minVotes = _minVotes;
+    m_pendingRow = nullptr;
+    m_numRows = 0;
+    m_regionRows = 0;
+    if (!enabled())
+    {
+        return;
+    }
+    m_headRaw.resize((size_t)2 * _width);
+    m_aboveRaw.resize(_width);
+    m_pendingRaw.resize(_width);
+    m_zeroRow.assign(_width, ZERO_UC);
+    // One extra column on each side so the horizontal sum needs no border checks
+    m_columnVotes.assign(_width + 2, 0);
+}
+
+void MaskRowFilter::pushRow(uint8_t *_row)
+{
+    // The first row needs the row above the region, it waits for filterFirstRow
+    if (m_numRows >= 2)
+    {
+        filterRow(m_aboveRaw.data(), m_pendingRaw.data(), _row, m_pendingRow);
+    }
+    else
+    {
+        memcpy(m_headRaw.data() + (size_t)m_numRows * m_width, _row, m_width);
+    }
+    // The raw pending row becomes the row above, the new row is saved before it gets overwritten
+    m_aboveRaw.swap(m_pendingRaw);
+    memcpy(m_pendingRaw.data(), _row, m_width);
+    m_pendingRow = _row;
+    ++m_numRows;
+}
+
+void MaskRowFilter::finish()
+{
+    m_regionRows = m_numRows;
+    m_numRows = 0;
+    m_pendingRow = nullptr;
+}
+
+void MaskRowFilter::filterFirstRow(const MaskRowFilter *_above, const MaskRowFilter *_below, uint8_t *_out)
+{
+    const uint8_t *const above{_above != nullptr ? _above->lastRawRow() : m_zeroRow.data()};
+    const uint8_t *below{m_headRaw.data() + m_width};
+    if (m_regionRows < 2)
+    {
+        below = _below != nullptr ? _below->firstRawRow() : m_zeroRow.data();
+    }
+    filterRow(above, m_headRaw.data(), below, _out);
+}
+
+void MaskRowFilter::filterLastRow(const MaskRowFilter *_below, uint8_t *_out)
+{
+    filterRow(m_aboveRaw.data(), m_pendingRaw.data(), _below != nullptr ? _below->firstRawRow() : m_zeroRow.data(), _out);
+}
+
+void MaskRowFilter::filterRow(const uint8_t *_above, const uint8_t *_row, const uint8_t *_below, uint8_t *_out)
+{
+    uint8_t *const votes{m_columnVotes.data() + 1};
+    for (int x{0}; x < m_width; ++x)
+    {
+        votes[x] = (uint8_t)((_above[x] != 0) + (_row[x] != 0) + (_below[x] != 0));
+    }
+    const uint8_t minVotes{(uint8_t)m_minVotes};
+    for (int x{0}; x < m_width; ++x)
+    {
+        _out[x] = (uint8_t)(votes[x - 1] + votes[x] + votes[x + 1]) >= minVotes ? UCHAR_MAX : ZERO_UC;
+    }
+}
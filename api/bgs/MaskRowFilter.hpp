@@ -0,0 +1,51 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <vector>
+
+namespace sky360lib::bgs
+{
+    /// 3x3 neighbourhood vote applied to a mask while it is being generated, row by row.
+    /// A pixel is foreground when at least minVotes pixels of its 3x3 neighbourhood (itself included) are,
+    /// 5 behaves like a median filter: isolated pixels are removed and single pixel holes are filled.
+    /// Only three rows are kept. The first and last rows of a region depend on the rows of the neighbouring regions,
+    /// pushRow and finish leave them as they are and filterFirstRow/filterLastRow finish them once all regions are done.
+    class MaskRowFilter final
+    {
+    public:
+        /// Prepares the row buffers, a _minVotes of 0 disables the filter
+        void reset(int _width, int _minVotes);
+
+        inline bool enabled() const { return m_minVotes > 0; }
+
+        /// To be called as soon as row y of the mask is complete, writes the filtered row y - 1 in place (except the first row)
+        void pushRow(uint8_t *_row);
+        /// To be called after the last row of the region, the last row is not filtered
+        void finish();
+
+        /// Writes the filtered first row of the last region to _out. _above and _below are the filters of the regions
+        /// right above and below it, nullptr at the borders of the frame where the rows outside count as background
+        void filterFirstRow(const MaskRowFilter *_above, const MaskRowFilter *_below, uint8_t *_out);
+        /// Same for the last row, only when the region has more than one row
+        void filterLastRow(const MaskRowFilter *_below, uint8_t *_out);
+
+    private:
+        void filterRow(const uint8_t *_above, const uint8_t *_row, const uint8_t *_below, uint8_t *_out);
+
+        const uint8_t *firstRawRow() const { return m_headRaw.data(); }
+        const uint8_t *lastRawRow() const { return m_pendingRaw.data(); }
+
+        int m_width{0};
+        int m_minVotes{0};
+        uint8_t *m_pendingRow{nullptr};
+        int m_numRows{0};
+        int m_regionRows{0};
+        /// Unfiltered first two rows of the region, the last two are m_aboveRaw and m_pendingRaw once it is finished
+        std::vector<uint8_t> m_headRaw;
+        std::vector<uint8_t> m_aboveRaw;
+        std::vector<uint8_t> m_pendingRaw;
+        std::vector<uint8_t> m_zeroRow;
+        std::vector<uint8_t> m_columnVotes;
+    };
+}
@@ -0,0 +1,55 @@
+#include "MaskRowWriter.hpp"
+
+#include "maskUtils.hpp"
+
+using namespace sky360lib::bgs;
+
+void MaskRowWriter::reset(int _width)
+{
+    m_width = _width;
+    // Row y - 1 has to stay around until the filter has seen row y
+    m_scratch.resize((size_t)2 * _width);
+}
+
+void MaskRowWriter::begin(const cv::Mat &_byteMask, const cv::Mat &_packedMask, MaskRowFilter *_filter)
+{
+    m_byteRows = _byteMask.empty() ? nullptr : _byteMask.data;
+    m_height = _byteMask.empty() ? _packedMask.rows : _byteMask.rows;
+    m_packedMask = _packedMask;
+    m_filter = _filter;
+}
+
+void MaskRowWriter::rowDone(int _y)
+{
+    if (m_filter == nullptr)
+    {
+        packRow(_y);
+        return;
+    }
+    // Pushing row y completes row y - 1
+    m_filter->pushRow(row(_y));
+    if (_y > 0)
+    {
+        packRow(_y - 1);
+    }
+}
+
+void MaskRowWriter::finish()
+{
+    if (m_filter != nullptr)
+    {
+        m_filter->finish();
+        if (m_height > 0)
+        {
+            packRow(m_height - 1);
+        }
+    }
+}
+
+void MaskRowWriter::packRow(int _y)
+{
+    if (m_byteRows == nullptr)
+    {
+        packMaskRow(row(_y), m_packedMask.ptr<uint8_t>(_y), m_width);
+    }
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "MaskRowFilter.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace sky360lib::bgs
+{
+    /// Destination of the mask rows of a split for the kernels that produce them one at a time (Vibe, WMV).
+    /// The rows go straight to a byte mask, or to a two row scratch that is packed as soon as the cleanup filter
+    /// is done with a row, so a packed mask never goes through a full size byte mask
+    class MaskRowWriter final
+    {
+    public:
+        /// Allocates the scratch rows
+        void reset(int _width);
+
+        /// To be called before the kernel of every frame. The rows are written to _byteMask, or packed into _packedMask
+        /// when _byteMask is empty. _filter is nullptr when the cleanup is disabled
+        void begin(const cv::Mat &_byteMask, const cv::Mat &_packedMask, MaskRowFilter *_filter);
+
+        /// True when the rows are contiguous bytes that need nothing between them, the kernel can write the split in one go to data()
+        inline bool isDirect() const { return m_byteRows != nullptr && m_filter == nullptr; }
+        inline uint8_t *data() { return m_byteRows; }
+
+        /// Where the kernel writes row _y
+        inline uint8_t *row(int _y) { return m_byteRows != nullptr ? m_byteRows + (size_t)_y * m_width : m_scratch.data() + (size_t)(_y & 1) * m_width; }
+        /// To be called as soon as row _y is complete
+        void rowDone(int _y);
+        /// To be called after the last row
+        void finish();
+
+    private:
+        void packRow(int _y);
+
+        int m_width{0};
+        int m_height{0};
+        uint8_t *m_byteRows{nullptr};
+        cv::Mat m_packedMask;
+        MaskRowFilter *m_filter{nullptr};
+        std::vector<uint8_t> m_scratch;
+    };
+}
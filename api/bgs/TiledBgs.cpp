@@ -0,0 +1,223 @@
+#include "TiledBgs.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace sky360lib::bgs;
+
+TiledBgs::TiledBgs(BgsFactory _bgsFactory, size_t _maxResidentBytes, const std::string &_backingFile, int _overlapRows)
+    : m_bgsFactory{std::move(_bgsFactory)},
+      m_maxResidentBytes{_maxResidentBytes},
+      m_overlapRows{std::max(_overlapRows, 0)},
+      m_initialized{false},
+      m_tileRows{0},
+      m_maxTileRows{0},
+      m_inputFormat{CoreBgs::InputFormat::Default},
+      m_maskFormat{MaskFormat::Bytes},
+      m_maskCleanupVotes{0},
+      m_trackDirtyRows{false}
+{
+    if (m_maxResidentBytes > 0)
+    {
+        m_modelArena = std::make_shared<MappedArena>(_backingFile);
+        if (!m_modelArena->isOpen())
+        {
+            std::cerr << "TiledBgs: models will be kept on the heap" << std::endl;
+            m_modelArena.reset();
+        }
+    }
+}
+
+void TiledBgs::apply(const cv::Mat &_image, cv::Mat &_fgmask)
+{
+    if (m_maskFormat == MaskFormat::PackedBits)
+    {
+        _fgmask.create(_image.rows, packedMaskWidth(_image.cols), CV_8UC1);
+    }
+    else
+    {
+        _fgmask.create(_image.size(), CV_8UC1);
+    }
+    apply(_image,
+          [&](const cv::Mat &_tileMask, int _startY)
+          {
+              cv::Mat fgmaskRows{_fgmask.rowRange(_startY, _startY + _tileMask.rows)};
+              _tileMask.copyTo(fgmaskRows);
+          });
+}
+
+void TiledBgs::apply(const cv::Mat &_image, const TileCallback &_onTile)
+{
+    if (!m_initialized)
+    {
+        prepareTiles(_image);
+        m_initialized = true;
+    }
+
+    const int maskCols{m_maskFormat == MaskFormat::PackedBits ? packedMaskWidth(_image.cols) : _image.cols};
+    m_tileMask.create(m_maxTileRows, maskCols, CV_8UC1);
+
+    m_dirtyRows.clear();
+    for (size_t i{0}; i < m_tiles.size(); ++i)
+    {
+        Tile &tile{m_tiles[i]};
+        // Paging the next model in while this one is processed
+        if (i + 1 < m_tiles.size())
+        {
+            m_tiles[i + 1].bgs->prefetchModel();
+        }
+
+        const int numRows{tile.overlapTop + (tile.endY - tile.startY) + tile.overlapBottom};
+        const cv::Mat tileImage{_image.rowRange(tile.startY - tile.overlapTop, tile.endY + tile.overlapBottom)};
+        cv::Mat tileMask{m_tileMask.rowRange(0, numRows)};
+        tile.bgs->apply(tileImage, tileMask);
+
+        collectDirtyRows(tile);
+        _onTile(tileMask.rowRange(tile.overlapTop, tile.overlapTop + (tile.endY - tile.startY)), tile.startY);
+
+        if (m_tiles.size() > 1)
+        {
+            tile.bgs->evictModel();
+        }
+    }
+}
+
+void TiledBgs::getBackgroundImage(cv::Mat &_bgImage)
+{
+    for (Tile &tile : m_tiles)
+    {
+        tile.bgs->getBackgroundImage(m_tileBgImage);
+        if (m_tiles.size() > 1)
+        {
+            tile.bgs->evictModel();
+        }
+        if (m_tileBgImage.empty())
+        {
+            continue;
+        }
+        if (_bgImage.rows != m_tiles.back().endY || _bgImage.cols != m_tileBgImage.cols || _bgImage.type() != m_tileBgImage.type())
+        {
+            _bgImage.create(m_tiles.back().endY, m_tileBgImage.cols, m_tileBgImage.type());
+        }
+        cv::Mat bgImageRows{_bgImage.rowRange(tile.startY, tile.endY)};
+        m_tileBgImage.rowRange(tile.overlapTop, tile.overlapTop + (tile.endY - tile.startY)).copyTo(bgImageRows);
+    }
+}
+
+void TiledBgs::setInputFormat(CoreBgs::InputFormat _inputFormat)
+{
+    if (_inputFormat != m_inputFormat)
+    {
+        m_inputFormat = _inputFormat;
+        // The tile borders depend on the input format
+        m_initialized = false;
+    }
+}
+
+void TiledBgs::setMaskFormat(MaskFormat _maskFormat)
+{
+    m_maskFormat = _maskFormat;
+    for (Tile &tile : m_tiles)
+    {
+        tile.bgs->setMaskFormat(m_maskFormat);
+    }
+}
+
+void TiledBgs::setMaskCleanup(int _minVotes)
+{
+    m_maskCleanupVotes = _minVotes;
+    for (Tile &tile : m_tiles)
+    {
+        tile.bgs->setMaskCleanup(m_maskCleanupVotes);
+    }
+}
+
+void TiledBgs::setTrackDirtyRows(bool _trackDirtyRows)
+{
+    m_trackDirtyRows = _trackDirtyRows;
+    m_dirtyRows.clear();
+    for (Tile &tile : m_tiles)
+    {
+        tile.bgs->setTrackDirtyRows(m_trackDirtyRows);
+    }
+}
+
+void TiledBgs::configureTile(CoreBgs &_bgs) const
+{
+    _bgs.setInputFormat(m_inputFormat);
+    _bgs.setMaskFormat(m_maskFormat);
+    _bgs.setMaskCleanup(m_maskCleanupVotes);
+    _bgs.setTrackDirtyRows(m_trackDirtyRows);
+    if (m_modelArena != nullptr)
+    {
+        _bgs.setModelArena(m_modelArena);
+    }
+}
+
+void TiledBgs::prepareTiles(const cv::Mat &_image)
+{
+    m_tiles.clear();
+    std::unique_ptr<CoreBgs> firstBgs{m_bgsFactory()};
+
+    const bool bayerInput{m_inputFormat == CoreBgs::InputFormat::BayerCFA && _image.channels() == 1};
+    int overlapRows{bayerInput ? (m_overlapRows + 1) & ~1 : m_overlapRows};
+    int tileRows{_image.rows};
+    const size_t modelBytesPerRow{firstBgs->getModelBytesPerPixel(_image) * (size_t)_image.cols};
+    if (m_modelArena != nullptr && modelBytesPerRow > 0)
+    {
+        // Two models are resident at a time, the one being processed and the one being prefetched
+        const size_t rowsInBudget{m_maxResidentBytes / 2 / modelBytesPerRow};
+        tileRows = (int)std::min<size_t>(std::max<size_t>(rowsInBudget, 2 * overlapRows + MIN_TILE_ROWS) - 2 * overlapRows, _image.rows);
+    }
+    if (bayerInput && tileRows < _image.rows)
+    {
+        // Tiles have to start on even rows to keep the CFA phase
+        tileRows &= ~1;
+    }
+    if (tileRows >= _image.rows)
+    {
+        overlapRows = 0;
+    }
+    m_tileRows = tileRows;
+
+    m_maxTileRows = 0;
+    for (int y{0}; y < _image.rows; y += tileRows)
+    {
+        Tile tile;
+        tile.bgs = m_tiles.empty() ? std::move(firstBgs) : m_bgsFactory();
+        tile.startY = y;
+        tile.endY = std::min(y + tileRows, _image.rows);
+        tile.overlapTop = std::min(overlapRows, tile.startY);
+        tile.overlapBottom = std::min(overlapRows, _image.rows - tile.endY);
+        configureTile(*tile.bgs);
+        m_maxTileRows = std::max(m_maxTileRows, tile.overlapTop + (tile.endY - tile.startY) + tile.overlapBottom);
+        m_tiles.push_back(std::move(tile));
+    }
+}
+
+void TiledBgs::collectDirtyRows(const Tile &_tile)
+{
+    if (!m_trackDirtyRows)
+    {
+        return;
+    }
+    const int tileRows{_tile.endY - _tile.startY};
+    const int shiftY{_tile.startY - _tile.overlapTop};
+    for (const cv::Range &range : _tile.bgs->getDirtyRows())
+    {
+        const int start{std::max(range.start, _tile.overlapTop) + shiftY};
+        const int end{std::min(range.end, _tile.overlapTop + tileRows) + shiftY};
+        if (start >= end)
+        {
+            continue;
+        }
+        if (!m_dirtyRows.empty() && m_dirtyRows.back().end == start)
+        {
+            m_dirtyRows.back().end = end;
+        }
+        else
+        {
+            m_dirtyRows.emplace_back(start, end);
+        }
+    }
+}
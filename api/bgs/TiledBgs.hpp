@@ -0,0 +1,85 @@
+#pragma once
+
+#include "CoreBgs.hpp"
+#include "MappedArena.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace sky360lib::bgs
+{
+    /// Runs a background subtractor over the frame as a sequence of horizontal tiles, each one with its own model.
+    /// The models live in a file backed arena and only the tile being processed and the next one (being prefetched)
+    /// are kept in memory, so the memory used by the models follows the budget and not the sensor size.
+    /// Each tile is processed with a few extra rows above and below so its models see the neighbourhood at the
+    /// tile borders, only the rows that belong to the tile make it to the mask.
+    class TiledBgs final
+    {
+    public:
+        using BgsFactory = std::function<std::unique_ptr<CoreBgs>()>;
+        /// Receives the mask rows of each tile, from the top down, in the mask format of the tiles
+        using TileCallback = std::function<void(const cv::Mat &_tileMask, int _startY)>;
+
+        static const int DEFAULT_OVERLAP_ROWS{4};
+        static const int MIN_TILE_ROWS{16};
+
+        /// _maxResidentBytes is the budget for the models held in memory at the same time,
+        /// 0 keeps the whole frame in a single tile with its model on the heap
+        TiledBgs(BgsFactory _bgsFactory, size_t _maxResidentBytes,
+                 const std::string &_backingFile = "", int _overlapRows = DEFAULT_OVERLAP_ROWS);
+
+        void apply(const cv::Mat &_image, cv::Mat &_fgmask);
+        /// Hands the mask over tile by tile without building the full frame mask,
+        /// ConnectedBlobDetection::addTile can take them directly
+        void apply(const cv::Mat &_image, const TileCallback &_onTile);
+
+        void getBackgroundImage(cv::Mat &_bgImage);
+
+        /// The settings are forwarded to every tile, changing the input format restarts the models
+        void setInputFormat(CoreBgs::InputFormat _inputFormat);
+        void setMaskFormat(MaskFormat _maskFormat);
+        void setMaskCleanup(int _minVotes);
+        void setTrackDirtyRows(bool _trackDirtyRows);
+        /// Dirty rows of the last frame in frame coordinates, see CoreBgs::getDirtyRows
+        const std::vector<cv::Range> &getDirtyRows() const { return m_dirtyRows; }
+
+        int getTileRows() const { return m_tileRows; }
+
+    private:
+        struct Tile
+        {
+            std::unique_ptr<CoreBgs> bgs;
+            /// Rows of the frame owned by the tile
+            int startY;
+            int endY;
+            /// Extra rows processed above and below
+            int overlapTop;
+            int overlapBottom;
+        };
+
+        BgsFactory m_bgsFactory;
+        size_t m_maxResidentBytes;
+        int m_overlapRows;
+        std::shared_ptr<MappedArena> m_modelArena;
+        bool m_initialized;
+        int m_tileRows;
+        int m_maxTileRows;
+        CoreBgs::InputFormat m_inputFormat;
+        MaskFormat m_maskFormat;
+        int m_maskCleanupVotes;
+        bool m_trackDirtyRows;
+        std::vector<Tile> m_tiles;
+        /// Mask of the tallest tile with its overlap, every tile writes to its first rows
+        cv::Mat m_tileMask;
+        cv::Mat m_tileBgImage;
+        std::vector<cv::Range> m_dirtyRows;
+
+        void prepareTiles(const cv::Mat &_image);
+        void configureTile(CoreBgs &_bgs) const;
+        void collectDirtyRows(const Tile &_tile);
+    };
+}
@@ -6,9 +6,10 @@ namespace
     class WMVColorGenerator : public Halide::Generator<WMVColorGenerator>
     {
     public:
-        Input<Buffer<uint8_t, 3>> input0{"input1"};
-        Input<Buffer<uint8_t, 3>> input1{"input2"};
-        Input<Buffer<uint8_t, 3>> input2{"input3"};
+        // uint8 or uint16, set at build time with the input1.type, input2.type and input3.type generator params
+        Input<Buffer<void, 3>> input0{"input1"};
+        Input<Buffer<void, 3>> input1{"input2"};
+        Input<Buffer<void, 3>> input2{"input3"};
         Input<float> w0{"w0"};
         Input<float> w1{"w1"};
         Input<float> w2{"w2"};
@@ -22,7 +23,6 @@ namespace
             Func mR, mG, mB;
             Func vR, vG, vB;
             Func r, g, b;
-            Func result;
             Expr w[] = {w0, w1, w2};
             iR(x, y) = {cast<float>(input0(x, y, 0)), cast<float>(input1(x, y, 0)), cast<float>(input2(x, y, 0))};
             iG(x, y) = {cast<float>(input0(x, y, 1)), cast<float>(input1(x, y, 1)), cast<float>(input2(x, y, 1))};
@@ -36,8 +36,7 @@ namespace
             r(x, y) = (vR(x, y)[0] * vR(x, y)[0] * w[0]) + (vR(x, y)[1] * vR(x, y)[1] * w[1]) + (vR(x, y)[2] * vR(x, y)[2] * w[2]);
             g(x, y) = (vG(x, y)[0] * vG(x, y)[0] * w[0]) + (vG(x, y)[1] * vG(x, y)[1] * w[1]) + (vG(x, y)[2] * vG(x, y)[2] * w[2]);
             b(x, y) = (vB(x, y)[0] * vB(x, y)[0] * w[0]) + (vB(x, y)[1] * vB(x, y)[1] * w[1]) + (vB(x, y)[2] * vB(x, y)[2] * w[2]);
-            result(x, y) = r(x, y) * 0.299f + g(x, y) * 0.587f + b(x, y) * 0.114f;
-            output(x, y) = cast<uint8_t>(sqrt(result(x, y)));
+            output(x, y) = saturating_cast<uint8_t>(round(sqrt(r(x, y)) * 0.299f + sqrt(g(x, y)) * 0.587f + sqrt(b(x, y)) * 0.114f));
 
             input0.set_estimates({{0, 2880}, {0, 2880}, {0, 2}});
             input1.set_estimates({{0, 2880}, {0, 2880}, {0, 2}});
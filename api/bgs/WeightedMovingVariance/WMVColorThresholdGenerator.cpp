@@ -6,9 +6,10 @@ namespace
     class WMVColorThresholdGenerator : public Halide::Generator<WMVColorThresholdGenerator>
     {
     public:
-        Input<Buffer<uint8_t, 3>> input0{"input1"};
-        Input<Buffer<uint8_t, 3>> input1{"input2"};
-        Input<Buffer<uint8_t, 3>> input2{"input3"};
+        // uint8 or uint16, set at build time with the input1.type, input2.type and input3.type generator params
+        Input<Buffer<void, 3>> input0{"input1"};
+        Input<Buffer<void, 3>> input1{"input2"};
+        Input<Buffer<void, 3>> input2{"input3"};
         Input<float> w0{"w0"};
         Input<float> w1{"w1"};
         Input<float> w2{"w2"};
@@ -6,9 +6,10 @@ namespace
     class WMVMono : public Halide::Generator<WMVMono>
     {
     public:
-        Input<Buffer<uint8_t, 2>> input0{"input1"};
-        Input<Buffer<uint8_t, 2>> input1{"input2"};
-        Input<Buffer<uint8_t, 2>> input2{"input3"};
+        // uint8 or uint16, set at build time with the input1.type, input2.type and input3.type generator params
+        Input<Buffer<void, 2>> input0{"input1"};
+        Input<Buffer<void, 2>> input1{"input2"};
+        Input<Buffer<void, 2>> input2{"input3"};
         Input<float> w0{"w0"};
         Input<float> w1{"w1"};
         Input<float> w2{"w2"};
@@ -24,7 +25,7 @@ namespace
             m(x, y) = (i(x, y)[0] * w[0]) + (i(x, y)[1] * w[1]) + (i(x, y)[2] * w[2]);
             v(x, y) = {i(x, y)[0] - m(x, y), i(x, y)[1] - m(x, y), i(x, y)[2] - m(x, y)};
             r(x, y) = (v(x, y)[0] * v(x, y)[0] * w[0]) + (v(x, y)[1] * v(x, y)[1] * w[1]) + (v(x, y)[2] * v(x, y)[2] * w[2]);
-            output(x, y) = cast<uint8_t>(sqrt(r(x, y)));
+            output(x, y) = saturating_cast<uint8_t>(round(sqrt(r(x, y))));
 
             input0.set_estimates({{0, 2880}, {0, 2880}});
             input1.set_estimates({{0, 2880}, {0, 2880}});
@@ -34,9 +34,9 @@ void WeightedMovingVariance::initialize(const cv::Mat &)
         imgInputPrev[i].pImgInput = nullptr;
         imgInputPrev[i].pImgInputPrev1 = nullptr;
         imgInputPrev[i].pImgInputPrev2 = nullptr;
-        imgInputPrev[i].pImgMem[0] = std::make_unique_for_overwrite<uint8_t[]>(imgInputPrev[i].pImgSize->sizeInBytes);
-        imgInputPrev[i].pImgMem[1] = std::make_unique_for_overwrite<uint8_t[]>(imgInputPrev[i].pImgSize->sizeInBytes);
-        imgInputPrev[i].pImgMem[2] = std::make_unique_for_overwrite<uint8_t[]>(imgInputPrev[i].pImgSize->sizeInBytes);
+        imgInputPrev[i].pImgMem[0] = allocModelBuffer(imgInputPrev[i].pImgSize->sizeInBytes);
+        imgInputPrev[i].pImgMem[1] = allocModelBuffer(imgInputPrev[i].pImgSize->sizeInBytes);
+        imgInputPrev[i].pImgMem[2] = allocModelBuffer(imgInputPrev[i].pImgSize->sizeInBytes);
         rollImages(imgInputPrev[i]);
     }
 }
@@ -44,66 +44,89 @@ void WeightedMovingVariance::initialize(const cv::Mat &)
 void WeightedMovingVariance::rollImages(RollingImages &rollingImages)
 {
     const auto rollingIdx = ROLLING_BG_IDX[rollingImages.currentRollingIdx % 3];
-    rollingImages.pImgInput = rollingImages.pImgMem[rollingIdx[0]].get();
-    rollingImages.pImgInputPrev1 = rollingImages.pImgMem[rollingIdx[1]].get();
-    rollingImages.pImgInputPrev2 = rollingImages.pImgMem[rollingIdx[2]].get();
+    rollingImages.pImgInput = rollingImages.pImgMem[rollingIdx[0]];
+    rollingImages.pImgInputPrev1 = rollingImages.pImgMem[rollingIdx[1]];
+    rollingImages.pImgInputPrev2 = rollingImages.pImgMem[rollingIdx[2]];
 
     ++rollingImages.currentRollingIdx;
 }
 
-void WeightedMovingVariance::process(const cv::Mat &_imgInput, cv::Mat &_imgOutput, int _numProcess)
+void WeightedMovingVariance::process(const cv::Mat &_imgInput, cv::Mat &, int _numProcess)
 {
-    if (_imgOutput.empty())
-    {
-        _imgOutput.create(_imgInput.size(), CV_8UC1);
-    }
-    process(_imgInput, _imgOutput, imgInputPrev[_numProcess], m_params);
+    process(_imgInput, imgInputPrev[_numProcess], m_params, maskWriter(_numProcess));
     rollImages(imgInputPrev[_numProcess]);
 }
 
 void WeightedMovingVariance::process(const cv::Mat &_inImage,
-                                     cv::Mat &_outImg,
                                      RollingImages &_imgInputPrev,
-                                     const WeightedMovingVarianceParams &_params)
+                                     const WeightedMovingVarianceParams &_params,
+                                     MaskRowWriter &_maskWriter)
 {
     memcpy(_imgInputPrev.pImgInput, _inImage.data, _imgInputPrev.pImgSize->sizeInBytes);
 
+    const size_t width{(size_t)_imgInputPrev.pImgSize->width};
     if (_imgInputPrev.firstPhase < 2)
     {
         ++_imgInputPrev.firstPhase;
+        // No variance yet, the mask is all background
+        for (int y{0}; y < _imgInputPrev.pImgSize->height; ++y)
+        {
+            memset(_maskWriter.row(y), ZERO_UC, width);
+            _maskWriter.rowDone(y);
+        }
+        _maskWriter.finish();
         return;
     }
 
-    if (_imgInputPrev.pImgSize->numChannels == 1)
+    const size_t numChannels{(size_t)_imgInputPrev.pImgSize->numChannels};
+    const auto applyKernel = [&](const size_t _pixelOffset, const size_t _numPixels, uint8_t *const outImg)
     {
-        if (_imgInputPrev.pImgSize->bytesPerPixel == 1)
+        const size_t offset{_pixelOffset * numChannels};
+        if (numChannels == 1)
         {
-            weightedVarianceMono(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
-                                _outImg.data, (size_t)_imgInputPrev.pImgSize->numPixels, 
-                                _params.weight, _params.enableThreshold, _params.thresholdSquared);
+            if (_imgInputPrev.pImgSize->bytesPerPixel == 1)
+            {
+                weightedVarianceMono(_imgInputPrev.pImgInput + offset, _imgInputPrev.pImgInputPrev1 + offset, _imgInputPrev.pImgInputPrev2 + offset,
+                                    outImg, _numPixels,
+                                    _params.weight, _params.enableThreshold, _params.thresholdSquared);
+            }
+            else
+            {
+                weightedVarianceMono((uint16_t*)_imgInputPrev.pImgInput + offset, (uint16_t*)_imgInputPrev.pImgInputPrev1 + offset, (uint16_t*)_imgInputPrev.pImgInputPrev2 + offset,
+                                    outImg, _numPixels,
+                                    _params.weight, _params.enableThreshold, _params.thresholdSquared16);
+            }
         }
         else
         {
-            weightedVarianceMono((uint16_t*)_imgInputPrev.pImgInput, (uint16_t*)_imgInputPrev.pImgInputPrev1, (uint16_t*)_imgInputPrev.pImgInputPrev2,
-                                _outImg.data, (size_t)_imgInputPrev.pImgSize->numPixels, 
-                                _params.weight, _params.enableThreshold, _params.thresholdSquared16);
+            if (_imgInputPrev.pImgSize->bytesPerPixel == 1)
+            {
+                weightedVarianceColor(_imgInputPrev.pImgInput + offset, _imgInputPrev.pImgInputPrev1 + offset, _imgInputPrev.pImgInputPrev2 + offset,
+                                    outImg, _numPixels,
+                                    _params.weight, _params.enableThreshold, _params.thresholdSquared);
+            }
+            else
+            {
+                weightedVarianceColor((uint16_t*)_imgInputPrev.pImgInput + offset, (uint16_t*)_imgInputPrev.pImgInputPrev1 + offset, (uint16_t*)_imgInputPrev.pImgInputPrev2 + offset,
+                                    outImg, _numPixels,
+                                    _params.weight, _params.enableThreshold, _params.thresholdSquared16);
+            }
         }
+    };
+
+    if (_maskWriter.isDirect())
+    {
+        applyKernel(0, _imgInputPrev.pImgSize->numPixels, _maskWriter.data());
+        return;
     }
-    else
+
+    // Row by row so the cleanup filter and the packing work on rows that are still in cache
+    for (int y{0}; y < _imgInputPrev.pImgSize->height; ++y)
     {
-        if (_imgInputPrev.pImgSize->bytesPerPixel == 1)
-        {
-            weightedVarianceColor(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
-                                _outImg.data, (size_t)_imgInputPrev.pImgSize->numPixels, 
-                                _params.weight, _params.enableThreshold, _params.thresholdSquared);
-        }
-        else
-        {
-            weightedVarianceColor((uint16_t*)_imgInputPrev.pImgInput, (uint16_t*)_imgInputPrev.pImgInputPrev1, (uint16_t*)_imgInputPrev.pImgInputPrev2,
-                                _outImg.data, (size_t)_imgInputPrev.pImgSize->numPixels, 
-                                _params.weight, _params.enableThreshold, _params.thresholdSquared16);
-        }
+        applyKernel(y * width, width, _maskWriter.row(y));
+        _maskWriter.rowDone(y);
     }
+    _maskWriter.finish();
 }
 
 template<class T>
@@ -115,7 +138,8 @@ inline void calcWeightedVarianceMono(const T *const i1, const T *const i2, const
         const float dI[]{(float)i1[i], (float)i2[i], (float)i3[i]};
         const float mean{(dI[0] * weight[0]) + (dI[1] * weight[1]) + (dI[2] * weight[2])};
         const float value[]{dI[0] - mean, dI[1] - mean, dI[2] - mean};
-        o[i] = std::sqrt(((value[0] * value[0]) * weight[0]) + ((value[1] * value[1]) * weight[1]) + ((value[2] * value[2]) * weight[2]));
+        // 16 bit inputs easily go past 255
+        o[i] = cv::saturate_cast<uint8_t>(std::sqrt(((value[0] * value[0]) * weight[0]) + ((value[1] * value[1]) * weight[1]) + ((value[2] * value[2]) * weight[2])));
     }
 }
 
@@ -147,13 +171,13 @@ inline void calcWeightedVarianceColor(const T *const i1, const T *const i2, cons
         const float meanR{(dI1[0] * weight[0]) + (dI2[0] * weight[1]) + (dI3[0] * weight[2])};
         const float meanG{(dI1[1] * weight[0]) + (dI2[1] * weight[1]) + (dI3[1] * weight[2])};
         const float meanB{(dI1[2] * weight[0]) + (dI2[2] * weight[1]) + (dI3[2] * weight[2])};
-        const float valueR[]{dI1[0] - meanR, dI2[0] - meanR, dI2[0] - meanR};
-        const float valueG[]{dI1[1] - meanG, dI2[1] - meanG, dI2[1] - meanG};
-        const float valueB[]{dI1[2] - meanB, dI2[2] - meanB, dI2[2] - meanB};
+        const float valueR[]{dI1[0] - meanR, dI2[0] - meanR, dI3[0] - meanR};
+        const float valueG[]{dI1[1] - meanG, dI2[1] - meanG, dI3[1] - meanG};
+        const float valueB[]{dI1[2] - meanB, dI2[2] - meanB, dI3[2] - meanB};
         const float r{std::sqrt(((valueR[0] * valueR[0]) * weight[0]) + ((valueR[1] * valueR[1]) * weight[1]) + ((valueR[2] * valueR[2]) * weight[2]))};
         const float g{std::sqrt(((valueG[0] * valueG[0]) * weight[0]) + ((valueG[1] * valueG[1]) * weight[1]) + ((valueG[2] * valueG[2]) * weight[2]))};
         const float b{std::sqrt(((valueB[0] * valueB[0]) * weight[0]) + ((valueB[1] * valueB[1]) * weight[1]) + ((valueB[2] * valueB[2]) * weight[2]))};
-        o[j] = 0.299f * r + 0.587f * g + 0.114f * b;
+        o[j] = cv::saturate_cast<uint8_t>(0.299f * r + 0.587f * g + 0.114f * b);
     }
 }
 
@@ -170,9 +194,9 @@ inline void calcWeightedVarianceColorThreshold(const T *const i1, const T *const
         const float meanR{(dI1[0] * weight[0]) + (dI2[0] * weight[1]) + (dI3[0] * weight[2])};
         const float meanG{(dI1[1] * weight[0]) + (dI2[1] * weight[1]) + (dI3[1] * weight[2])};
         const float meanB{(dI1[2] * weight[0]) + (dI2[2] * weight[1]) + (dI3[2] * weight[2])};
-        const float valueR[]{dI1[0] - meanR, dI2[0] - meanR, dI2[0] - meanR};
-        const float valueG[]{dI1[1] - meanG, dI2[1] - meanG, dI2[1] - meanG};
-        const float valueB[]{dI1[2] - meanB, dI2[2] - meanB, dI2[2] - meanB};
+        const float valueR[]{dI1[0] - meanR, dI2[0] - meanR, dI3[0] - meanR};
+        const float valueG[]{dI1[1] - meanG, dI2[1] - meanG, dI3[1] - meanG};
+        const float valueB[]{dI1[2] - meanB, dI2[2] - meanB, dI3[2] - meanB};
         const float r2{((valueR[0] * valueR[0]) * weight[0]) + ((valueR[1] * valueR[1]) * weight[1]) + ((valueR[2] * valueR[2]) * weight[2])};
         const float g2{((valueG[0] * valueG[0]) * weight[0]) + ((valueG[1] * valueG[1]) * weight[1]) + ((valueG[2] * valueG[2]) * weight[2])};
         const float b2{((valueB[0] * valueB[0]) * weight[0]) + ((valueB[1] * valueB[1]) * weight[1]) + ((valueB[2] * valueB[2]) * weight[2])};
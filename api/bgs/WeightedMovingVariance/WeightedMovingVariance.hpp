@@ -19,10 +19,12 @@ namespace sky360lib::bgs
         ~WeightedMovingVariance();
 
         void getBackgroundImage(cv::Mat &_bgImage);
+        size_t getModelBytesPerPixel(const cv::Mat &_image) const { return 3 * _image.elemSize(); }
 
     private:
         void initialize(const cv::Mat &_image);
         void process(const cv::Mat &img_input, cv::Mat &img_output, int _numProcess);
+        bool hasFusedMaskWriter() const { return true; }
 
         static const inline int ROLLING_BG_IDX[3][3] = {{0, 1, 2}, {2, 0, 1}, {1, 2, 0}};
 
@@ -37,15 +39,15 @@ namespace sky360lib::bgs
             uint8_t* pImgInputPrev1;
             uint8_t* pImgInputPrev2;
 
-            std::array<std::unique_ptr<uint8_t[]>, 3> pImgMem;
+            std::array<uint8_t*, 3> pImgMem;
         };
         std::vector<RollingImages> imgInputPrev;
 
         static void rollImages(RollingImages& rollingImages);
         static void process(const cv::Mat &_imgInput,
-                            cv::Mat &_imgOutput,
                             RollingImages &_imgInputPrev,
-                            const WeightedMovingVarianceParams &_params);
+                            const WeightedMovingVarianceParams &_params,
+                            MaskRowWriter &_maskWriter);
         template<class T>
         static void weightedVarianceMono(
             const T *const img1,
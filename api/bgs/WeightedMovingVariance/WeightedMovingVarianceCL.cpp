@@ -1,17 +1,89 @@
 #include "WeightedMovingVarianceCL.hpp"
 
-// opencv legacy includes
-// #include <opencv2/imgproc/types_c.h>
-#include <execution>
+#include <algorithm>
 #include <iostream>
+#include <stdexcept>
 
 using namespace sky360lib::bgs;
 
-WeightedMovingVarianceCL::WeightedMovingVarianceCL(const WeightedMovingVarianceParams& _params)
+// The same source is built once per input depth, T is uchar or ushort
+static const char *const WMV_KERNEL_SOURCE = R"(
+#pragma OPENCL FP_CONTRACT OFF
+
+inline float weightedVariance(const float i1, const float i2, const float i3,
+                              const float w0, const float w1, const float w2)
+{
+    const float mean = (i1 * w0) + (i2 * w1) + (i3 * w2);
+    const float v1 = i1 - mean;
+    const float v2 = i2 - mean;
+    const float v3 = i3 - mean;
+    return ((v1 * v1) * w0) + ((v2 * v2) * w1) + ((v3 * v3) * w2);
+}
+
+kernel void monoThreshold(global const T *i1, global const T *i2, global const T *i3, global uchar *o,
+                          const float w0, const float w1, const float w2, const float thresholdSquared)
+{
+    const size_t gid = get_global_id(0);
+    const float result = weightedVariance(i1[gid], i2[gid], i3[gid], w0, w1, w2);
+    o[gid] = result > thresholdSquared ? 255 : 0;
+}
+
+kernel void mono(global const T *i1, global const T *i2, global const T *i3, global uchar *o,
+                 const float w0, const float w1, const float w2, const float thresholdSquared)
+{
+    const size_t gid = get_global_id(0);
+    o[gid] = convert_uchar_sat_rte(sqrt(weightedVariance(i1[gid], i2[gid], i3[gid], w0, w1, w2)));
+}
+
+kernel void colorThreshold(global const T *i1, global const T *i2, global const T *i3, global uchar *o,
+                           const float w0, const float w1, const float w2, const float thresholdSquared)
+{
+    const size_t gid = get_global_id(0);
+    const size_t c = gid * 3;
+    const float r2 = weightedVariance(i1[c], i2[c], i3[c], w0, w1, w2);
+    const float g2 = weightedVariance(i1[c + 1], i2[c + 1], i3[c + 1], w0, w1, w2);
+    const float b2 = weightedVariance(i1[c + 2], i2[c + 2], i3[c + 2], w0, w1, w2);
+    const float result = 0.299f * r2 + 0.587f * g2 + 0.114f * b2;
+    o[gid] = result > thresholdSquared ? 255 : 0;
+}
+
+kernel void color(global const T *i1, global const T *i2, global const T *i3, global uchar *o,
+                  const float w0, const float w1, const float w2, const float thresholdSquared)
+{
+    const size_t gid = get_global_id(0);
+    const size_t c = gid * 3;
+    const float r = sqrt(weightedVariance(i1[c], i2[c], i3[c], w0, w1, w2));
+    const float g = sqrt(weightedVariance(i1[c + 1], i2[c + 1], i3[c + 1], w0, w1, w2));
+    const float b = sqrt(weightedVariance(i1[c + 2], i2[c + 2], i3[c + 2], w0, w1, w2));
+    o[gid] = convert_uchar_sat_rte(0.299f * r + 0.587f * g + 0.114f * b);
+}
+)";
+
+static const char *const WMV_PROGRAM_OPTIONS[2] = {"-D T=uchar", "-D T=ushort"};
+
+static int deviceTypeRank(cl_device_type _type)
+{
+    if (_type & CL_DEVICE_TYPE_GPU)
+        return 3;
+    if (_type & CL_DEVICE_TYPE_ACCELERATOR)
+        return 2;
+    if (_type & CL_DEVICE_TYPE_CPU)
+        return 1;
+    return 0;
+}
+
+WeightedMovingVarianceCL::WeightedMovingVarianceCL(const WeightedMovingVarianceParams& _params,
+                                                   cl_device_type _deviceType,
+                                                   size_t _numPipelineChunks)
     : CoreBgs(1),
-      m_params(_params)
+      m_params(_params),
+      m_numPipelineChunks{std::max(_numPipelineChunks, (size_t)1)},
+      m_thresholdSquared{_params.thresholdSquared}
 {
-    initOpenCL();
+    if (!initOpenCL(_deviceType))
+    {
+        throw std::runtime_error("WeightedMovingVarianceCL: OpenCL is not available");
+    }
 }
 
 WeightedMovingVarianceCL::~WeightedMovingVarianceCL()
@@ -25,68 +97,135 @@ void WeightedMovingVarianceCL::getBackgroundImage(cv::Mat &)
 
 void WeightedMovingVarianceCL::clearCL()
 {
-    for (size_t i = 0; i < m_numProcessesParallel; ++i)
+    if (imgInputPrev.empty())
     {
-        // if (imgInputPrev[i].pImgOutputCuda != nullptr)
-        //     cudaFree(imgInputPrev[i].pImgOutputCuda);
-        // if (imgInputPrev[i].pImgMem[0] != nullptr)
-        //     cudaFree(imgInputPrev[i].pImgMem[0]);
-        // if (imgInputPrev[i].pImgMem[1] != nullptr)
-        //     cudaFree(imgInputPrev[i].pImgMem[1]);
-        // if (imgInputPrev[i].pImgMem[2] != nullptr)
-        //     cudaFree(imgInputPrev[i].pImgMem[2]);
+        return;
+    }
+    m_uploadQueue.finish();
+    m_computeQueue.finish();
+    m_downloadQueue.finish();
+    for (auto &rollingImages : imgInputPrev)
+    {
+        for (size_t s{0}; s < rollingImages.bPinnedInput.size(); ++s)
+        {
+            if (rollingImages.pPinnedInput[s] != nullptr)
+            {
+                m_uploadQueue.enqueueUnmapMemObject(rollingImages.bPinnedInput[s], rollingImages.pPinnedInput[s]);
+            }
+            if (rollingImages.pPinnedOutput[s] != nullptr)
+            {
+                m_downloadQueue.enqueueUnmapMemObject(rollingImages.bPinnedOutput[s], rollingImages.pPinnedOutput[s]);
+            }
+        }
     }
+    m_uploadQueue.finish();
+    m_downloadQueue.finish();
+    // Releasing the cl::Buffer handles frees the device memory
+    imgInputPrev.clear();
+    m_pipelineChunks.clear();
 }
 
-void WeightedMovingVarianceCL::initOpenCL()
+bool WeightedMovingVarianceCL::selectDevice(cl_device_type _deviceType)
 {
     std::vector<cl::Platform> platforms;
-    cl::Platform::get(&platforms);
-    if (platforms.size() == 0)
+    if (cl::Platform::get(&platforms) != CL_SUCCESS || platforms.empty())
     {
-        std::cout << "No OpenCL supported." << std::endl;
-        return;
+        std::cerr << "OpenCL: no platforms found" << std::endl;
+        return false;
     }
-    cl::Platform platform = platforms[0];
-    std::vector<cl::Device> devices;
-    platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
-    std::cout << "OpenCL Using platform: " << platform.getInfo<CL_PLATFORM_NAME>() << std::endl;
-    std::cout << "OpenCL Number of devices: " << devices.size() << std::endl;
-    m_device = devices[0];
-
-    // output some device configuration
-    cl_uint computeUnits;
-    m_device.getInfo(CL_DEVICE_MAX_COMPUTE_UNITS, &computeUnits);
-    std::cout << "Using device: " << m_device.getInfo<CL_DEVICE_NAME>() << std::endl;
-    std::cout << "OpenCL Number of Compute Units: " << computeUnits << std::endl;
-
-    // Create the context and command queue
-    m_context = cl::Context({m_device});
-    m_queue = cl::CommandQueue(m_context, m_device);
-
-    // Create the program and kernel
-    std::string kernelSource = R"(
-void kernel monoThreshold(global const uchar * i1, global const uchar *i2, global const uchar *i3,
-                          global uchar *o, global float* _w, float _thresholdSquared)
-{
-    const int gid = get_global_id(0);
-    const float dI[3] = {(float)i1[gid], (float)i2[gid], (float)i3[gid]};
-    const float mean = (dI[0] * _w[0]) + (dI[1] * _w[1]) + (dI[2] * _w[2]);
-    const float value[3] = {dI[0] - mean, dI[1] - mean, dI[2] - mean};
-    const float result = ((value[0] * value[0]) * _w[0]) + ((value[1] * value[1]) * _w[1]) + ((value[2] * value[2]) * _w[2]);
-    o[gid] = result > _thresholdSquared ? 255 : 0;
+
+    int bestRank{-1};
+    cl_uint bestComputeUnits{0};
+    for (const auto &platform : platforms)
+    {
+        std::vector<cl::Device> devices;
+        if (platform.getDevices(_deviceType, &devices) != CL_SUCCESS)
+        {
+            continue;
+        }
+        for (const auto &device : devices)
+        {
+            if (!device.getInfo<CL_DEVICE_AVAILABLE>() || !device.getInfo<CL_DEVICE_COMPILER_AVAILABLE>())
+            {
+                continue;
+            }
+            const int rank{deviceTypeRank(device.getInfo<CL_DEVICE_TYPE>())};
+            const cl_uint computeUnits{device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>()};
+            if (rank > bestRank || (rank == bestRank && computeUnits > bestComputeUnits))
+            {
+                bestRank = rank;
+                bestComputeUnits = computeUnits;
+                m_device = device;
+            }
+        }
+    }
+    if (bestRank < 0)
+    {
+        std::cerr << "OpenCL: no available device with a compiler found" << std::endl;
+        return false;
+    }
+
+    std::cout << "OpenCL using platform: " << cl::Platform(m_device.getInfo<CL_DEVICE_PLATFORM>()).getInfo<CL_PLATFORM_NAME>() << std::endl;
+    std::cout << "OpenCL using device: " << m_device.getInfo<CL_DEVICE_NAME>() << ", compute units: " << bestComputeUnits << std::endl;
+    return true;
 }
-)";
-    m_program = cl::Program(m_context, kernelSource);
-    if (m_program.build({ m_device }) != CL_SUCCESS) {
-        std::cout << " OpenCL Error building: " << m_program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device) << std::endl;
-        exit(1);
+
+bool WeightedMovingVarianceCL::initOpenCL(cl_device_type _deviceType)
+{
+    if (!selectDevice(_deviceType))
+    {
+        return false;
+    }
+
+    cl_int err{CL_SUCCESS};
+    m_context = cl::Context(m_device, nullptr, nullptr, nullptr, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::cerr << "OpenCL: error creating context: " << err << std::endl;
+        return false;
     }
-    m_wmvKernel = cl::Kernel(m_program, "monoThreshold");
+    // Separate in-order queues so transfers of one chunk overlap with the compute of another
+    m_uploadQueue = cl::CommandQueue(m_context, m_device, 0, &err);
+    if (err == CL_SUCCESS)
+        m_computeQueue = cl::CommandQueue(m_context, m_device, 0, &err);
+    if (err == CL_SUCCESS)
+        m_downloadQueue = cl::CommandQueue(m_context, m_device, 0, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::cerr << "OpenCL: error creating command queues: " << err << std::endl;
+        return false;
+    }
+
+    for (size_t i{0}; i < m_programs.size(); ++i)
+    {
+        m_programs[i] = cl::Program(m_context, WMV_KERNEL_SOURCE, false, &err);
+        if (err != CL_SUCCESS || m_programs[i].build({m_device}, WMV_PROGRAM_OPTIONS[i]) != CL_SUCCESS)
+        {
+            std::cerr << "OpenCL: error building (" << WMV_PROGRAM_OPTIONS[i] << "): "
+                      << m_programs[i].getBuildInfo<CL_PROGRAM_BUILD_LOG>(m_device) << std::endl;
+            return false;
+        }
+    }
+    return true;
 }
 
-void WeightedMovingVarianceCL::initialize(const cv::Mat &)
+void WeightedMovingVarianceCL::initialize(const cv::Mat &_image)
 {
+    clearCL();
+
+    const bool is16Bits{_image.elemSize1() > 1};
+    const char *const kernelName{_image.channels() > 1
+                                     ? (m_params.enableThreshold ? "colorThreshold" : "color")
+                                     : (m_params.enableThreshold ? "monoThreshold" : "mono")};
+    cl_int err{CL_SUCCESS};
+    m_wmvKernel = cl::Kernel(m_programs[is16Bits ? 1 : 0], kernelName, &err);
+    if (err != CL_SUCCESS)
+    {
+        std::cerr << "OpenCL: error creating kernel " << kernelName << ": " << err << std::endl;
+        throw std::runtime_error("WeightedMovingVarianceCL: could not create kernel");
+    }
+    m_thresholdSquared = is16Bits ? m_params.thresholdSquared16 : m_params.thresholdSquared;
+
     imgInputPrev.resize(m_numProcessesParallel);
     for (size_t i = 0; i < m_numProcessesParallel; ++i)
     {
@@ -97,13 +236,37 @@ void WeightedMovingVarianceCL::initialize(const cv::Mat &)
         imgInputPrev[i].pImgInputPrev1 = nullptr;
         imgInputPrev[i].pImgInputPrev2 = nullptr;
 
-        imgInputPrev[i].pImgMem[0] = cl::Buffer(m_context, CL_MEM_READ_ONLY, imgInputPrev[i].pImgSize->sizeInBytes);
-        imgInputPrev[i].pImgMem[1] = cl::Buffer(m_context, CL_MEM_READ_ONLY, imgInputPrev[i].pImgSize->sizeInBytes);
-        imgInputPrev[i].pImgMem[2] = cl::Buffer(m_context, CL_MEM_READ_ONLY, imgInputPrev[i].pImgSize->sizeInBytes);
-        imgInputPrev[i].bImgOutput = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, imgInputPrev[i].pImgSize->numPixels);
-        imgInputPrev[i].bWeight = cl::Buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, 4 * sizeof(float), (void*)m_params.weight);
+        const size_t sizeInBytes{imgInputPrev[i].pImgSize->sizeInBytes};
+        const size_t numPixels{imgInputPrev[i].pImgSize->numPixels};
+        imgInputPrev[i].pImgMem[0] = cl::Buffer(m_context, CL_MEM_READ_ONLY, sizeInBytes);
+        imgInputPrev[i].pImgMem[1] = cl::Buffer(m_context, CL_MEM_READ_ONLY, sizeInBytes);
+        imgInputPrev[i].pImgMem[2] = cl::Buffer(m_context, CL_MEM_READ_ONLY, sizeInBytes);
+
+        imgInputPrev[i].frameSlot = 0;
+        imgInputPrev[i].hasPendingMask = false;
+        for (size_t s{0}; s < imgInputPrev[i].bImgOutput.size(); ++s)
+        {
+            imgInputPrev[i].bImgOutput[s] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY, numPixels);
+            imgInputPrev[i].bPinnedInput[s] = cl::Buffer(m_context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, sizeInBytes);
+            imgInputPrev[i].bPinnedOutput[s] = cl::Buffer(m_context, CL_MEM_WRITE_ONLY | CL_MEM_ALLOC_HOST_PTR, numPixels);
+            imgInputPrev[i].pPinnedInput[s] = (uint8_t *)m_uploadQueue.enqueueMapBuffer(imgInputPrev[i].bPinnedInput[s], CL_TRUE, CL_MAP_WRITE, 0, sizeInBytes);
+            imgInputPrev[i].pPinnedOutput[s] = (uint8_t *)m_downloadQueue.enqueueMapBuffer(imgInputPrev[i].bPinnedOutput[s], CL_TRUE, CL_MAP_READ, 0, numPixels);
+        }
         rollImages(imgInputPrev[i]);
     }
+
+    const size_t numPixels{(size_t)_image.size().area()};
+    const size_t numChunks{std::min(m_numPipelineChunks, std::max(numPixels, (size_t)1))};
+    m_pipelineChunks.resize(numChunks);
+    size_t pixelOffset{0};
+    for (size_t c{0}; c < numChunks; ++c)
+    {
+        m_pipelineChunks[c].pixelOffset = pixelOffset;
+        m_pipelineChunks[c].numPixels = (c == numChunks - 1) ? numPixels - pixelOffset : numPixels / numChunks;
+        m_pipelineChunks[c].uploaded.resize(1);
+        m_pipelineChunks[c].computed.resize(1);
+        pixelOffset += m_pipelineChunks[c].numPixels;
+    }
 }
 
 void WeightedMovingVarianceCL::rollImages(RollingImages &rollingImages)
@@ -127,109 +290,74 @@ void WeightedMovingVarianceCL::process(const cv::Mat &_imgInput, cv::Mat &_imgOu
 }
 
 void WeightedMovingVarianceCL::process(const cv::Mat &_imgInput,
-                                         cv::Mat &_imgOutput,
-                                         RollingImages &_imgInputPrev)
+                                       cv::Mat &_imgOutput,
+                                       RollingImages &_imgInputPrev)
 {
-    const size_t numPixels = _imgInput.size().area();
-    //memcpy(_imgInputPrev.pImgInput, _imgInput.data, _imgInputPrev.pImgSize->sizeInBytes);
-    m_queue.enqueueWriteBuffer(*_imgInputPrev.pImgInput, CL_TRUE, 0, _imgInputPrev.pImgSize->sizeInBytes, _imgInput.data);
-
-    if (_imgInputPrev.firstPhase < 2)
-    { 
-        ++_imgInputPrev.firstPhase;
-        return;
-    }
-
-    // Set the kernel arguments and run the kernel
-    m_wmvKernel.setArg(0, *_imgInputPrev.pImgInput);
-    m_wmvKernel.setArg(1, *_imgInputPrev.pImgInputPrev1);
-    m_wmvKernel.setArg(2, *_imgInputPrev.pImgInputPrev2);
-    m_wmvKernel.setArg(3, _imgInputPrev.bImgOutput);
-    m_wmvKernel.setArg(4, _imgInputPrev.bWeight);
-    m_wmvKernel.setArg(5, m_params.thresholdSquared);
+    const size_t pixelBytes{(size_t)_imgInputPrev.pImgSize->numChannels * _imgInputPrev.pImgSize->bytesPerPixel};
+    const bool computeFrame{_imgInputPrev.firstPhase >= 2};
+    const size_t slot{_imgInputPrev.frameSlot};
 
-    m_queue.enqueueNDRangeKernel(m_wmvKernel, cl::NullRange, cl::NDRange(numPixels), cl::NullRange);
-
-    // Copy the result from the device to the host
-    m_queue.enqueueReadBuffer(_imgInputPrev.bImgOutput, CL_TRUE, 0, numPixels, _imgOutput.data);
-}
-
-void testOpenCL()
-{
-    // Get the platform and device
-    std::vector<cl::Platform> platforms;
-    cl::Platform::get(&platforms);
-    if (platforms.size() == 0)
+    if (computeFrame)
     {
-        std::cout << "No OpenCL supported." << std::endl;
-        return;
+        m_wmvKernel.setArg(0, *_imgInputPrev.pImgInput);
+        m_wmvKernel.setArg(1, *_imgInputPrev.pImgInputPrev1);
+        m_wmvKernel.setArg(2, *_imgInputPrev.pImgInputPrev2);
+        m_wmvKernel.setArg(3, _imgInputPrev.bImgOutput[slot]);
+        m_wmvKernel.setArg(4, m_params.weight[0]);
+        m_wmvKernel.setArg(5, m_params.weight[1]);
+        m_wmvKernel.setArg(6, m_params.weight[2]);
+        m_wmvKernel.setArg(7, m_thresholdSquared);
     }
-    cl::Platform platform = platforms[0];
-    std::vector<cl::Device> devices;
-    platform.getDevices(CL_DEVICE_TYPE_ALL, &devices);
-    cl::Device device = devices[0];
 
-    // Print the device type
-    cl_device_type deviceType;
-    device.getInfo(CL_DEVICE_TYPE, &deviceType);
-    if (deviceType & CL_DEVICE_TYPE_GPU)
+    // Upload of chunk n + 1 overlaps compute of chunk n and download of chunk n - 1.
+    // The pinned input of this slot was last read by the upload of two frames ago, which is done:
+    // the download of the frame after it has been waited for
+    for (auto &chunk : m_pipelineChunks)
     {
-        std::cout << "Running on GPU" << std::endl;
-    }
-    else if (deviceType & CL_DEVICE_TYPE_CPU)
-    {
-        std::cout << "Running on CPU" << std::endl;
-    }
-    else
-    {
-        std::cout << "Running on unknown device type" << std::endl;
-    }
-
-    // Create the context and command queue
-    cl::Context context({device});
-    cl::CommandQueue queue(context, device);
-
-    // Create the program and kernel
-    std::string kernelSource = R"(
-    __kernel void add(__global int* a, __global int* b, __global int* c) {
-      int gid = get_global_id(0);
-      c[gid] = a[gid] + b[gid];
+        const size_t byteOffset{chunk.pixelOffset * pixelBytes};
+        const size_t numBytes{chunk.numPixels * pixelBytes};
+        memcpy(_imgInputPrev.pPinnedInput[slot] + byteOffset, _imgInput.data + byteOffset, numBytes);
+        // The oldest frame, overwritten now, may still be read by the compute of the previous frame
+        const bool previousCompute{chunk.computed[0]() != nullptr};
+        m_uploadQueue.enqueueWriteBuffer(*_imgInputPrev.pImgInput, CL_FALSE, byteOffset, numBytes,
+                                         _imgInputPrev.pPinnedInput[slot] + byteOffset,
+                                         previousCompute ? &chunk.computed : nullptr, &chunk.uploaded[0]);
+        m_uploadQueue.flush();
+        if (computeFrame)
+        {
+            m_computeQueue.enqueueNDRangeKernel(m_wmvKernel, cl::NDRange(chunk.pixelOffset), cl::NDRange(chunk.numPixels), cl::NullRange,
+                                                &chunk.uploaded, &chunk.computed[0]);
+            m_computeQueue.flush();
+            m_downloadQueue.enqueueReadBuffer(_imgInputPrev.bImgOutput[slot], CL_FALSE, chunk.pixelOffset, chunk.numPixels,
+                                              _imgInputPrev.pPinnedOutput[slot] + chunk.pixelOffset, &chunk.computed, &chunk.downloaded[slot]);
+            m_downloadQueue.flush();
+        }
     }
-  )";
-    cl::Program program(context, kernelSource);
-    program.build({device});
-    cl::Kernel add(program, "add");
 
-    // Create the input and output arrays
-    const int N = 1024;
-    int a[N], b[N], c[N];
-    for (int i = 0; i < N; i++)
+    if (!computeFrame)
     {
-        a[i] = i;
-        b[i] = i * 2;
+        // Nothing waits on these uploads later, the pinned staging is reused next frame
+        m_uploadQueue.finish();
+        ++_imgInputPrev.firstPhase;
+        // No variance yet, the mask is all background
+        _imgOutput.setTo(0);
+        return;
     }
-    cl::Buffer A(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * N, a);
-    cl::Buffer B(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(int) * N, b);
-    cl::Buffer C(context, CL_MEM_WRITE_ONLY, sizeof(int) * N);
 
-    // Set the kernel arguments and run the kernel
-    add.setArg(0, A);
-    add.setArg(1, B);
-    add.setArg(2, C);
-    queue.enqueueNDRangeKernel(add, cl::NullRange, cl::NDRange(N), cl::NullRange);
-
-    // Copy the result from the device to the host
-    queue.enqueueReadBuffer(C, CL_TRUE, 0, sizeof(int) * N, c);
-
-    // Check the result
-    bool correct = true;
-    for (int i = 0; i < N; i++)
+    // The frame just queued is collected by the next call, this one hands out the previous frame
+    const size_t previousSlot{slot ^ 1};
+    if (_imgInputPrev.hasPendingMask)
     {
-        if (c[i] != a[i] + b[i])
+        for (auto &chunk : m_pipelineChunks)
         {
-            correct = false;
-            break;
+            chunk.downloaded[previousSlot].wait();
+            memcpy(_imgOutput.data + chunk.pixelOffset, _imgInputPrev.pPinnedOutput[previousSlot] + chunk.pixelOffset, chunk.numPixels);
         }
     }
-    std::cout << (correct ? "Success" : "Failure") << std::endl;
+    else
+    {
+        _imgOutput.setTo(0);
+    }
+    _imgInputPrev.hasPendingMask = true;
+    _imgInputPrev.frameSlot = previousSlot;
 }
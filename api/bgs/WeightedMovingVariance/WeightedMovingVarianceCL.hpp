@@ -12,11 +12,24 @@
 
 namespace sky360lib::bgs
 {
+    /// OpenCL backend for the Weighted Moving Variance
+    /// The rolling history stays on the device, frames go through pinned (mapped) host buffers and
+    /// every frame is split in chunks so upload, compute and download of different chunks overlap.
+    /// apply does not wait for the frame it was given: it queues it and returns the mask of the previous frame,
+    /// so the transfers and the kernels of one frame run while the caller works on the mask of the one before.
+    /// The mask is all background until the first one is ready.
+    /// Throws std::runtime_error if no usable OpenCL device is found or the kernels fail to build.
     class WeightedMovingVarianceCL final
         : public CoreBgs
     {
     public:
-        WeightedMovingVarianceCL(const WeightedMovingVarianceParams& _params = WeightedMovingVarianceParams());
+        static const size_t DEFAULT_PIPELINE_CHUNKS{4};
+
+        /// _deviceType restricts the device search (CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU, ...),
+        /// among the candidates GPUs are preferred over accelerators and those over CPUs
+        WeightedMovingVarianceCL(const WeightedMovingVarianceParams& _params = WeightedMovingVarianceParams(),
+                                 cl_device_type _deviceType = CL_DEVICE_TYPE_ALL,
+                                 size_t _numPipelineChunks = DEFAULT_PIPELINE_CHUNKS);
         ~WeightedMovingVarianceCL();
 
         void getBackgroundImage(cv::Mat &_bgImage);
@@ -24,12 +37,14 @@ namespace sky360lib::bgs
     private:
         void initialize(const cv::Mat &_image);
         void process(const cv::Mat &img_input, cv::Mat &img_output, int _numProcess);
-        void initOpenCL();
+        bool initOpenCL(cl_device_type _deviceType);
+        bool selectDevice(cl_device_type _deviceType);
         void clearCL();
 
         static const inline int ROLLING_BG_IDX[3][3] = {{0, 1, 2}, {2, 0, 1}, {1, 2, 0}};
 
         const WeightedMovingVarianceParams m_params;
+        const size_t m_numPipelineChunks;
 
         struct RollingImages
         {
@@ -39,17 +54,40 @@ namespace sky360lib::bgs
             cl::Buffer* pImgInput;
             cl::Buffer* pImgInputPrev1;
             cl::Buffer* pImgInputPrev2;
-            cl::Buffer bImgOutput;
-            cl::Buffer bWeight;
             std::array<cl::Buffer, 3> pImgMem;
+
+            // Two frames are in flight, each one with its own output and pinned host staging,
+            // mapped for the whole life of the model
+            size_t frameSlot;
+            bool hasPendingMask;
+            std::array<cl::Buffer, 2> bImgOutput;
+            std::array<cl::Buffer, 2> bPinnedInput;
+            std::array<cl::Buffer, 2> bPinnedOutput;
+            std::array<uint8_t*, 2> pPinnedInput;
+            std::array<uint8_t*, 2> pPinnedOutput;
         };
         std::vector<RollingImages> imgInputPrev;
 
+        struct PipelineChunk
+        {
+            size_t pixelOffset;
+            size_t numPixels;
+            // Single event wait lists, reused every frame. The next upload of the chunk waits for the last
+            // compute that read it, the downloads are kept per frame slot
+            std::vector<cl::Event> uploaded;
+            std::vector<cl::Event> computed;
+            std::array<cl::Event, 2> downloaded;
+        };
+        std::vector<PipelineChunk> m_pipelineChunks;
+
         cl::Device m_device;
         cl::Context m_context;
-        cl::CommandQueue m_queue;
-        cl::Program m_program;
+        cl::CommandQueue m_uploadQueue;
+        cl::CommandQueue m_computeQueue;
+        cl::CommandQueue m_downloadQueue;
+        std::array<cl::Program, 2> m_programs;
         cl::Kernel m_wmvKernel;
+        float m_thresholdSquared;
 
         static void rollImages(RollingImages& rollingImages);
         void process(const cv::Mat &_imgInput,
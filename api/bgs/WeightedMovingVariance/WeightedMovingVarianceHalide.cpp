@@ -5,10 +5,14 @@
 #include <execution>
 #include <iostream>
 
-#include "wmv_mono_auto_schedule.h"
-#include "wmv_mono_threshold_auto_schedule.h"
-#include "wmv_color_auto_schedule.h"
-#include "wmv_color_threshold_auto_schedule.h"
+#include "wmv_mono_8u.h"
+#include "wmv_mono_16u.h"
+#include "wmv_mono_threshold_8u.h"
+#include "wmv_mono_threshold_16u.h"
+#include "wmv_color_8u.h"
+#include "wmv_color_16u.h"
+#include "wmv_color_threshold_8u.h"
+#include "wmv_color_threshold_16u.h"
 
 #include <HalideBuffer.h>
 
@@ -77,22 +81,39 @@ void WeightedMovingVarianceHalide::process(const cv::Mat &_inImage,
                                      RollingImages &_imgInputPrev,
                                      const WeightedMovingVarianceParams &_params)
 {
-    memcpy(_imgInputPrev.pImgInput, _inImage.data, _imgInputPrev.pImgSize->size);
+    memcpy(_imgInputPrev.pImgInput, _inImage.data, _imgInputPrev.pImgSize->sizeInBytes);
 
     if (_imgInputPrev.firstPhase < 2)
     {
         ++_imgInputPrev.firstPhase;
+        // No variance yet, the mask is all background
+        _outImg.setTo(0);
         return;
     }
 
-    if (_imgInputPrev.pImgSize->numBytesPerPixel == 1)
-        weightedVarianceMono(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2, 
-                            _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+    const bool isColor{_imgInputPrev.pImgSize->numChannels > 1};
+    const bool is8Bits{_imgInputPrev.pImgSize->bytesPerPixel == 1};
+    if (!isColor)
+    {
+        if (is8Bits)
+            weightedVarianceMono<uint8_t>(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
+                                          _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+        else
+            weightedVarianceMono<uint16_t>(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
+                                           _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+    }
     else
-        weightedVarianceColor(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2, 
-                            _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+    {
+        if (is8Bits)
+            weightedVarianceColor<uint8_t>(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
+                                           _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+        else
+            weightedVarianceColor<uint16_t>(_imgInputPrev.pImgInput, _imgInputPrev.pImgInputPrev1, _imgInputPrev.pImgInputPrev2,
+                                            _outImg.data, _imgInputPrev.pImgSize->width, _imgInputPrev.pImgSize->height, _params);
+    }
 }
 
+template<class T>
 void WeightedMovingVarianceHalide::weightedVarianceMono(
     uint8_t *const img1,
     uint8_t *const img2,
@@ -102,35 +123,56 @@ void WeightedMovingVarianceHalide::weightedVarianceMono(
     const int height,
     const WeightedMovingVarianceParams &_params)
 {
-    Buffer<uint8_t> input0(img1, width, height);
-    Buffer<uint8_t> input1(img2, width, height);
-    Buffer<uint8_t> input2(img3, width, height);
+    Buffer<T> input0((T*)img1, width, height);
+    Buffer<T> input1((T*)img2, width, height);
+    Buffer<T> input2((T*)img3, width, height);
     Buffer<uint8_t> output(outImg, width, height);
 
-    if (_params.enableThreshold)
-        wmv_mono_threshold_auto_schedule(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared, output);
+    if constexpr (sizeof(T) == 1)
+    {
+        if (_params.enableThreshold)
+            wmv_mono_threshold_8u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared, output);
+        else
+            wmv_mono_8u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    }
     else
-        wmv_mono_auto_schedule(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    {
+        if (_params.enableThreshold)
+            wmv_mono_threshold_16u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared16, output);
+        else
+            wmv_mono_16u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    }
     output.device_sync();
 }
 
+template<class T>
 void WeightedMovingVarianceHalide::weightedVarianceColor(
-    const uint8_t *const img1,
-    const uint8_t *const img2,
-    const uint8_t *const img3,
+    uint8_t *const img1,
+    uint8_t *const img2,
+    uint8_t *const img3,
     uint8_t *const outImg,
     const int width,
     const int height,
     const WeightedMovingVarianceParams &_params)
 {
-    Buffer<uint8_t> input0{Buffer<uint8_t>::make_interleaved((uint8_t*)img1, width, height, 3)};
-    Buffer<uint8_t> input1{Buffer<uint8_t>::make_interleaved((uint8_t*)img2, width, height, 3)};
-    Buffer<uint8_t> input2{Buffer<uint8_t>::make_interleaved((uint8_t*)img3, width, height, 3)};
+    Buffer<T> input0{Buffer<T>::make_interleaved((T*)img1, width, height, 3)};
+    Buffer<T> input1{Buffer<T>::make_interleaved((T*)img2, width, height, 3)};
+    Buffer<T> input2{Buffer<T>::make_interleaved((T*)img3, width, height, 3)};
     Buffer<uint8_t> output(outImg, width, height);
 
-    if (_params.enableThreshold)
-        wmv_color_threshold_auto_schedule(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared, output);
+    if constexpr (sizeof(T) == 1)
+    {
+        if (_params.enableThreshold)
+            wmv_color_threshold_8u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared, output);
+        else
+            wmv_color_8u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    }
     else
-        wmv_color_auto_schedule(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    {
+        if (_params.enableThreshold)
+            wmv_color_threshold_16u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], _params.thresholdSquared16, output);
+        else
+            wmv_color_16u(input0, input1, input2, _params.weight[0], _params.weight[1], _params.weight[2], output);
+    }
     output.device_sync();
 }
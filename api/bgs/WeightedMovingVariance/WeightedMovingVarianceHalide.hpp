@@ -10,6 +10,8 @@
 
 namespace sky360lib::bgs
 {
+    /// Weighted Moving Variance using the Halide generated filters (8/16 bits, mono/colour)
+    /// The filters are multi-target, the best instruction set for the running CPU is picked at runtime
     class WeightedMovingVarianceHalide final
         : public CoreBgs
     {
@@ -46,6 +48,7 @@ namespace sky360lib::bgs
                             cv::Mat &_imgOutput,
                             RollingImages &_imgInputPrev,
                             const WeightedMovingVarianceParams &_params);
+        template<class T>
         static void weightedVarianceMono(
             uint8_t *const img1,
             uint8_t *const img2,
@@ -54,10 +57,11 @@ namespace sky360lib::bgs
             const int width,
             const int height,
             const WeightedMovingVarianceParams &_params);
+        template<class T>
         static void weightedVarianceColor(
-            const uint8_t *const img1,
-            const uint8_t *const img2,
-            const uint8_t *const img3,
+            uint8_t *const img1,
+            uint8_t *const img2,
+            uint8_t *const img3,
             uint8_t *const outImg,
             const int width,
             const int height,
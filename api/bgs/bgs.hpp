@@ -1,8 +1,11 @@
 #pragma once
 
+#include "TiledBgs.hpp"
 #include "vibe/Vibe.hpp"
 #include "WeightedMovingVariance/WeightedMovingVariance.hpp"
 #include "WeightedMovingVariance/WeightedMovingVarianceCL.hpp"
 //#include "WeightedMovingVariance/WeightedMovingVarianceCuda.hpp"
-//#include "WeightedMovingVariance/WeightedMovingVarianceHalide.hpp"
+#ifdef SKY360_USE_HALIDE
+#include "WeightedMovingVariance/WeightedMovingVarianceHalide.hpp"
+#endif
 
@@ -1,12 +1,13 @@
 #include "Vibe.hpp"
 
+#include <cstring>
 #include <iostream>
 #include <execution>
 
 using namespace sky360lib::bgs;
 
 Vibe::Vibe(const VibeParams &_params, size_t _numProcessesParallel)
-    : CoreBgs(_numProcessesParallel), m_params(_params)
+    : CoreBgs(_numProcessesParallel), m_params(_params), m_neighborStep{1}
 {
 }
 
@@ -14,9 +15,14 @@ void Vibe::initialize(const cv::Mat &_initImg)
 {
     std::vector<std::unique_ptr<Img>> imgSplit(m_numProcessesParallel);
     m_origImgSize = ImgSize::create(_initImg.size().width, _initImg.size().height, _initImg.channels(), _initImg.elemSize1(), 0);
-    Img frameImg(_initImg.data, *m_origImgSize);
+    m_neighborStep = isBayerInput(_initImg) ? 2 : 1;
     //std::cout << "initialize 1" << std::endl;
-    splitImg(frameImg, imgSplit, m_numProcessesParallel);
+    // The sample splits have to match the ones used by applySplit
+    for (size_t i{0}; i < m_numProcessesParallel; ++i)
+    {
+        const ImgSize &splitSize{*m_imgSizesParallel[i]};
+        imgSplit[i] = std::make_unique<Img>(_initImg.data + (splitSize.originalPixelPos * splitSize.numChannels * splitSize.bytesPerPixel), splitSize);
+    }
 
     //std::cout << "initialize 2" << std::endl;
     m_randomGenerators.resize(m_numProcessesParallel);
@@ -47,12 +53,12 @@ void Vibe::initialize(const Img &_initImg, std::vector<std::unique_ptr<Img>> &_b
     for (size_t s{0}; s < m_params.NBGSamples; ++s)
     {
         //std::cout << "initialize " << s << " (" << _initImg.size.width << "x" << _initImg.size.height << ") = " << _initImg.size.sizeInBytes << std::endl;
-        _bgImgSamples[s] = Img::create(_initImg.size, false);
+        _bgImgSamples[s] = std::make_unique<Img>(allocModelBuffer(_initImg.size.sizeInBytes), _initImg.size);
         for (int yOrig{0}; yOrig < _initImg.size.height; yOrig++)
         {
             for (int xOrig{0}; xOrig < _initImg.size.width; xOrig++)
             {
-                getSamplePosition_7x7_std2(_rndGen.fast(), xSample, ySample, xOrig, yOrig, _initImg.size);
+                getSamplePosition_7x7_std2(_rndGen.fast(), xSample, ySample, xOrig, yOrig, _initImg.size, m_neighborStep);
                 const size_t pixelPos = (yOrig * _initImg.size.width + xOrig) * _initImg.size.numChannels;
                 const size_t samplePos = (ySample * _initImg.size.width + xSample) * _initImg.size.numChannels;
                 _bgImgSamples[s]->ptr<T>()[pixelPos] = _initImg.ptr<T>()[samplePos];
@@ -66,31 +72,30 @@ void Vibe::initialize(const Img &_initImg, std::vector<std::unique_ptr<Img>> &_b
     }
 }
 
-void Vibe::process(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess)
+void Vibe::process(const cv::Mat &_image, cv::Mat &, int _numProcess)
 {
     //std::cout << "process: " << _numProcess << ", bpp: " << _image.elemSize1() << std::endl;
     Img imgSplit(_image.data, ImgSize(_image.size().width, _image.size().height, _image.channels(), _image.elemSize1(), 0));
-    Img maskPartial(_fgmask.data, ImgSize(_image.size().width, _image.size().height, _fgmask.channels(), _fgmask.elemSize1(), 0));
     if (imgSplit.size.numChannels > 1)
     {
         if (imgSplit.size.bytesPerPixel == 1)
         {
-            apply3<uint8_t>(imgSplit, m_bgImgSamples[_numProcess], maskPartial, m_params, m_randomGenerators[_numProcess]);
+            apply3<uint8_t>(imgSplit, m_bgImgSamples[_numProcess], m_params, m_randomGenerators[_numProcess], m_neighborStep, maskWriter(_numProcess));
         }
         else
         {
-            apply3<uint16_t>(imgSplit, m_bgImgSamples[_numProcess], maskPartial, m_params, m_randomGenerators[_numProcess]);
+            apply3<uint16_t>(imgSplit, m_bgImgSamples[_numProcess], m_params, m_randomGenerators[_numProcess], m_neighborStep, maskWriter(_numProcess));
         }
     }
     else
     {
         if (imgSplit.size.bytesPerPixel == 1)
         {
-            apply1<uint8_t>(imgSplit, m_bgImgSamples[_numProcess], maskPartial, m_params, m_randomGenerators[_numProcess]);
+            apply1<uint8_t>(imgSplit, m_bgImgSamples[_numProcess], m_params, m_randomGenerators[_numProcess], m_neighborStep, maskWriter(_numProcess));
         }
         else
         {
-            apply1<uint16_t>(imgSplit, m_bgImgSamples[_numProcess], maskPartial, m_params, m_randomGenerators[_numProcess]);
+            apply1<uint16_t>(imgSplit, m_bgImgSamples[_numProcess], m_params, m_randomGenerators[_numProcess], m_neighborStep, maskWriter(_numProcess));
         }
     }
 }
@@ -98,17 +103,19 @@ void Vibe::process(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess)
 template<class T>
 void Vibe::apply3(const Img &_image,
                   std::vector<std::unique_ptr<Img>> &_bgImg,
-                  Img &_fgmask,
                   const VibeParams &_params,
-                  Pcg32 &_rndGen)
+                  Pcg32 &_rndGen,
+                  const int _neighborStep,
+                  MaskRowWriter &_maskWriter)
 {
-    _fgmask.clear();
 
     const int32_t nColorDistThreshold = sizeof(T) == 1 ? _params.NColorDistThresholdColorSquared : _params.NColorDistThresholdColor16Squared;
 
     size_t pixOffset{0}, colorPixOffset{0};
     for (int y{0}; y < _image.size.height; ++y)
     {
+        uint8_t *const maskRow{_maskWriter.row(y)};
+        memset(maskRow, ZERO_UC, _image.size.width);
         for (int x{0}; x < _image.size.width; ++x, ++pixOffset, colorPixOffset += _image.size.numChannels)
         {
             size_t nGoodSamplesCount{0},
@@ -131,7 +138,7 @@ void Vibe::apply3(const Img &_image,
             }
             if (nGoodSamplesCount < _params.NRequiredBGSamples)
             {
-                _fgmask.data[pixOffset] = UCHAR_MAX;
+                maskRow[x] = UCHAR_MAX;
             }
             else
             {
@@ -144,7 +151,7 @@ void Vibe::apply3(const Img &_image,
                 }
                 if ((_rndGen.fast() & _params.ANDlearningRate) == 0)
                 {
-                    const int neighData{getNeighborPosition_3x3(x, y, _image.size, _rndGen.fast()) * 3};
+                    const int neighData{getNeighborPosition_3x3(x, y, _image.size, _rndGen.fast(), _neighborStep) * 3};
                     T *const xyRandData{&_bgImg[_rndGen.fast() & _params.ANDlearningRate]->ptr<T>()[neighData]};
                     xyRandData[0] = pixData[0];
                     xyRandData[1] = pixData[1];
@@ -152,23 +159,27 @@ void Vibe::apply3(const Img &_image,
                 }
             }
         }
+        _maskWriter.rowDone(y);
     }
+    _maskWriter.finish();
 }
 
 template<class T>
 void Vibe::apply1(const Img &_image,
                   std::vector<std::unique_ptr<Img>> &_bgImg,
-                  Img &_fgmask,
                   const VibeParams &_params,
-                  Pcg32 &_rndGen)
+                  Pcg32 &_rndGen,
+                  const int _neighborStep,
+                  MaskRowWriter &_maskWriter)
 {
-    _fgmask.clear();
 
     const int32_t nColorDistThreshold = sizeof(T) == 1 ? _params.NColorDistThresholdMono : _params.NColorDistThresholdMono16;
 
     size_t pixOffset{0};
     for (int y{0}; y < _image.size.height; ++y)
     {
+        uint8_t *const maskRow{_maskWriter.row(y)};
+        memset(maskRow, ZERO_UC, _image.size.width);
         for (int x{0}; x < _image.size.width; ++x, ++pixOffset)
         {
             uint32_t nGoodSamplesCount{0},
@@ -190,7 +201,7 @@ void Vibe::apply1(const Img &_image,
             }
             if (nGoodSamplesCount < _params.NRequiredBGSamples)
             {
-                _fgmask.data[pixOffset] = UCHAR_MAX;
+                maskRow[x] = UCHAR_MAX;
             }
             else
             {
@@ -200,12 +211,14 @@ void Vibe::apply1(const Img &_image,
                 }
                 if ((_rndGen.fast() & _params.ANDlearningRate) == 0)
                 {
-                    const int neighData{getNeighborPosition_3x3(x, y, _image.size, _rndGen.fast())};
+                    const int neighData{getNeighborPosition_3x3(x, y, _image.size, _rndGen.fast(), _neighborStep)};
                     _bgImg[_rndGen.fast() & _params.ANDlearningRate]->ptr<T>()[neighData] = pixData;
                 }
             }
         }
+        _maskWriter.rowDone(y);
     }
+    _maskWriter.finish();
 }
 
 void Vibe::getBackgroundImage(cv::Mat &backgroundImage)
@@ -14,12 +14,16 @@ namespace sky360lib::bgs
              size_t _numProcessesParallel = DETECT_NUMBER_OF_THREADS);
 
         void getBackgroundImage(cv::Mat &_bgImage);
+        size_t getModelBytesPerPixel(const cv::Mat &_image) const { return m_params.NBGSamples * _image.elemSize(); }
 
     private:
         void initialize(const cv::Mat &oInitImg);
         void process(const cv::Mat &_image, cv::Mat &_fgmask, int _numProcess);
+        bool hasFusedMaskWriter() const { return true; }
 
         VibeParams m_params;
+        /// 2 when working on a raw Bayer mosaic so samples and neighbors stay on sensels of the same colour
+        int m_neighborStep;
 
         std::unique_ptr<ImgSize> m_origImgSize;
         std::vector<std::vector<std::unique_ptr<Img>>> m_bgImgSamples;
@@ -28,8 +32,8 @@ namespace sky360lib::bgs
         template<class T>
         void initialize(const Img &_initImg, std::vector<std::unique_ptr<Img>> &_bgImgSamples, Pcg32 &_rndGen);
         template<class T>
-        static void apply1(const Img &_image, std::vector<std::unique_ptr<Img>> &_bgImgSamples, Img &_fgmask, const VibeParams &_params, Pcg32 &_rndGen);
+        static void apply1(const Img &_image, std::vector<std::unique_ptr<Img>> &_bgImgSamples, const VibeParams &_params, Pcg32 &_rndGen, const int _neighborStep, MaskRowWriter &_maskWriter);
         template<class T>
-        static void apply3(const Img &_image, std::vector<std::unique_ptr<Img>> &_bgImgSamples, Img &_fgmask, const VibeParams &_params, Pcg32 &_rndGen);
+        static void apply3(const Img &_image, std::vector<std::unique_ptr<Img>> &_bgImgSamples, const VibeParams &_params, Pcg32 &_rndGen, const int _neighborStep, MaskRowWriter &_maskWriter);
     };
 }
\ No newline at end of file
@@ -36,7 +36,8 @@ namespace sky360lib::bgs
         return (nNeighborCoord_Y * oImageSize.width + nNeighborCoord_X);
     }
 
-    static inline int getNeighborPosition_3x3(const int x, const int y, const ImgSize &oImageSize, const uint32_t nRandIdx)
+    /// _step is 2 for raw Bayer mosaics so the neighbor is always a sensel of the same colour; out-of-bounds moves keep the original coordinate
+    static inline int getNeighborPosition_3x3(const int x, const int y, const ImgSize &oImageSize, const uint32_t nRandIdx, const int _step = 1)
     {
         typedef std::array<int, 2> Nb;
         static const std::array<Nb, 8> s_anNeighborPattern = {
@@ -50,8 +51,10 @@ namespace sky360lib::bgs
             Nb{1, -1},
         };
         const size_t r{nRandIdx & 0x7};
-        const int nNeighborCoord_X{std::max(std::min(x + s_anNeighborPattern[r][0], oImageSize.width - 1), 0)};
-        const int nNeighborCoord_Y{std::max(std::min(y + s_anNeighborPattern[r][1], oImageSize.height - 1), 0)};
+        const int nx{x + s_anNeighborPattern[r][0] * _step};
+        const int ny{y + s_anNeighborPattern[r][1] * _step};
+        const int nNeighborCoord_X{(nx < 0 || nx >= oImageSize.width) ? x : nx};
+        const int nNeighborCoord_Y{(ny < 0 || ny >= oImageSize.height) ? y : ny};
         return (nNeighborCoord_Y * oImageSize.width + nNeighborCoord_X);
     }
 
@@ -72,7 +75,7 @@ namespace sky360lib::bgs
     template <int nKernelHeight, int nKernelWidth>
     inline void getSamplePosition(const std::array<std::array<int, nKernelWidth>, nKernelHeight> &anSamplesInitPattern,
                                   const int nSamplesInitPatternTot, const int nRandIdx, int &nSampleCoord_X, int &nSampleCoord_Y,
-                                  const int nOrigCoord_X, const int nOrigCoord_Y, const ImgSize &oImageSize)
+                                  const int nOrigCoord_X, const int nOrigCoord_Y, const ImgSize &oImageSize, const int _step = 1)
     {
         int r = 1 + (nRandIdx % nSamplesInitPatternTot);
         for (nSampleCoord_Y = 0; nSampleCoord_Y < nKernelHeight; ++nSampleCoord_Y)
@@ -85,16 +88,25 @@ namespace sky360lib::bgs
             }
         }
     stop:
-        nSampleCoord_X += nOrigCoord_X - nKernelWidth / 2;
-        nSampleCoord_Y += nOrigCoord_Y - nKernelHeight / 2;
+        nSampleCoord_X = nOrigCoord_X + (nSampleCoord_X - nKernelWidth / 2) * _step;
+        nSampleCoord_Y = nOrigCoord_Y + (nSampleCoord_Y - nKernelHeight / 2) * _step;
         clampImageCoords(nSampleCoord_X, nSampleCoord_Y, oImageSize);
+        if (_step > 1)
+        {
+            // clamping can land on a sensel of another colour, step back into the original CFA phase
+            if ((nSampleCoord_X ^ nOrigCoord_X) & 1)
+                nSampleCoord_X += nSampleCoord_X > nOrigCoord_X ? -1 : 1;
+            if ((nSampleCoord_Y ^ nOrigCoord_Y) & 1)
+                nSampleCoord_Y += nSampleCoord_Y > nOrigCoord_Y ? -1 : 1;
+        }
     }
 
     /// returns the sampling location for the specified random index & original pixel location; also guards against out-of-bounds values via image/border size check
     inline void getSamplePosition_7x7_std2(const int nRandIdx,
                                            int &nSampleCoord_X, int &nSampleCoord_Y,
                                            const int nOrigCoord_X, const int nOrigCoord_Y,
-                                           const ImgSize &oImageSize)
+                                           const ImgSize &oImageSize,
+                                           const int _step = 1)
     {
         // based on 'floor(fspecial('gaussian',7,2)*512)'
         static const int s_nSamplesInitPatternTot = 512;
@@ -107,7 +119,7 @@ namespace sky360lib::bgs
             std::array<int, 7>{ 4,  8, 12, 14, 12,  8,  4 },
             std::array<int, 7>{ 2,  4,  6,  7,  6,  4,  2 },
         };
-        getSamplePosition<7, 7>(s_anSamplesInitPattern, s_nSamplesInitPatternTot, nRandIdx, nSampleCoord_X, nSampleCoord_Y, nOrigCoord_X, nOrigCoord_Y, oImageSize);
+        getSamplePosition<7, 7>(s_anSamplesInitPattern, s_nSamplesInitPatternTot, nRandIdx, nSampleCoord_X, nSampleCoord_Y, nOrigCoord_X, nOrigCoord_Y, oImageSize, _step);
     }
 
     static inline void splitImg(const Img &_inputImg, std::vector<std::unique_ptr<Img>> &_outputImages, int _numSplits)
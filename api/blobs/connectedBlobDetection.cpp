@@ -1,39 +1,42 @@
 #include "connectedBlobDetection.hpp"
 
-#include <opencv2/imgproc.hpp>
-
 #include <iostream>
 #include <execution>
 #include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstring>
 
 using namespace sky360lib::blobs;
 
 ConnectedBlobDetection::ConnectedBlobDetection(const ConnectedBlobDetectionParams &_params, size_t _numProcessesParallel)
-    : m_params{_params}, m_numProcessesParallel{_numProcessesParallel}, m_initialized{false}
+    : m_params{_params}, m_numProcessesParallel{_numProcessesParallel}, m_maskFormat{MaskFormat::Bytes}
 {
     if (m_numProcessesParallel == DETECT_NUMBER_OF_THREADS)
     {
         m_numProcessesParallel = calcAvailableThreads();
     }
+    prepareParallel();
+    beginFrame();
 }
 
-static inline cv::KeyPoint convertFromRect(const cv::Rect &rect)
+bool ConnectedBlobDetection::detectKP(const cv::Mat &_image, std::vector<cv::KeyPoint> &_keyPoints, const std::vector<cv::Range> *_dirtyRows)
 {
-    static const float scale = 6.0f;
-    const float size = (float)std::max(rect.width, rect.height) / scale;
-    return cv::KeyPoint(rect.x + scale * size / 2.0f, rect.y + scale * size / 2.0f, size);
+    beginFrame();
+    labelTile(_image, 0, cv::Mat(), _dirtyRows);
+    const bool found{finishComponents()};
+    _keyPoints.resize(found ? m_components.size() : 0);
+    for (size_t i{0}; i < _keyPoints.size(); ++i)
+    {
+        _keyPoints[i] = m_components[i].toBlob().toKeyPoint();
+    }
+    return found;
 }
 
 std::vector<cv::KeyPoint> ConnectedBlobDetection::detectKP(const cv::Mat &_image)
 {
-    std::vector<cv::Rect> bboxes;
-    detect(_image, bboxes);
     std::vector<cv::KeyPoint> kps;
-    std::transform(bboxes.begin(),
-                   bboxes.end(),
-                   std::back_inserter(kps),
-                   [](const cv::Rect &r) -> cv::KeyPoint
-                   { return convertFromRect(r); });
+    detectKP(_image, kps);
     return kps;
 }
 
@@ -44,171 +47,600 @@ std::vector<cv::Rect> ConnectedBlobDetection::detectRet(const cv::Mat &_image)
     return bboxes;
 }
 
-// Joining bboxes together if they overlap
-static inline void joinBBoxes(std::vector<cv::Rect> &_bboxes, int minDistanceSquared)
+std::vector<Blob> ConnectedBlobDetection::detectBlobsRet(const cv::Mat &_image, const cv::Mat &_intensity)
 {
-    bool bboxOverlap;
-    do
+    std::vector<Blob> blobs;
+    detectBlobs(_image, blobs, _intensity);
+    return blobs;
+}
+
+// Finds the connected components in the image and returns a list of bounding boxes
+bool ConnectedBlobDetection::detect(const cv::Mat &_image, std::vector<cv::Rect> &_bboxes, const std::vector<cv::Range> *_dirtyRows)
+{
+    beginFrame();
+    labelTile(_image, 0, cv::Mat(), _dirtyRows);
+    return endFrame(_bboxes);
+}
+
+bool ConnectedBlobDetection::detectBlobs(const cv::Mat &_image, std::vector<Blob> &_blobs, const cv::Mat &_intensity,
+                                         const std::vector<cv::Range> *_dirtyRows)
+{
+    if (!checkIntensity(_image, _intensity))
+    {
+        _blobs.clear();
+        return false;
+    }
+
+    beginFrame();
+    labelTile(_image, 0, _intensity, _dirtyRows);
+    return endFrame(_blobs);
+}
+
+void ConnectedBlobDetection::beginFrame()
+{
+    m_componentParents.clear();
+    m_tileComponents.clear();
+    m_lastRowRuns.clear();
+    m_lastRowY = -2;
+}
+
+bool ConnectedBlobDetection::addTile(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity, const std::vector<cv::Range> *_dirtyRows)
+{
+    if (!checkIntensity(_mask, _intensity))
     {
-        bboxOverlap = false;
-        for (size_t i{0}; i < _bboxes.size() - 1; ++i)
+        return false;
+    }
+    labelTile(_mask, _startY, _intensity, _dirtyRows);
+    return true;
+}
+
+bool ConnectedBlobDetection::endFrame(std::vector<cv::Rect> &_bboxes)
+{
+    if (finishComponents())
+    {
+        _bboxes.resize(m_components.size());
+        for (size_t i{0}; i < m_components.size(); ++i)
         {
-            for (size_t j{i + 1}; j < _bboxes.size();)
-            {
-                if (sky360lib::rectsDistanceSquared(_bboxes[i], _bboxes[j]) < minDistanceSquared)
-                {
-                    bboxOverlap = true;
-                    const int xmax = std::max(_bboxes[i].x + _bboxes[i].width, _bboxes[j].x + _bboxes[j].width);
-                    const int ymax = std::max(_bboxes[i].y + _bboxes[i].height, _bboxes[j].y + _bboxes[j].height);
-                    _bboxes[i].x = std::min(_bboxes[i].x, _bboxes[j].x);
-                    _bboxes[i].y = std::min(_bboxes[i].y, _bboxes[j].y);
-                    _bboxes[i].width = xmax - _bboxes[i].x;
-                    _bboxes[i].height = ymax - _bboxes[i].y;
-                    _bboxes.erase(_bboxes.begin() + j);
-                }
-                else
-                {
-                    ++j;
-                }
-            }
+            _bboxes[i] = m_components[i].rect();
         }
-    } while (bboxOverlap);
+        return true;
+    }
+
+    _bboxes.clear();
+    return false;
 }
 
-inline static void applySizeCut(std::vector<cv::Rect> &_bboxes, const int _sizeThreshold, const int _areaThreshold)
+bool ConnectedBlobDetection::endFrame(std::vector<Blob> &_blobs)
 {
-    for (size_t i{0}; i < _bboxes.size();)
+    if (finishComponents())
     {
-        if ((_bboxes[i].width < _sizeThreshold) || (_bboxes[i].height < _sizeThreshold) || (_bboxes[i].area() < _areaThreshold))
+        _blobs.resize(m_components.size());
+        for (size_t i{0}; i < m_components.size(); ++i)
         {
-            _bboxes.erase(_bboxes.begin() + i);
+            _blobs[i] = m_components[i].toBlob();
         }
-        else
+        return true;
+    }
+
+    _blobs.clear();
+    return false;
+}
+
+bool ConnectedBlobDetection::checkIntensity(const cv::Mat &_mask, const cv::Mat &_intensity) const
+{
+    if (!_intensity.empty())
+    {
+        const int maskWidth{m_maskFormat == MaskFormat::PackedBits ? packedMaskWidth(_intensity.cols) : _intensity.cols};
+        if ((_intensity.type() != CV_8UC1 && _intensity.type() != CV_16UC1) || _intensity.rows != _mask.rows || maskWidth != _mask.cols)
         {
-            ++i;
+            std::cerr << "ConnectedBlobDetection: intensity image must be CV_8UC1 or CV_16UC1 with the size of the mask" << std::endl;
+            return false;
         }
     }
+    return true;
 }
 
-inline void ConnectedBlobDetection::posProcessBboxes(std::vector<cv::Rect> &_bboxes)
+// Labels the rows of a tile and appends its components to the frame
+void ConnectedBlobDetection::labelTile(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity, const std::vector<cv::Range> *_dirtyRows)
 {
-    const size_t numLabels = _bboxes.size();
+    distributeRows(_mask, _startY, _dirtyRows);
+
+    // Every strip is labelled on its own, only the runs touching the strip borders are merged afterwards
+    std::for_each(
+        std::execution::par,
+        m_processSeq.begin(),
+        m_processSeq.end(),
+        [&](size_t np)
+        {
+            labelStrip(_mask, _startY, _intensity, m_stripLabels[np]);
+        });
 
-    // Reseting returning bboxes to the MIN/MAX values
-    for (size_t i{0}; i < numLabels; ++i)
+    appendStrips();
+}
+
+// Leaves the joined and filtered components of the frame in m_components
+bool ConnectedBlobDetection::finishComponents()
+{
+    if (reduceComponents() > 0)
     {
-        _bboxes[i].x = _bboxes[i].y = INT_MAX;
-        _bboxes[i].width = _bboxes[i].height = INT_MIN;
+        // Joining components whose bboxes are close to each other
+        joinComponents();
+
+        // Removing components that are below threshold
+        applySizeCut();
+
+        return true;
     }
 
-    // Joining all parallel bboxes into one label
-    for (size_t i{0}; i < m_numProcessesParallel; ++i)
+    m_components.clear();
+    return false;
+}
+
+Blob ConnectedBlobDetection::Component::toBlob() const
+{
+    const double invArea{1.0 / (double)area};
+    const double cx{(double)sumX * invArea};
+    const double cy{(double)sumY * invArea};
+    const double mu20{(double)sumXX * invArea - cx * cx};
+    const double mu11{(double)sumXY * invArea - cx * cy};
+    const double mu02{(double)sumYY * invArea - cy * cy};
+
+    // Largest eigenvalue of the covariance, each pixel adds the 1/12 variance of a unit square so single pixels get a size.
+    // A disk of diameter d has a variance of d^2 / 16 on every axis
+    static const double PIXEL_VARIANCE{1.0 / 12.0};
+    const double halfSum{(mu20 + mu02) * 0.5 + PIXEL_VARIANCE};
+    const double halfDiff{(mu20 - mu02) * 0.5};
+    const double maxVariance{halfSum + std::sqrt(halfDiff * halfDiff + mu11 * mu11)};
+
+    const bool hasIntensity{maxIntensity >= minIntensity};
+    cv::Point2d weightedCentroid(cx, cy);
+    if (hasIntensity)
     {
-        const int addedY = (int)(m_imgSizesParallel[i]->originalPixelPos / m_imgSizesParallel[i]->width);
-        const std::vector<cv::Rect> &bboxesParallel = m_bboxesParallel[i];
-        for (size_t j{0}; j < numLabels; ++j)
+        // Weights are the intensity above the blob minimum: sum((I - min) * x) = sum(I * x) - min * sum(x)
+        const double sumWeights{(double)sumIntensity - (double)minIntensity * (double)area};
+        if (sumWeights > 0.0)
         {
-            // If the coordinates for the label were altered, process
-            if (bboxesParallel[j].x != INT_MAX)
-            {
-                _bboxes[j].x = std::min(_bboxes[j].x, bboxesParallel[j].x);
-                _bboxes[j].y = std::min(_bboxes[j].y, bboxesParallel[j].y + addedY);
-                _bboxes[j].width = std::max(_bboxes[j].width, (bboxesParallel[j].width - _bboxes[j].x) + 1);
-                _bboxes[j].height = std::max(_bboxes[j].height, ((bboxesParallel[j].height + addedY) - _bboxes[j].y) + 1);
-            }
+            weightedCentroid.x = ((double)sumIntensityX - (double)minIntensity * (double)sumX) / sumWeights;
+            weightedCentroid.y = ((double)sumIntensityY - (double)minIntensity * (double)sumY) / sumWeights;
         }
     }
 
-    // Joining bboxes that are overlaping each other
-    joinBBoxes(_bboxes, m_params.minDistanceSquared);
+    return Blob{rect(),
+                area,
+                cv::Point2d(cx, cy),
+                weightedCentroid,
+                4.0 * std::sqrt(maxVariance),
+                mu20,
+                mu11,
+                mu02,
+                hasIntensity ? minIntensity : 0,
+                hasIntensity ? maxIntensity : 0,
+                sumIntensity};
+}
 
-    // Removing bboxes that are below threshold
-    applySizeCut(_bboxes, m_params.sizeThreshold, m_params.areaThreshold);
+static inline int findRoot(std::vector<int> &_parents, int _i)
+{
+    while (_parents[_i] != _i)
+    {
+        _parents[_i] = _parents[_parents[_i]];
+        _i = _parents[_i];
+    }
+    return _i;
 }
 
-// Finds the connected components in the image and returns a list of bounding boxes
-bool ConnectedBlobDetection::detect(const cv::Mat &_image, std::vector<cv::Rect> &_bboxes)
+// The smallest index is always kept as the root so components stay in raster order of their first pixel
+// Returns false if both were already in the same set
+static inline bool unite(std::vector<int> &_parents, int _a, int _b)
+{
+    _a = findRoot(_parents, _a);
+    _b = findRoot(_parents, _b);
+    if (_a < _b)
+    {
+        _parents[_b] = _a;
+    }
+    else if (_b < _a)
+    {
+        _parents[_a] = _b;
+    }
+    return _a != _b;
+}
+
+// Calls _onTouch for every pair of runs of two consecutive rows that are 8-connected
+template <typename Run, typename OnTouch>
+static inline void forEachTouchingRun(const Run *_prev, size_t _numPrev, const Run *_cur, size_t _numCur, OnTouch &&_onTouch)
+{
+    size_t p{0};
+    for (size_t c{0}; c < _numCur; ++c)
+    {
+        while ((p < _numPrev) && (_prev[p].xEnd + 1 < _cur[c].xStart))
+        {
+            ++p;
+        }
+        for (size_t q{p}; (q < _numPrev) && (_prev[q].xStart <= _cur[c].xEnd + 1); ++q)
+        {
+            _onTouch(q, c);
+        }
+    }
+}
+
+template <typename Run>
+static inline void extractRunsBytes(const uint8_t *_row, int _width, int _y, std::vector<Run> &_runs)
 {
-    if (!m_initialized)
+    int x{0};
+    while (x < _width)
     {
-        prepareParallel(_image);
-        // Create a labels image to store the labels for each connected component
-        m_initialized = true;
+        // Skipping background 8 pixels at a time
+        uint64_t word;
+        while ((x + 8 <= _width) && (memcpy(&word, _row + x, sizeof(word)), word == 0))
+        {
+            x += 8;
+        }
+        while ((x < _width) && (_row[x] == 0))
+        {
+            ++x;
+        }
+        if (x >= _width)
+        {
+            break;
+        }
+        const int xStart{x};
+        while ((x < _width) && (_row[x] != 0))
+        {
+            ++x;
+        }
+        _runs.push_back({xStart, x - 1, _y, 0});
     }
+}
 
-    // Use connected component analysis to find the blobs in the image, subtract 1 because the background is considered as label 0
-    // CCL_SAUF      = 0, //!< SAUF @cite Wu2009 algorithm for 8-way connectivity, SAUF algorithm for 4-way connectivity. The parallel implementation described in @cite Bolelli2017 is available for SAUF.
-    // CCL_BBDT      = 1, //!< BBDT @cite Grana2010 algorithm for 8-way connectivity, SAUF algorithm for 4-way connectivity. The parallel implementation described in @cite Bolelli2017 is available for both BBDT and SAUF.
-    // CCL_SPAGHETTI = 2, //!< Spaghetti @cite Bolelli2019 algorithm for 8-way connectivity, Spaghetti4C @cite Bolelli2021 algorithm for 4-way connectivity. The parallel implementation described in @cite Bolelli2017 is available for both Spaghetti and Spaghetti4C.
-    const int numLabels = cv::connectedComponents(_image, m_labels, 8, CV_32S, cv::CCL_SPAGHETTI) - 1;
+static inline uint64_t loadPackedWord(const uint8_t *_bytes, int _numBytes)
+{
+    uint64_t word{0};
+    if constexpr (std::endian::native == std::endian::little)
+    {
+        memcpy(&word, _bytes, (size_t)_numBytes);
+    }
+    else
+    {
+        for (int i{0}; i < _numBytes; ++i)
+        {
+            word |= (uint64_t)_bytes[i] << (i * 8);
+        }
+    }
+    return word;
+}
 
-    _bboxes.resize(numLabels);
-    if (numLabels > 0)
+// Reads the runs straight from the packed bits, 64 pixels at a time
+template <typename Run>
+static inline void extractRunsPacked(const uint8_t *_row, int _numBytes, int _y, std::vector<Run> &_runs)
+{
+    int xStart{-1};
+    for (int byteX{0}; byteX < _numBytes; byteX += 8)
     {
-        std::for_each(
-            std::execution::par,
-            m_processSeq.begin(),
-            m_processSeq.end(),
-            [&](int np)
+        const uint64_t word{loadPackedWord(_row + byteX, std::min(8, _numBytes - byteX))};
+        if ((xStart < 0) ? (word == 0) : (word == UINT64_MAX))
+        {
+            continue;
+        }
+        const int baseX{byteX * 8};
+        int bit{0};
+        while (bit < 64)
+        {
+            // Looking for the next set bit when outside a run, or the next clear bit when inside one
+            const uint64_t rest{((xStart < 0) ? word : ~word) >> bit};
+            if (rest == 0)
             {
-                // Reseting parallel bboxes to the MIN/MAX values
-                m_bboxesParallel[np].resize(numLabels);
-                for (int j{0}; j < numLabels; ++j)
-                {
-                    m_bboxesParallel[np][j].x = m_bboxesParallel[np][j].y = INT_MAX;
-                    m_bboxesParallel[np][j].width = m_bboxesParallel[np][j].height = INT_MIN;
-                }
-                // Spliting the image into chuncks and processing
-                const cv::Mat imgSplit(m_imgSizesParallel[np]->height, m_imgSizesParallel[np]->width, m_labels.type(),
-                                       m_labels.data + (m_imgSizesParallel[np]->originalPixelPos * m_imgSizesParallel[np]->numChannels));
-                applyDetectBBoxes(imgSplit, m_bboxesParallel[np]);
-            });
+                break;
+            }
+            bit += std::countr_zero(rest);
+            if (xStart < 0)
+            {
+                xStart = baseX + bit;
+            }
+            else
+            {
+                _runs.push_back({xStart, baseX + bit - 1, _y, 0});
+                xStart = -1;
+            }
+        }
+    }
+    if (xStart >= 0)
+    {
+        _runs.push_back({xStart, _numBytes * 8 - 1, _y, 0});
+    }
+}
 
-        posProcessBboxes(_bboxes);
+void ConnectedBlobDetection::labelStrip(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity, StripLabels &_strip) const
+{
+    std::vector<Run> &runs{_strip.runs};
+    std::vector<int> &parents{_strip.parents};
+    runs.clear();
+    parents.clear();
+    _strip.components.clear();
+    _strip.firstY = _strip.lastY = -1;
+    _strip.firstRowEnd = _strip.lastRowStart = 0;
 
-        return true;
+    size_t prevStart{0};
+    for (const cv::Range &rowRange : _strip.rowRanges)
+    {
+        for (int y{rowRange.start}; y < rowRange.end; ++y)
+        {
+            const size_t curStart{runs.size()};
+            if (m_maskFormat == MaskFormat::PackedBits)
+            {
+                extractRunsPacked(_mask.ptr<uint8_t>(y - _startY), _mask.cols, y, runs);
+            }
+            else
+            {
+                extractRunsBytes(_mask.ptr<uint8_t>(y - _startY), _mask.cols, y, runs);
+            }
+            for (size_t i{curStart}; i < runs.size(); ++i)
+            {
+                parents.push_back((int)i);
+            }
+            if (_strip.firstY < 0)
+            {
+                _strip.firstY = y;
+                _strip.firstRowEnd = runs.size();
+            }
+            else if (y == _strip.lastY + 1)
+            {
+                forEachTouchingRun(runs.data() + prevStart, curStart - prevStart, runs.data() + curStart, runs.size() - curStart,
+                                   [&](size_t _p, size_t _c)
+                                   { unite(parents, (int)(prevStart + _p), (int)(curStart + _c)); });
+            }
+            _strip.lastY = y;
+            _strip.lastRowStart = curStart;
+            prevStart = curStart;
+        }
     }
 
-    return false;
+    // Parents always come before their children, so a single pass assigns the labels and accumulates the components
+    std::vector<Component> &components{_strip.components};
+    for (size_t i{0}; i < runs.size(); ++i)
+    {
+        if (parents[i] == (int)i)
+        {
+            runs[i].label = (int)components.size();
+            components.emplace_back().init(runs[i]);
+        }
+        else
+        {
+            runs[i].label = runs[parents[i]].label;
+            components[runs[i].label].addRun(runs[i]);
+        }
+        if (!_intensity.empty())
+        {
+            Component &component{components[runs[i].label]};
+            if (_intensity.depth() == CV_16U)
+            {
+                component.addIntensity(_intensity.ptr<uint16_t>(runs[i].y - _startY), runs[i]);
+            }
+            else
+            {
+                component.addIntensity(_intensity.ptr<uint8_t>(runs[i].y - _startY), runs[i]);
+            }
+        }
+    }
+}
+
+// Appends the components of the strips to the frame, joining the ones that touch the last labelled row.
+// Only that row is kept from one strip (or tile) to the next
+void ConnectedBlobDetection::appendStrips()
+{
+    for (const StripLabels &strip : m_stripLabels)
+    {
+        if (strip.firstY < 0)
+        {
+            continue;
+        }
+        const int offset{(int)m_tileComponents.size()};
+        for (size_t i{0}; i < strip.components.size(); ++i)
+        {
+            m_tileComponents.push_back(strip.components[i]);
+            m_componentParents.push_back(offset + (int)i);
+        }
+        if (m_lastRowY + 1 == strip.firstY)
+        {
+            forEachTouchingRun(m_lastRowRuns.data(), m_lastRowRuns.size(), strip.runs.data(), strip.firstRowEnd,
+                               [&](size_t _p, size_t _c)
+                               { unite(m_componentParents, m_lastRowRuns[_p].label, offset + strip.runs[_c].label); });
+        }
+        m_lastRowRuns.assign(strip.runs.begin() + (std::ptrdiff_t)strip.lastRowStart, strip.runs.end());
+        for (Run &run : m_lastRowRuns)
+        {
+            run.label += offset;
+        }
+        m_lastRowY = strip.lastY;
+    }
+}
+
+size_t ConnectedBlobDetection::reduceComponents()
+{
+    // Reducing every component into its root, roots keep their relative order.
+    // Parents always come before their children, so the parent slot is reused to hold the output index as -1 - index
+    m_components.clear();
+    for (size_t i{0}; i < m_tileComponents.size(); ++i)
+    {
+        int &parent{m_componentParents[i]};
+        if (parent == (int)i)
+        {
+            parent = -1 - (int)m_components.size();
+            m_components.push_back(m_tileComponents[i]);
+        }
+        else
+        {
+            parent = m_componentParents[parent];
+            m_components[-1 - parent].merge(m_tileComponents[i]);
+        }
+    }
+
+    return m_components.size();
 }
 
-void ConnectedBlobDetection::applyDetectBBoxes(const cv::Mat &_labels, std::vector<cv::Rect> &_bboxes)
+// Joining is repeated until no two bboxes are closer than minDistance. Since a join only grows the bboxes, the pairs
+// can be found in any order and the result is the same as joining them one by one. Each round compares the bboxes
+// sorted by x and stops scanning once the gap on x alone is already too large.
+// The joined components keep the position of their first component.
+void ConnectedBlobDetection::joinComponents()
 {
-    int *pLabel = (int *)_labels.data;
-    for (int r = 0; r < _labels.rows; r++)
+    const int numComponents{(int)m_components.size()};
+    m_clusterParents.resize(numComponents);
+    m_clusterRoots.resize(numComponents);
+    for (int i{0}; i < numComponents; ++i)
+    {
+        m_clusterParents[i] = m_clusterRoots[i] = i;
+    }
+
+    bool joined;
+    do
     {
-        for (int c = 0; c < _labels.cols; c++)
+        joined = false;
+        const size_t numRoots{m_clusterRoots.size()};
+        m_clusterRects.resize(numRoots);
+        m_sweepOrder.resize(numRoots);
+        for (size_t i{0}; i < numRoots; ++i)
+        {
+            m_clusterRects[i] = m_components[m_clusterRoots[i]].rect();
+            m_sweepOrder[i] = (int)i;
+        }
+        std::sort(m_sweepOrder.begin(), m_sweepOrder.end(),
+                  [&](int _a, int _b)
+                  { return m_clusterRects[_a].x < m_clusterRects[_b].x; });
+
+        for (size_t a{0}; a < numRoots; ++a)
+        {
+            const cv::Rect &rectA{m_clusterRects[m_sweepOrder[a]]};
+            const int rightA{rectA.x + rectA.width};
+            for (size_t b{a + 1}; b < numRoots; ++b)
+            {
+                const cv::Rect &rectB{m_clusterRects[m_sweepOrder[b]]};
+                const int gapX{rectB.x - rightA};
+                if ((gapX > 0) && (gapX * gapX >= m_params.minDistanceSquared))
+                {
+                    break;
+                }
+                if (sky360lib::rectsDistanceSquared(rectA, rectB) < m_params.minDistanceSquared)
+                {
+                    joined |= unite(m_clusterParents, m_clusterRoots[m_sweepOrder[a]], m_clusterRoots[m_sweepOrder[b]]);
+                }
+            }
+        }
+
+        if (joined)
         {
-            const int label = *pLabel - 1;
-            if (label >= 0)
+            // Folding the joined components into their roots, roots are kept in ascending order
+            size_t numNewRoots{0};
+            for (size_t i{0}; i < numRoots; ++i)
             {
-                _bboxes[label].x = std::min(_bboxes[label].x, c);
-                _bboxes[label].y = std::min(_bboxes[label].y, r);
-                _bboxes[label].width = std::max(_bboxes[label].width, c);
-                _bboxes[label].height = std::max(_bboxes[label].height, r);
+                const int id{m_clusterRoots[i]};
+                const int root{findRoot(m_clusterParents, id)};
+                if (root == id)
+                {
+                    m_clusterRoots[numNewRoots++] = id;
+                }
+                else
+                {
+                    m_components[root].merge(m_components[id]);
+                }
             }
-            ++pLabel;
+            m_clusterRoots.resize(numNewRoots);
         }
+    } while (joined);
+
+    // Compacting the roots to the front, they are in ascending order so this never overwrites a pending root
+    for (size_t i{0}; i < m_clusterRoots.size(); ++i)
+    {
+        m_components[i] = m_components[m_clusterRoots[i]];
     }
+    m_components.resize(m_clusterRoots.size());
+}
+
+void ConnectedBlobDetection::applySizeCut()
+{
+    std::erase_if(m_components,
+                  [&](const Component &_component)
+                  {
+                      const cv::Rect rect{_component.rect()};
+                      return (rect.width < m_params.sizeThreshold) || (rect.height < m_params.sizeThreshold) || (rect.area() < m_params.areaThreshold);
+                  });
 }
 
-void ConnectedBlobDetection::prepareParallel(const cv::Mat &_image)
+void ConnectedBlobDetection::prepareParallel()
 {
-    m_imgSizesParallel.resize(m_numProcessesParallel);
     m_processSeq.resize(m_numProcessesParallel);
-    m_bboxesParallel.resize(m_numProcessesParallel);
-    size_t y{0};
-    size_t h{_image.size().height / m_numProcessesParallel};
+    m_stripLabels.resize(m_numProcessesParallel);
     for (size_t i{0}; i < m_numProcessesParallel; ++i)
     {
         m_processSeq[i] = i;
-        if (i == (m_numProcessesParallel - 1))
+    }
+}
+
+// Splits the rows to label evenly between the strips, a strip can get pieces of several dirty ranges
+void ConnectedBlobDetection::distributeRows(const cv::Mat &_mask, int _startY, const std::vector<cv::Range> *_dirtyRows)
+{
+    m_dirtyRows.clear();
+    if (_dirtyRows == nullptr)
+    {
+        m_dirtyRows.emplace_back(_startY, _startY + _mask.rows);
+    }
+    else
+    {
+        for (const cv::Range &range : *_dirtyRows)
+        {
+            const int start{std::max(range.start, _startY)};
+            const int end{std::min(range.end, _startY + _mask.rows)};
+            if (start < end)
+            {
+                m_dirtyRows.emplace_back(start, end);
+            }
+        }
+        std::sort(m_dirtyRows.begin(), m_dirtyRows.end(),
+                  [](const cv::Range &_a, const cv::Range &_b)
+                  { return _a.start < _b.start; });
+        // Joining overlapping and touching ranges
+        size_t numRanges{0};
+        for (size_t i{0}; i < m_dirtyRows.size(); ++i)
+        {
+            if (numRanges > 0 && m_dirtyRows[i].start <= m_dirtyRows[numRanges - 1].end)
+            {
+                m_dirtyRows[numRanges - 1].end = std::max(m_dirtyRows[numRanges - 1].end, m_dirtyRows[i].end);
+            }
+            else
+            {
+                m_dirtyRows[numRanges++] = m_dirtyRows[i];
+            }
+        }
+        m_dirtyRows.resize(numRanges);
+    }
+
+    size_t totalRows{0};
+    for (const cv::Range &range : m_dirtyRows)
+    {
+        totalRows += (size_t)range.size();
+    }
+    const size_t numStrips{m_stripLabels.size()};
+    const auto stripQuota = [&](size_t _np)
+    { return totalRows / numStrips + (_np < totalRows % numStrips ? 1 : 0); };
+
+    for (StripLabels &strip : m_stripLabels)
+    {
+        strip.rowRanges.clear();
+    }
+    size_t np{0};
+    size_t quota{stripQuota(0)};
+    for (const cv::Range &range : m_dirtyRows)
+    {
+        int y{range.start};
+        while (y < range.end)
         {
-            h = _image.size().height - y;
+            while (quota == 0)
+            {
+                quota = stripQuota(++np);
+            }
+            const int rows{(int)std::min((size_t)(range.end - y), quota)};
+            m_stripLabels[np].rowRanges.emplace_back(y, y + rows);
+            y += rows;
+            quota -= rows;
         }
-        m_imgSizesParallel[i] = ImgSize::create(_image.size().width, h,
-                                                4, 1,
-                                                y * _image.size().width);
-        y += h;
     }
 }
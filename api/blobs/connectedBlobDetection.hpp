@@ -1,6 +1,7 @@
 #pragma once
 
 #include "coreUtils.hpp"
+#include "maskUtils.hpp"
 
 #include <opencv2/core.hpp>
 
@@ -36,6 +37,31 @@ namespace sky360lib::blobs
         int minDistanceSquared;
     };
 
+    /// Detected blob with the statistics gathered while labelling
+    struct Blob
+    {
+        cv::Rect bbox;
+        /// Number of foreground pixels
+        int64_t area;
+        /// Mean position of the foreground pixels
+        cv::Point2d centroid;
+        /// Sub-pixel position weighted by the intensity above the darkest pixel of the blob (so the sky level does not
+        /// pull it to the geometric centre), the same as centroid when no intensity image was given or the blob is flat
+        cv::Point2d weightedCentroid;
+        /// Diameter of the disk with the same second order moments, the pixels are taken as unit squares
+        double size;
+        /// Central second order moments normalised by the area (the covariance of the pixel positions)
+        double mu20;
+        double mu11;
+        double mu02;
+        /// Intensity of the foreground pixels in the companion image, all zero when no image was given
+        int minIntensity;
+        int maxIntensity;
+        int64_t sumIntensity;
+
+        inline cv::KeyPoint toKeyPoint() const { return cv::KeyPoint((float)weightedCentroid.x, (float)weightedCentroid.y, (float)size); }
+    };
+
     class ConnectedBlobDetection final
     {
     public:
@@ -47,30 +73,190 @@ namespace sky360lib::blobs
                                size_t _numProcessesParallel = DETECT_NUMBER_OF_THREADS);
 
         // Finds the connected components in the image and returns a list of bounding boxes
-        bool detect(const cv::Mat &_image, std::vector<cv::Rect> &_bboxes);
+        // The detect* functions that take an output vector reuse its storage and the detector keeps all of its
+        // working buffers, so once they reached the size of the busiest frame detection does no heap allocation.
+        // _dirtyRows optionally restricts the labelling to those row ranges (for instance CoreBgs::getDirtyRows),
+        // every other row is taken as background. nullptr labels the whole mask
+        bool detect(const cv::Mat &_image, std::vector<cv::Rect> &_bboxes, const std::vector<cv::Range> *_dirtyRows = nullptr);
 
         inline void setSizeThreshold(int _threshold) { m_params.setSizeThreshold(_threshold); }
         inline void setAreaThreshold(int _threshold) { m_params.setSizeThreshold(_threshold); }
         inline void setMinDistance(int _distance) { m_params.setMinDistance(_distance); }
+        /// Format of the masks passed to detect, bytes by default
+        inline void setMaskFormat(MaskFormat _maskFormat) { m_maskFormat = _maskFormat; }
+
+        /// Finds the connected components in the image and returns them with their statistics.
+        /// _intensity is optional, a CV_8UC1 or CV_16UC1 image with the size of the frame that is sampled under every blob
+        bool detectBlobs(const cv::Mat &_image, std::vector<Blob> &_blobs, const cv::Mat &_intensity = cv::Mat(),
+                         const std::vector<cv::Range> *_dirtyRows = nullptr);
+
+        /// Streaming detection for frames whose mask is produced in horizontal tiles (see TiledBgs).
+        /// Tiles are added from the top down, blobs crossing tile borders are stitched and only the last
+        /// labelled row of the previous tile is kept, so the full frame mask never has to exist
+        void beginFrame();
+        /// _mask holds the frame rows [_startY, _startY + _mask.rows), _intensity and _dirtyRows work as in detectBlobs
+        /// with _dirtyRows in frame coordinates
+        bool addTile(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity = cv::Mat(),
+                     const std::vector<cv::Range> *_dirtyRows = nullptr);
+        bool endFrame(std::vector<cv::Rect> &_bboxes);
+        bool endFrame(std::vector<Blob> &_blobs);
+
+        // Finds the connected components in the image and returns a list of keypoints
+        // The keypoints are placed on the centroid of the blobs and their size comes from the moments, see Blob
+        bool detectKP(const cv::Mat &_image, std::vector<cv::KeyPoint> &_keyPoints, const std::vector<cv::Range> *_dirtyRows = nullptr);
 
         // Finds the connected components in the image and returns a list of keypoints
-        // This function uses detect and converts from Rect to KeyPoints using a fixed scale
         std::vector<cv::KeyPoint> detectKP(const cv::Mat &_image);
 
         // Finds the connected components in the image and returns a list of bounding boxes
         std::vector<cv::Rect> detectRet(const cv::Mat &_image);
 
+        // Finds the connected components in the image and returns them with their statistics
+        std::vector<Blob> detectBlobsRet(const cv::Mat &_image, const cv::Mat &_intensity);
+
     private:
+        /// Horizontal run of foreground pixels, label is the component index inside its strip
+        struct Run
+        {
+            int xStart;
+            int xEnd;
+            int y;
+            int label;
+        };
+
+        /// Bounding box, pixel count, raw moments and intensity range of a connected component
+        struct Component
+        {
+            int minX;
+            int minY;
+            int maxX;
+            int maxY;
+            int64_t area;
+            int64_t sumX;
+            int64_t sumY;
+            int64_t sumXX;
+            int64_t sumXY;
+            int64_t sumYY;
+            int minIntensity;
+            int maxIntensity;
+            int64_t sumIntensity;
+            int64_t sumIntensityX;
+            int64_t sumIntensityY;
+
+            inline void init(const Run &_run)
+            {
+                minX = _run.xStart;
+                maxX = _run.xEnd;
+                minY = maxY = _run.y;
+                area = sumX = sumY = sumXX = sumXY = sumYY = 0;
+                minIntensity = INT_MAX;
+                maxIntensity = INT_MIN;
+                sumIntensity = sumIntensityX = sumIntensityY = 0;
+                addRun(_run);
+            }
+
+            /// The moments of a run are closed form sums over x in [xStart, xEnd]
+            inline void addRun(const Run &_run)
+            {
+                const int64_t length{_run.xEnd - _run.xStart + 1};
+                const int64_t runSumX{(int64_t)(_run.xStart + _run.xEnd) * length / 2};
+                minX = std::min(minX, _run.xStart);
+                maxX = std::max(maxX, _run.xEnd);
+                maxY = _run.y;
+                area += length;
+                sumX += runSumX;
+                sumY += (int64_t)_run.y * length;
+                sumXX += sumOfSquares(_run.xEnd) - sumOfSquares(_run.xStart - 1);
+                sumXY += (int64_t)_run.y * runSumX;
+                sumYY += (int64_t)_run.y * _run.y * length;
+            }
+
+            template <class T>
+            inline void addIntensity(const T *_row, const Run &_run)
+            {
+                int64_t sum{0};
+                int64_t sumX{0};
+                for (int x{_run.xStart}; x <= _run.xEnd; ++x)
+                {
+                    minIntensity = std::min(minIntensity, (int)_row[x]);
+                    maxIntensity = std::max(maxIntensity, (int)_row[x]);
+                    sum += _row[x];
+                    sumX += (int64_t)_row[x] * x;
+                }
+                sumIntensity += sum;
+                sumIntensityX += sumX;
+                sumIntensityY += sum * _run.y;
+            }
+
+            inline void merge(const Component &_other)
+            {
+                minX = std::min(minX, _other.minX);
+                minY = std::min(minY, _other.minY);
+                maxX = std::max(maxX, _other.maxX);
+                maxY = std::max(maxY, _other.maxY);
+                area += _other.area;
+                sumX += _other.sumX;
+                sumY += _other.sumY;
+                sumXX += _other.sumXX;
+                sumXY += _other.sumXY;
+                sumYY += _other.sumYY;
+                minIntensity = std::min(minIntensity, _other.minIntensity);
+                maxIntensity = std::max(maxIntensity, _other.maxIntensity);
+                sumIntensity += _other.sumIntensity;
+                sumIntensityX += _other.sumIntensityX;
+                sumIntensityY += _other.sumIntensityY;
+            }
+
+            static inline int64_t sumOfSquares(int64_t _n) { return _n * (_n + 1) * (2 * _n + 1) / 6; }
+
+            inline cv::Rect rect() const { return cv::Rect(minX, minY, maxX - minX + 1, maxY - minY + 1); }
+
+            Blob toBlob() const;
+        };
+
+        /// Runs and components found in the rows given to one parallel process
+        struct StripLabels
+        {
+            /// Rows to label, sorted and not overlapping
+            std::vector<cv::Range> rowRanges;
+            std::vector<Run> runs;
+            std::vector<int> parents;
+            std::vector<Component> components;
+            /// First and last labelled rows, -1 when the strip had no rows
+            int firstY;
+            int lastY;
+            /// Runs of the first row are [0, firstRowEnd), runs of the last row are [lastRowStart, runs.size())
+            size_t firstRowEnd;
+            size_t lastRowStart;
+        };
+
         ConnectedBlobDetectionParams m_params;
         size_t m_numProcessesParallel;
-        bool m_initialized;
-        cv::Mat m_labels;
+        MaskFormat m_maskFormat;
         std::vector<size_t> m_processSeq;
-        std::vector<std::unique_ptr<ImgSize>> m_imgSizesParallel;
-        std::vector<std::vector<cv::Rect>> m_bboxesParallel;
+        std::vector<cv::Range> m_dirtyRows;
+        std::vector<StripLabels> m_stripLabels;
+        /// Components of the frame so far, joined through m_componentParents
+        std::vector<Component> m_tileComponents;
+        std::vector<int> m_componentParents;
+        /// Runs of the last labelled row, labelled with their index in m_tileComponents
+        std::vector<Run> m_lastRowRuns;
+        int m_lastRowY;
+        std::vector<Component> m_components;
+        std::vector<int> m_clusterParents;
+        std::vector<int> m_clusterRoots;
+        std::vector<int> m_sweepOrder;
+        std::vector<cv::Rect> m_clusterRects;
 
-        void prepareParallel(const cv::Mat &_image);
-        static void applyDetectBBoxes(const cv::Mat &_labels, std::vector<cv::Rect> &_bboxes);
-        inline void posProcessBboxes(std::vector<cv::Rect> &_bboxes);
+        void prepareParallel();
+        void distributeRows(const cv::Mat &_mask, int _startY, const std::vector<cv::Range> *_dirtyRows);
+        bool checkIntensity(const cv::Mat &_mask, const cv::Mat &_intensity) const;
+        void labelTile(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity, const std::vector<cv::Range> *_dirtyRows);
+        void labelStrip(const cv::Mat &_mask, int _startY, const cv::Mat &_intensity, StripLabels &_strip) const;
+        void appendStrips();
+        size_t reduceComponents();
+        bool finishComponents();
+        void joinComponents();
+        void applySizeCut();
     };
 }
\ No newline at end of file
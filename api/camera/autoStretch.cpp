@@ -0,0 +1,229 @@
+#include "autoStretch.hpp"
+#include "coreUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <execution>
+#include <iostream>
+
+using namespace sky360lib::camera;
+
+AutoStretch::AutoStretch(size_t _numProcessesParallel)
+    : m_numProcessesParallel{_numProcessesParallel},
+      m_blackPercentile{0.001},
+      m_whitePercentile{0.9999},
+      m_targetMedian{0.25},
+      m_sampleStep{4},
+      m_adaptRate{DEFAULT_ADAPT_RATE},
+      m_hasLevels{false},
+      m_blackPoint{0.0},
+      m_whitePoint{65535.0},
+      m_gamma{1.0},
+      m_lutBlackPoint{-1.0},
+      m_lutWhitePoint{-1.0},
+      m_lutGamma{-1.0},
+      m_numRows{0},
+      m_histogram(HISTOGRAM_BINS)
+{
+    if (m_numProcessesParallel == DETECT_NUMBER_OF_THREADS)
+    {
+        m_numProcessesParallel = calcAvailableThreads();
+    }
+}
+
+void AutoStretch::setPercentiles(double _blackPercentile, double _whitePercentile)
+{
+    m_blackPercentile = std::clamp(_blackPercentile, 0.0, 1.0);
+    m_whitePercentile = std::clamp(_whitePercentile, m_blackPercentile, 1.0);
+}
+
+bool AutoStretch::apply(const cv::Mat &_image, cv::Mat &_image8)
+{
+    if (_image.depth() == CV_8U)
+    {
+        _image8 = _image;
+        return true;
+    }
+    if (_image.depth() != CV_16U)
+    {
+        std::cerr << "AutoStretch: only 8 and 16 bits unsigned images are supported" << std::endl;
+        return false;
+    }
+
+    prepareParallel(_image);
+    _image8.create(_image.rows, _image.cols, CV_MAKETYPE(CV_8U, _image.channels()));
+
+    calcHistogram(_image);
+    calcLevels();
+    if (m_blackPoint != m_lutBlackPoint || m_whitePoint != m_lutWhitePoint || m_gamma != m_lutGamma)
+    {
+        buildLut();
+    }
+    applyLut(_image, _image8);
+
+    return true;
+}
+
+cv::Mat AutoStretch::applyRet(const cv::Mat &_image)
+{
+    cv::Mat image8;
+    apply(_image, image8);
+    return image8;
+}
+
+void AutoStretch::prepareParallel(const cv::Mat &_image)
+{
+    if (_image.rows == m_numRows)
+    {
+        return;
+    }
+    m_numRows = _image.rows;
+    const int numStrips{(int)std::min<size_t>(m_numProcessesParallel, (size_t)std::max(m_numRows, 1))};
+    m_processSeq.resize(numStrips);
+    m_stripRows.resize(numStrips);
+    for (int i{0}; i < numStrips; ++i)
+    {
+        m_processSeq[i] = i;
+        m_stripRows[i] = cv::Range(m_numRows * i / numStrips, m_numRows * (i + 1) / numStrips);
+    }
+    m_stripHistograms.resize((size_t)numStrips * HISTOGRAM_BINS);
+}
+
+void AutoStretch::calcHistogram(const cv::Mat &_image)
+{
+    const int rowElements{_image.cols * _image.channels()};
+    std::for_each(
+        std::execution::par,
+        m_processSeq.begin(),
+        m_processSeq.end(),
+        [&](size_t np)
+        {
+            uint32_t *const histogram{m_stripHistograms.data() + np * HISTOGRAM_BINS};
+            std::fill_n(histogram, HISTOGRAM_BINS, 0);
+            // Sampling the rows at the same phase on every strip
+            const int firstRow{(m_stripRows[np].start + m_sampleStep - 1) / m_sampleStep * m_sampleStep};
+            for (int y{firstRow}; y < m_stripRows[np].end; y += m_sampleStep)
+            {
+                const uint16_t *const row{_image.ptr<uint16_t>(y)};
+                for (int x{0}; x < rowElements; x += m_sampleStep)
+                {
+                    ++histogram[row[x] >> HISTOGRAM_SHIFT];
+                }
+            }
+        });
+
+    std::copy_n(m_stripHistograms.begin(), HISTOGRAM_BINS, m_histogram.begin());
+    for (size_t np{1}; np < m_processSeq.size(); ++np)
+    {
+        const uint32_t *const histogram{m_stripHistograms.data() + np * HISTOGRAM_BINS};
+        for (int i{0}; i < HISTOGRAM_BINS; ++i)
+        {
+            m_histogram[i] += histogram[i];
+        }
+    }
+}
+
+void AutoStretch::calcLevels()
+{
+    uint64_t total{0};
+    for (uint32_t count : m_histogram)
+    {
+        total += count;
+    }
+    if (total == 0)
+    {
+        return;
+    }
+
+    // First value of the bin where the cumulative count goes over each fraction
+    const double fractions[3]{m_blackPercentile, 0.5, m_whitePercentile};
+    double values[3]{0.0, 0.0, 0.0};
+    uint64_t cumulative{0};
+    int bin{0};
+    for (int i{0}; i < 3; ++i)
+    {
+        const double limit{fractions[i] * (double)total};
+        while (bin < HISTOGRAM_BINS - 1 && (double)(cumulative + m_histogram[bin]) <= limit)
+        {
+            cumulative += m_histogram[bin];
+            ++bin;
+        }
+        values[i] = (double)(bin << HISTOGRAM_SHIFT);
+    }
+    double blackPoint{values[0]};
+    // The white point takes the whole bin
+    double whitePoint{values[2] + (double)((1 << HISTOGRAM_SHIFT) - 1)};
+    if (whitePoint - blackPoint < MIN_RANGE)
+    {
+        whitePoint = std::min(blackPoint + MIN_RANGE, 65535.0);
+        blackPoint = whitePoint - MIN_RANGE;
+    }
+
+    double gamma{1.0};
+    if (m_targetMedian > 0.0 && m_targetMedian < 1.0)
+    {
+        const double median{std::clamp((values[1] - blackPoint) / (whitePoint - blackPoint), 0.001, 0.999)};
+        gamma = std::clamp(std::log(m_targetMedian) / std::log(median), MIN_GAMMA, MAX_GAMMA);
+    }
+
+    if (!m_hasLevels || m_adaptRate >= 1.0)
+    {
+        m_blackPoint = blackPoint;
+        m_whitePoint = whitePoint;
+        m_gamma = gamma;
+        m_hasLevels = true;
+    }
+    else
+    {
+        m_blackPoint += m_adaptRate * (blackPoint - m_blackPoint);
+        m_whitePoint += m_adaptRate * (whitePoint - m_whitePoint);
+        m_gamma += m_adaptRate * (gamma - m_gamma);
+    }
+}
+
+void AutoStretch::buildLut()
+{
+    // Output k = round(255 * t^gamma) with t = (v - black) / (white - black), filled by ranges from the input
+    // values where the output goes to k, so only 255 pow calls are needed instead of one per entry
+    const double range{m_whitePoint - m_blackPoint};
+    const double invGamma{1.0 / m_gamma};
+    size_t start{0};
+    for (int k{0}; k < 256; ++k)
+    {
+        size_t end{m_lut.size()};
+        if (k < 255)
+        {
+            const double threshold{m_blackPoint + range * std::pow((k + 0.5) / 255.0, invGamma)};
+            end = (size_t)std::clamp(std::ceil(threshold), (double)start, (double)m_lut.size());
+        }
+        memset(m_lut.data() + start, k, end - start);
+        start = end;
+    }
+
+    m_lutBlackPoint = m_blackPoint;
+    m_lutWhitePoint = m_whitePoint;
+    m_lutGamma = m_gamma;
+}
+
+void AutoStretch::applyLut(const cv::Mat &_image, cv::Mat &_image8)
+{
+    const int rowElements{_image.cols * _image.channels()};
+    const uint8_t *const lut{m_lut.data()};
+    std::for_each(
+        std::execution::par,
+        m_processSeq.begin(),
+        m_processSeq.end(),
+        [&](size_t np)
+        {
+            for (int y{m_stripRows[np].start}; y < m_stripRows[np].end; ++y)
+            {
+                const uint16_t *const in{_image.ptr<uint16_t>(y)};
+                uint8_t *const out{_image8.ptr<uint8_t>(y)};
+                for (int x{0}; x < rowElements; ++x)
+                {
+                    out[x] = lut[in[x]];
+                }
+            }
+        });
+}
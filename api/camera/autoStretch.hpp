@@ -0,0 +1,84 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace sky360lib::camera
+{
+    /// Converts the 16 bit frames of the camera to 8 bits for display, tracking and recording.
+    /// The black and white points come from percentiles of a sub-sampled histogram of the frame and the gamma puts
+    /// the median (the sky background) at a target level, the three of them are baked in a 64K entries LUT that is
+    /// applied in parallel row strips. The LUT is only rebuilt when the levels change
+    class AutoStretch final
+    {
+    public:
+        static const size_t DETECT_NUMBER_OF_THREADS{0};
+        /// The histogram keeps the top 12 bits, enough to place the levels
+        static const int HISTOGRAM_SHIFT{4};
+        static const int HISTOGRAM_BINS{65536 >> HISTOGRAM_SHIFT};
+        /// The levels follow the sky over about 50 frames. Re-levelling every frame changes the whole image at once,
+        /// which the background subtractors see as foreground everywhere
+        static constexpr double DEFAULT_ADAPT_RATE{0.02};
+
+        AutoStretch(size_t _numProcessesParallel = DETECT_NUMBER_OF_THREADS);
+
+        /// _image can be CV_16UC1 or CV_16UC3, the output has the same channels in CV_8U.
+        /// 8 bit images are passed through without a copy
+        bool apply(const cv::Mat &_image, cv::Mat &_image8);
+        cv::Mat applyRet(const cv::Mat &_image);
+
+        /// Fractions of the sampled pixels that end up black and white
+        void setPercentiles(double _blackPercentile, double _whitePercentile);
+        /// Output level (0 to 1) of the median, 0 disables the gamma
+        void setTargetMedian(double _targetMedian) { m_targetMedian = _targetMedian; }
+        /// Only one in _sampleStep rows and columns goes to the histogram
+        void setSampleStep(int _sampleStep) { m_sampleStep = std::max(_sampleStep, 1); }
+        /// How fast the levels follow the frame after the first one. 1 uses the levels of each frame as they are, fine for
+        /// display only, 0 keeps the levels of the first frame. See DEFAULT_ADAPT_RATE
+        void setAdaptRate(double _adaptRate) { m_adaptRate = std::clamp(_adaptRate, 0.0, 1.0); }
+
+        double getBlackPoint() const { return m_blackPoint; }
+        double getWhitePoint() const { return m_whitePoint; }
+        double getGamma() const { return m_gamma; }
+
+    private:
+        static constexpr double MIN_GAMMA{0.2};
+        static constexpr double MAX_GAMMA{5.0};
+        /// Smallest distance between the black and white points
+        static constexpr double MIN_RANGE{64.0};
+
+        size_t m_numProcessesParallel;
+        double m_blackPercentile;
+        double m_whitePercentile;
+        double m_targetMedian;
+        int m_sampleStep;
+        double m_adaptRate;
+
+        bool m_hasLevels;
+        double m_blackPoint;
+        double m_whitePoint;
+        double m_gamma;
+        /// Levels the LUT was built with
+        double m_lutBlackPoint;
+        double m_lutWhitePoint;
+        double m_lutGamma;
+
+        int m_numRows;
+        std::vector<size_t> m_processSeq;
+        std::vector<cv::Range> m_stripRows;
+        /// One histogram per strip, summed in m_histogram
+        std::vector<uint32_t> m_stripHistograms;
+        std::vector<uint32_t> m_histogram;
+        std::array<uint8_t, 65536> m_lut;
+
+        void prepareParallel(const cv::Mat &_image);
+        void calcHistogram(const cv::Mat &_image);
+        void calcLevels();
+        void buildLut();
+        void applyLut(const cv::Mat &_image, cv::Mat &_image8);
+    };
+}
@@ -1,10 +1,109 @@
 #include "qhyCamera.hpp"
+#include "boundedQueue.hpp"
 
+#include <unistd.h>
+
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
+#include <semaphore>
 #include <thread>
+#include <vector>
 
 using namespace sky360lib::camera;
 
+// Buffers of the capture thread, shared with the leases so they stay valid until the last one is released.
+// The capture thread always owns one buffer to read the next frame into, it starts with the extra one at the end
+struct QHYCamera::FrameRing
+{
+    FrameRing(size_t _numBuffers, size_t _bufferSize)
+        : buffers(_numBuffers + 1, nullptr),
+          infos(_numBuffers + 1),
+          freeBuffers(_numBuffers + 1),
+          readyBuffers(_numBuffers + 1),
+          readyCount{0},
+          sequence{0},
+          overruns{0},
+          drops{0}
+    {
+        const size_t pageSize{(size_t)sysconf(_SC_PAGESIZE)};
+        const size_t size{(_bufferSize + pageSize - 1) & ~(pageSize - 1)};
+        for (size_t i{0}; i < buffers.size(); ++i)
+        {
+            buffers[i] = (uint8_t *)std::aligned_alloc(pageSize, size);
+            if (buffers[i] == nullptr)
+            {
+                valid = false;
+                return;
+            }
+        }
+        for (size_t i{0}; i < _numBuffers; ++i)
+        {
+            freeBuffers.push(i);
+        }
+    }
+
+    ~FrameRing()
+    {
+        for (uint8_t *buffer : buffers)
+        {
+            std::free(buffer);
+        }
+    }
+
+    std::vector<uint8_t *> buffers;
+    std::vector<FrameInfo> infos;
+    sky360lib::BoundedQueue<size_t> freeBuffers;
+    // Frames waiting to be read, oldest first, readyCount follows their number so the consumers can wait on it
+    sky360lib::BoundedQueue<size_t> readyBuffers;
+    std::counting_semaphore<> readyCount;
+    // Only written by the thread reading the camera
+    uint64_t sequence;
+    uint64_t overruns;
+    uint64_t drops;
+    bool valid{true};
+};
+
+QHYCamera::FrameLease::~FrameLease()
+{
+    release();
+}
+
+QHYCamera::FrameLease::FrameLease(FrameLease &&other) noexcept
+    : m_ring{std::move(other.m_ring)}, m_index{other.m_index}
+{
+}
+
+QHYCamera::FrameLease &QHYCamera::FrameLease::operator=(FrameLease &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        m_ring = std::move(other.m_ring);
+        m_index = other.m_index;
+    }
+    return *this;
+}
+
+const uint8_t *QHYCamera::FrameLease::data() const
+{
+    return m_ring->buffers[m_index];
+}
+
+const QHYCamera::FrameInfo &QHYCamera::FrameLease::info() const
+{
+    return m_ring->infos[m_index];
+}
+
+void QHYCamera::FrameLease::release()
+{
+    if (m_ring)
+    {
+        m_ring->freeBuffers.push(m_index);
+        m_ring.reset();
+    }
+}
+
 std::string QHYCamera::CameraInfo::bayerFormatToString()
 {
     switch (bayerFormat)
@@ -87,11 +186,21 @@ bool QHYCamera::getLive(uint32_t *w, uint32_t *h, uint32_t *bpp, uint32_t *chann
 }
 
 const uint8_t *QHYCamera::getFrame()
+{
+    if (isCapturing())
+    {
+        std::cerr << "getFrame: the capture thread is reading the camera, use acquireFrame" << std::endl;
+        return nullptr;
+    }
+
+    FrameInfo info;
+    return captureFrame(m_pImgData, info) ? m_pImgData : nullptr;
+}
+
+bool QHYCamera::captureFrame(uint8_t *imgData, FrameInfo &info)
 {
     using fsec = std::chrono::duration<float>;
     std::chrono::high_resolution_clock timer;
-    uint32_t w, h, bpp, channels;
-    static fsec fpsTime = fsec::zero();
 
     if (!m_isExposing)
         beginExposing();
@@ -100,24 +209,68 @@ const uint8_t *QHYCamera::getFrame()
 
     if (m_params.streamMode == SingleFrame)
     {
-        if (!getSingle(&w, &h, &bpp, &channels, m_pImgData))
+        if (!getSingle(&info.width, &info.height, &info.bpp, &info.channels, imgData))
         {
-            return nullptr;
+            return false;
         }
     }
     else
     {
-        if (!getLive(&w, &h, &bpp, &channels, m_pImgData))
+        if (!getLive(&info.width, &info.height, &info.bpp, &info.channels, imgData))
         {
-            return nullptr;
+            return false;
         }
     }
 
     auto stop = timer.now();
     fsec duration = (stop - start);
     m_lastFrameCaptureTime = duration.count();
+    info.timestamp = std::chrono::steady_clock::now();
+
+    return true;
+}
+
+bool QHYCamera::readFrame(FrameLease &lease)
+{
+    lease.release();
+    if (!m_frameRing)
+    {
+        const uint32_t size = getMemoryNeededForFrame();
+        if (size == 0)
+        {
+            std::cerr << "Cannot get memory for frame." << std::endl;
+            return false;
+        }
+        auto ring = std::make_shared<FrameRing>(DEFAULT_FRAME_BUFFERS, size);
+        if (!ring->valid)
+        {
+            std::cerr << "getFrame: cannot allocate the frame buffers" << std::endl;
+            return false;
+        }
+        // Without the capture thread the extra buffer is free as well
+        ring->freeBuffers.push(ring->buffers.size() - 1);
+        m_frameRing = ring;
+    }
+
+    size_t index;
+    if (!m_frameRing->freeBuffers.pop(index))
+    {
+        std::cerr << "getFrame: every frame buffer is leased" << std::endl;
+        return false;
+    }
+    FrameInfo &info{m_frameRing->infos[index]};
+    if (!captureFrame(m_frameRing->buffers[index], info))
+    {
+        m_frameRing->freeBuffers.push(index);
+        return false;
+    }
+    info.sequence = m_frameRing->sequence++;
+    info.overruns = 0;
+    info.drops = 0;
 
-    return m_pImgData;
+    lease.m_ring = m_frameRing;
+    lease.m_index = index;
+    return true;
 }
 
 static inline int convertBayerPattern(uint32_t bayerFormat)
@@ -134,18 +287,51 @@ static inline int convertBayerPattern(uint32_t bayerFormat)
 
 bool QHYCamera::getFrame(cv::Mat& frame, bool debayer)
 {
-    const uint8_t* pFrame = getFrame();
-    if (!pFrame)
+    if (isCapturing())
+    {
+        FrameLease lease;
+        if (!acquireFrame(lease))
+        {
+            return false;
+        }
+        convertFrame(lease.data(), lease.info(), frame, debayer);
+        return true;
+    }
+
+    FrameInfo info;
+    if (!captureFrame(m_pImgData, info))
+    {
+        return false;
+    }
+    convertFrame(m_pImgData, info, frame, debayer);
+
+    return true;
+}
+
+bool QHYCamera::getFrame(cv::Mat& frame, FrameLease& lease)
+{
+    if (isCapturing() ? !acquireFrame(lease) : !readFrame(lease))
     {
         return false;
     }
-    
-    int channels = m_currentInfo->isColor && m_params.applyDebayer ? 3 : 1;
-    int type = m_params.transferBits == 16 ? CV_MAKETYPE(CV_16U, channels) : CV_MAKETYPE(CV_8U, channels);
+    frame = wrapFrame(lease.data(), lease.info());
+
+    return true;
+}
 
-    const cv::Mat imgQHY(m_params.roiHeight, m_params.roiWidth, type, (int8_t *)pFrame);
+// The geometry is the one the SDK reported for this frame, the settings may have changed since it was read
+cv::Mat QHYCamera::wrapFrame(const uint8_t *pFrame, const FrameInfo &info) const
+{
+    int type = info.bpp > 8 ? CV_MAKETYPE(CV_16U, info.channels) : CV_MAKETYPE(CV_8U, info.channels);
 
-    if (m_currentInfo->isColor && !m_params.applyDebayer && debayer)
+    return cv::Mat(info.height, info.width, type, (int8_t *)pFrame);
+}
+
+void QHYCamera::convertFrame(const uint8_t *pFrame, const FrameInfo &info, cv::Mat &frame, bool debayer) const
+{
+    const cv::Mat imgQHY = wrapFrame(pFrame, info);
+
+    if (m_currentInfo->isColor && info.channels == 1 && debayer)
     {
         cv::cvtColor(imgQHY, frame, convertBayerPattern(m_currentInfo->bayerFormat));
     }
@@ -154,10 +340,142 @@ bool QHYCamera::getFrame(cv::Mat& frame, bool debayer)
         imgQHY.copyTo(frame);
     }
     //cameraFrame.convertTo(frame, CV_8U, 1 / 256.0f);
+}
 
+bool QHYCamera::startCapture(size_t numBuffers)
+{
+    if (!m_camOpen)
+    {
+        std::cerr << "startCapture: the camera is not open" << std::endl;
+        return false;
+    }
+    stopCapture();
+
+    if (m_params.streamMode != LiveFrame)
+    {
+        if (!setStreamMode(LiveFrame))
+        {
+            return false;
+        }
+        m_isExposing = false;
+    }
+    if (!m_isExposing && !beginExposing())
+    {
+        return false;
+    }
+
+    const uint32_t size = getMemoryNeededForFrame();
+    if (size == 0)
+    {
+        std::cerr << "Cannot get memory for frame." << std::endl;
+        return false;
+    }
+    auto ring = std::make_shared<FrameRing>(std::max<size_t>(numBuffers, 1), size);
+    if (!ring->valid)
+    {
+        std::cerr << "startCapture: cannot allocate the frame buffers" << std::endl;
+        return false;
+    }
+
+    m_frameRing = ring;
+    m_lastFrameTimestamp = std::chrono::steady_clock::time_point{};
+    m_captureThread = std::jthread([this, ring](std::stop_token stopToken)
+                                   { captureLoop(stopToken, ring); });
     return true;
 }
 
+void QHYCamera::stopCapture()
+{
+    if (m_captureThread.joinable())
+    {
+        m_captureThread.request_stop();
+        m_captureThread.join();
+    }
+    // The leased buffers are freed with the last lease
+    m_frameRing.reset();
+}
+
+bool QHYCamera::isCapturing() const
+{
+    return m_captureThread.joinable();
+}
+
+size_t QHYCamera::pauseCapture()
+{
+    if (!isCapturing())
+    {
+        return 0;
+    }
+    const size_t numBuffers{m_frameRing->buffers.size() - 1};
+    stopCapture();
+    // The SDK cannot change the frame geometry while it is streaming, resumeCapture begins the live mode again
+    StopQHYCCDLive(pCamHandle);
+    m_isExposing = false;
+    return numBuffers;
+}
+
+bool QHYCamera::resumeCapture(size_t numBuffers)
+{
+    return numBuffers == 0 || startCapture(numBuffers);
+}
+
+bool QHYCamera::acquireFrame(FrameLease &lease, uint32_t timeoutMs)
+{
+    lease.release();
+    if (!isCapturing() || !m_frameRing->readyCount.try_acquire_for(std::chrono::milliseconds(timeoutMs)))
+    {
+        return false;
+    }
+    m_frameRing->readyBuffers.pop(lease.m_index);
+    lease.m_ring = m_frameRing;
+
+    // Time between the frames handed out
+    const std::chrono::steady_clock::time_point timestamp{lease.info().timestamp};
+    if (m_lastFrameTimestamp != std::chrono::steady_clock::time_point{})
+    {
+        m_lastFrameCaptureTime = std::chrono::duration<float>(timestamp - m_lastFrameTimestamp).count();
+    }
+    m_lastFrameTimestamp = timestamp;
+    return true;
+}
+
+void QHYCamera::captureLoop(std::stop_token stopToken, std::shared_ptr<FrameRing> ring)
+{
+    size_t index{ring->buffers.size() - 1};
+    while (!stopToken.stop_requested())
+    {
+        FrameInfo &info{ring->infos[index]};
+        if (GetQHYCCDLiveFrame(pCamHandle, &info.width, &info.height, &info.bpp, &info.channels, ring->buffers[index]) != QHYCCD_SUCCESS)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            continue;
+        }
+        info.timestamp = std::chrono::steady_clock::now();
+        info.sequence = ring->sequence++;
+
+        // The next frame goes to a free buffer, or to the oldest frame nobody has read yet.
+        // When every other buffer is leased the frame just read is thrown away
+        size_t next;
+        if (!ring->freeBuffers.pop(next))
+        {
+            if (!ring->readyCount.try_acquire())
+            {
+                ++ring->drops;
+                continue;
+            }
+            ring->readyBuffers.pop(next);
+            ++ring->overruns;
+        }
+        info.overruns = ring->overruns;
+        info.drops = ring->drops;
+
+        ring->readyBuffers.push(index);
+        ring->readyCount.release();
+        index = next;
+    }
+    ring->freeBuffers.push(index);
+}
+
 cv::Mat QHYCamera::getFrameRet(bool debayer)
 {
     cv::Mat returnFrame;
@@ -278,6 +596,8 @@ float QHYCamera::getLastFrameCaptureTime() const
 
 bool QHYCamera::setControl(ControlParam controlParam, double value)
 {
+    // The transfer bits and the channels change the size of the frames
+    const size_t numBuffers{controlParam == TransferBits || controlParam == Channels ? pauseCapture() : 0};
     uint32_t rc = IsQHYCCDControlAvailable(pCamHandle, (CONTROL_ID)controlParam);
     if (rc == QHYCCD_SUCCESS)
     {
@@ -285,6 +605,7 @@ bool QHYCamera::setControl(ControlParam controlParam, double value)
         if (rc != QHYCCD_SUCCESS)
         {
             std::cerr << "setControl failed: " << controlParam << std::endl;
+            resumeCapture(numBuffers);
             return false;
         }
         switch (controlParam)
@@ -309,42 +630,48 @@ bool QHYCamera::setControl(ControlParam controlParam, double value)
     {
         std::cout << "Control not available to change: " << controlParam << std::endl;
     }
-    return true;
+    return resumeCapture(numBuffers);
 }
 
 bool QHYCamera::setDebayer(bool enable)
 {
+    const size_t numBuffers{pauseCapture()};
     if (SetQHYCCDDebayerOnOff(pCamHandle, enable) != QHYCCD_SUCCESS)
     {
         std::cerr << "SetQHYCCDDebayerOnOff failure" << std::endl;
+        resumeCapture(numBuffers);
         return false;
     }
     allocBufferMemory();
     m_params.applyDebayer = enable;
 
-    return true;
+    return resumeCapture(numBuffers);
 }
 
 bool QHYCamera::setBinMode(QHYCamera::BinMode mode)
 {
+    const size_t numBuffers{pauseCapture()};
     uint32_t rc = SetQHYCCDBinMode(pCamHandle, (int)mode, (int)mode);
     if (rc != QHYCCD_SUCCESS)
     {
         std::cerr << "SetQHYCCDBinMode failure, error: " << rc << std::endl;
+        resumeCapture(numBuffers);
         return false;
     }
     allocBufferMemory();
     m_params.binMode = mode;
 
-    return true;
+    return resumeCapture(numBuffers);
 }
 
 bool QHYCamera::setResolution(uint32_t startX, uint32_t startY, uint32_t width, uint32_t height)
 {
+    const size_t numBuffers{pauseCapture()};
     uint32_t rc = SetQHYCCDResolution(pCamHandle, startX, startY, width, height);
     if (rc != QHYCCD_SUCCESS)
     {
         std::cerr << "SetQHYCCDResolution failure, error: " << rc << std::endl;
+        resumeCapture(numBuffers);
         return false;
     }
     allocBufferMemory();
@@ -353,7 +680,7 @@ bool QHYCamera::setResolution(uint32_t startX, uint32_t startY, uint32_t width,
     m_params.roiWidth = width;
     m_params.roiHeight = height;
 
-    return true;
+    return resumeCapture(numBuffers);
 }
 
 bool QHYCamera::setStreamMode(StreamModeType mode)
@@ -451,6 +778,11 @@ bool QHYCamera::allocBufferMemory()
 
     m_pImgData = new uint8_t[size];
     memset(m_pImgData, 0, size);
+    // The frame ring of getFrame with a lease is sized again on the next frame, leased buffers stay valid
+    if (!isCapturing())
+    {
+        m_frameRing.reset();
+    }
 
     return true;
 }
@@ -562,6 +894,8 @@ void QHYCamera::close()
 {
     if (m_camOpen)
     {
+        stopCapture();
+
         if (m_params.streamMode == SingleFrame)
         {
             CancelQHYCCDExposingAndReadout(pCamHandle);
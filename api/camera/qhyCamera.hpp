@@ -4,6 +4,10 @@
 #include <sstream>
 #include <map>
 #include <iostream>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
 
 #include <qhyccd.h>
 #include <opencv2/opencv.hpp>
@@ -14,6 +18,7 @@ namespace sky360lib::camera
     {
     public:
     static const int DEFAULT_CAPTURE_RETRIES = 1000;
+    static constexpr size_t DEFAULT_FRAME_BUFFERS = 4;
         enum BinMode
         {
             Bin_1x1 = 1,
@@ -113,6 +118,45 @@ namespace sky360lib::camera
             Channels = CONTROL_CHANNELS //!< image channels
         };
 
+        /// A frame read by the capture thread, see startCapture
+        struct FrameInfo
+        {
+            uint64_t sequence; //!< frames read since startCapture, the gaps are frames overrun or dropped
+            std::chrono::steady_clock::time_point timestamp; //!< when the frame was read from the camera
+            uint32_t width;
+            uint32_t height;
+            uint32_t bpp;
+            uint32_t channels;
+            uint64_t overruns; //!< frames recycled before anyone read them, since startCapture
+            uint64_t drops; //!< frames read while every buffer was leased, since startCapture
+        };
+
+        struct FrameRing;
+
+        /// Keeps a buffer of the frame ring out of reuse until it is released or destroyed.
+        /// The buffers outlive stopCapture and the camera while they are leased, a lease can be released from any thread
+        class FrameLease
+        {
+        public:
+            FrameLease() = default;
+            ~FrameLease();
+            FrameLease(FrameLease &&other) noexcept;
+            FrameLease &operator=(FrameLease &&other) noexcept;
+            FrameLease(const FrameLease &) = delete;
+            FrameLease &operator=(const FrameLease &) = delete;
+
+            bool valid() const { return m_ring != nullptr; }
+            const uint8_t *data() const;
+            const FrameInfo &info() const;
+            void release();
+
+        private:
+            friend class QHYCamera;
+
+            std::shared_ptr<FrameRing> m_ring;
+            size_t m_index{0};
+        };
+
         QHYCamera();
         ~QHYCamera();
 
@@ -121,6 +165,11 @@ namespace sky360lib::camera
         const uint8_t* getFrame();
         bool getFrame(cv::Mat& frame, bool debayer);
         cv::Mat getFrameRet(bool debayer);
+        /// Zero copy: frame wraps the camera buffer held by lease, it stays valid and is not rewritten until the
+        /// lease is released. The frame is as the camera sends it (Bayer unless the SDK debayers) and has to be
+        /// treated as read only. Taken from the capture thread when capturing, otherwise read now into a free
+        /// buffer of the frame ring, false if every buffer is leased
+        bool getFrame(cv::Mat& frame, FrameLease& lease);
 
         float getLastFrameCaptureTime() const;
         CameraInfo const * getCameraInfo() const;
@@ -142,6 +191,17 @@ namespace sky360lib::camera
 
         uint32_t getMemoryNeededForFrame() const;
 
+        /// Streaming: a thread owned by the camera reads live frames into a ring of numBuffers page aligned buffers
+        /// while the frames are being processed. When the consumer falls behind the oldest waiting frame is recycled
+        /// (an overrun), when every buffer is leased the frame is read and thrown away (a drop).
+        /// The buffers are sized for the current settings: setResolution, setBinMode, setDebayer and setControl of the
+        /// transfer bits or channels stop the capture and start it again with new buffers, the leases keep the old ones
+        bool startCapture(size_t numBuffers = DEFAULT_FRAME_BUFFERS);
+        void stopCapture();
+        bool isCapturing() const;
+        /// Waits up to timeoutMs for the next captured frame, releases the previous buffer of the lease first
+        bool acquireFrame(FrameLease &lease, uint32_t timeoutMs = 1000);
+
     private:
         std::string m_camId;
         qhyccd_handle *pCamHandle{nullptr};
@@ -155,6 +215,10 @@ namespace sky360lib::camera
         bool m_camOpen{false};
         bool m_isExposing{false};
 
+        std::shared_ptr<FrameRing> m_frameRing;
+        std::jthread m_captureThread;
+        std::chrono::steady_clock::time_point m_lastFrameTimestamp;
+
         bool getCameraInfo(std::string camId, CameraInfo &ci);
         bool scanCameras();
         bool allocBufferMemory();
@@ -163,5 +227,13 @@ namespace sky360lib::camera
         void applyParams();
         bool getSingle(uint32_t *w, uint32_t *h, uint32_t *bpp, uint32_t *channels, uint8_t *imgData);
         bool getLive(uint32_t *w, uint32_t *h, uint32_t *bpp, uint32_t *channels, uint8_t *imgData);
+        bool captureFrame(uint8_t *imgData, FrameInfo &info);
+        bool readFrame(FrameLease &lease);
+        void captureLoop(std::stop_token stopToken, std::shared_ptr<FrameRing> ring);
+        /// Stops the capture around a change of the frame geometry, returns its number of buffers or 0 if it was not running
+        size_t pauseCapture();
+        bool resumeCapture(size_t numBuffers);
+        cv::Mat wrapFrame(const uint8_t *pFrame, const FrameInfo &info) const;
+        void convertFrame(const uint8_t *pFrame, const FrameInfo &info, cv::Mat &frame, bool debayer) const;
     };
 }
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace sky360lib
+{
+    /// Lock free queue of a fixed capacity (rounded up to a power of two), any number of threads can push and pop.
+    /// Every slot carries a sequence number that tells whether it is ready to be written or read, so a push and a pop
+    /// only contend on their own position (D. Vyukov's bounded MPMC queue).
+    /// Meant for small trivially copyable items such as buffer indices
+    template <typename T>
+    class BoundedQueue final
+    {
+    public:
+        explicit BoundedQueue(size_t _capacity)
+        {
+            size_t capacity{2};
+            while (capacity < _capacity)
+            {
+                capacity <<= 1;
+            }
+            m_mask = capacity - 1;
+            m_cells = std::make_unique<Cell[]>(capacity);
+            for (size_t i{0}; i < capacity; ++i)
+            {
+                m_cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+            m_pushPos.store(0, std::memory_order_relaxed);
+            m_popPos.store(0, std::memory_order_relaxed);
+        }
+
+        BoundedQueue(const BoundedQueue &) = delete;
+        BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+        /// false if the queue is full
+        bool push(const T &_item)
+        {
+            size_t pos{m_pushPos.load(std::memory_order_relaxed)};
+            for (;;)
+            {
+                Cell &cell{m_cells[pos & m_mask]};
+                const size_t sequence{cell.sequence.load(std::memory_order_acquire)};
+                const intptr_t diff{(intptr_t)sequence - (intptr_t)pos};
+                if (diff == 0)
+                {
+                    if (m_pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.item = _item;
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_pushPos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// false if the queue is empty
+        bool pop(T &_item)
+        {
+            size_t pos{m_popPos.load(std::memory_order_relaxed)};
+            for (;;)
+            {
+                Cell &cell{m_cells[pos & m_mask]};
+                const size_t sequence{cell.sequence.load(std::memory_order_acquire)};
+                const intptr_t diff{(intptr_t)sequence - (intptr_t)(pos + 1)};
+                if (diff == 0)
+                {
+                    if (m_popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        _item = cell.item;
+                        cell.sequence.store(pos + m_mask + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = m_popPos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        size_t capacity() const { return m_mask + 1; }
+
+    private:
+        static constexpr size_t CACHE_LINE_SIZE{64};
+
+        struct Cell
+        {
+            std::atomic<size_t> sequence;
+            T item;
+        };
+
+        std::unique_ptr<Cell[]> m_cells;
+        size_t m_mask;
+        // On their own cache lines, so the producers and the consumers do not invalidate each other
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_pushPos;
+        alignas(CACHE_LINE_SIZE) std::atomic<size_t> m_popPos;
+    };
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "core.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace sky360lib
+{
+    /// Layouts of the foreground masks produced by the background subtractors
+    enum class MaskFormat
+    {
+        /// One byte per pixel, UCHAR_MAX for foreground and ZERO_UC for background
+        Bytes,
+        /// One bit per pixel packed per row in a CV_8UC1 Mat of packedMaskWidth(width) columns.
+        /// Pixel x is bit (x % 8) of byte (x / 8), the padding bits at the end of a row are always zero
+        PackedBits
+    };
+
+    inline int packedMaskWidth(int _width)
+    {
+        return (_width + 7) / 8;
+    }
+
+    /// Packs a row of a byte mask, any non zero byte is foreground
+    inline void packMaskRow(const uint8_t *const _in, uint8_t *const _out, const int _width)
+    {
+        int x{0};
+#if defined(__AVX2__)
+        const __m256i zero256{_mm256_setzero_si256()};
+        for (; x + 32 <= _width; x += 32)
+        {
+            const __m256i isZero{_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(_in + x)), zero256)};
+            const uint32_t bits{~(uint32_t)_mm256_movemask_epi8(isZero)};
+            memcpy(_out + (x >> 3), &bits, sizeof(bits));
+        }
+#endif
+#if defined(__SSE2__)
+        const __m128i zero128{_mm_setzero_si128()};
+        for (; x + 16 <= _width; x += 16)
+        {
+            const __m128i isZero{_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(_in + x)), zero128)};
+            const uint16_t bits{(uint16_t)~_mm_movemask_epi8(isZero)};
+            memcpy(_out + (x >> 3), &bits, sizeof(bits));
+        }
+#endif
+        for (; x < _width; x += 8)
+        {
+            const int end{std::min(x + 8, _width)};
+            uint8_t bits{0};
+            for (int b{x}; b < end; ++b)
+            {
+                bits |= (uint8_t)((_in[b] != 0) << (b - x));
+            }
+            _out[x >> 3] = bits;
+        }
+    }
+
+    /// Expands a packed row back to UCHAR_MAX/ZERO_UC bytes
+    inline void unpackMaskRow(const uint8_t *const _in, uint8_t *const _out, const int _width)
+    {
+        for (int x{0}; x < _width; ++x)
+        {
+            _out[x] = ((_in[x >> 3] >> (x & 7)) & 1) ? UCHAR_MAX : ZERO_UC;
+        }
+    }
+
+    /// True if any byte of the row is non zero, works for byte and packed rows
+    inline bool maskRowHasForeground(const uint8_t *const _row, const int _numBytes)
+    {
+        int x{0};
+        uint64_t bits{0};
+        for (; x + 8 <= _numBytes; x += 8)
+        {
+            uint64_t word;
+            memcpy(&word, _row + x, sizeof(word));
+            bits |= word;
+        }
+        for (; x < _numBytes; ++x)
+        {
+            bits |= _row[x];
+        }
+        return bits != 0;
+    }
+
+    /// _packedMask must already have the rows of _byteMask and at least packedMaskWidth(_byteMask.cols) columns
+    inline void packMask(const cv::Mat &_byteMask, cv::Mat &_packedMask)
+    {
+        for (int y{0}; y < _byteMask.rows; ++y)
+        {
+            packMaskRow(_byteMask.ptr<uint8_t>(y), _packedMask.ptr<uint8_t>(y), _byteMask.cols);
+        }
+    }
+
+    /// Expands a packed mask into a CV_8UC1 mask of _width columns
+    inline void unpackMask(const cv::Mat &_packedMask, cv::Mat &_byteMask, int _width)
+    {
+        _byteMask.create(_packedMask.rows, _width, CV_8UC1);
+        for (int y{0}; y < _packedMask.rows; ++y)
+        {
+            unpackMaskRow(_packedMask.ptr<uint8_t>(y), _byteMask.ptr<uint8_t>(y), _width);
+        }
+    }
+}
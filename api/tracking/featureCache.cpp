@@ -0,0 +1,264 @@
+#include "precomp.hpp"
+
+#include "featureCache.hpp"
+#include "trackerCSRTUtils.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace sky360lib::tracking;
+
+FeatureCache::FeatureCache(const TrackerCSRT::Params &_params)
+    : m_params{_params}, m_numBlocks{0}
+{
+}
+
+void FeatureCache::beginFrame(const cv::Mat &_frame)
+{
+    m_frame = _frame;
+    m_frameSize = _frame.size();
+    m_regions.clear();
+    m_regionCellSizes.clear();
+    m_numBlocks = 0;
+}
+
+void FeatureCache::addRegion(const cv::Rect &_region, float _cellSize)
+{
+    const cv::Rect region{_region & cv::Rect(cv::Point(0, 0), m_frameSize)};
+    if (region.empty())
+    {
+        return;
+    }
+    m_regions.push_back(region);
+    m_regionCellSizes.push_back(std::max(1, cvRound(_cellSize)));
+}
+
+void FeatureCache::prepare()
+{
+    mergeRegions();
+
+    // The cell sizes in use by each block
+    for (size_t b{0}; b < m_numBlocks; ++b)
+    {
+        m_blocks[b].cellSizes.clear();
+    }
+    for (size_t i{0}; i < m_regions.size(); ++i)
+    {
+        for (size_t b{0}; b < m_numBlocks; ++b)
+        {
+            if ((m_blocks[b].rect & m_regions[i]) == m_regions[i])
+            {
+                std::vector<int> &cellSizes{m_blocks[b].cellSizes};
+                if (std::find(cellSizes.begin(), cellSizes.end(), m_regionCellSizes[i]) == cellSizes.end())
+                {
+                    cellSizes.push_back(m_regionCellSizes[i]);
+                }
+                break;
+            }
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, (int)m_numBlocks),
+                      [this](const cv::Range &_range)
+                      {
+                          for (int b{_range.start}; b < _range.end; ++b)
+                          {
+                              prepareBlock(m_blocks[b]);
+                          }
+                      });
+}
+
+void FeatureCache::mergeRegions()
+{
+    // Overlapping regions go to the same block, merging two blocks can make them overlap a third one
+    std::vector<cv::Rect> &rects{m_mergedRegions};
+    rects.assign(m_regions.begin(), m_regions.end());
+    bool merged{true};
+    while (merged)
+    {
+        merged = false;
+        for (size_t i{0}; i < rects.size(); ++i)
+        {
+            for (size_t j{i + 1}; j < rects.size();)
+            {
+                if ((rects[i] & rects[j]).area() > 0)
+                {
+                    rects[i] |= rects[j];
+                    rects[j] = rects.back();
+                    rects.pop_back();
+                    merged = true;
+                }
+                else
+                {
+                    ++j;
+                }
+            }
+        }
+    }
+
+    // The blocks of the previous frames are reused in order, the same targets usually give the same blocks
+    if (m_blocks.size() < rects.size())
+    {
+        m_blocks.resize(rects.size());
+    }
+    m_numBlocks = rects.size();
+    for (size_t b{0}; b < rects.size(); ++b)
+    {
+        m_blocks[b].rect = rects[b];
+    }
+}
+
+// The maps are written into the buffers of the previous frames, they only reallocate when the block changes size
+void FeatureCache::prepareBlock(Block &_block) const
+{
+    // Single channel and 16 bit frames keep their format, only the segmentation works on 8 bits
+    _block.image = m_frame(_block.rect);
+    const bool colour{_block.image.channels() == 3};
+
+    if (m_params.use_segmentation)
+    {
+        _block.hsv = get_segmentation_image(_block.image, _block.hsvBuffer);
+    }
+    if (m_params.use_hog)
+    {
+        _block.hog.resize(_block.cellSizes.size());
+        for (size_t i{0}; i < _block.cellSizes.size(); ++i)
+        {
+            HogMap &hogMap{_block.hog[i]};
+            hogMap.cellSize = _block.cellSizes[i];
+            get_features_hog(_block.image, hogMap.cellSize, hogMap.buffer, hogMap.channels);
+            hogMap.channels.resize(std::min<size_t>(hogMap.channels.size(), (size_t)m_params.num_hog_channels_used));
+        }
+    }
+    if (m_params.use_color_names && _block.image.type() == CV_8UC3)
+    {
+        get_features_cn(_block.image, cv::Size(), _block.colorNamesBuffer, _block.colorNames);
+    }
+    else
+    {
+        _block.colorNames.clear();
+    }
+    if (m_params.use_gray)
+    {
+        const cv::Mat *gray{&_block.image};
+        if (colour)
+        {
+            cv::cvtColor(_block.image, _block.grayImage, cv::COLOR_BGR2GRAY);
+            gray = &_block.grayImage;
+        }
+        gray->convertTo(_block.gray, CV_32FC1, 1.0 / pixel_range(gray->depth()), -0.5);
+    }
+}
+
+const FeatureCache::Block *FeatureCache::findBlock(const cv::Rect &_region) const
+{
+    for (size_t b{0}; b < m_numBlocks; ++b)
+    {
+        if ((m_blocks[b].rect & _region) == _region)
+        {
+            return &m_blocks[b];
+        }
+    }
+    return nullptr;
+}
+
+bool FeatureCache::getImage(const cv::Rect &_region, cv::Mat &_image) const
+{
+    const Block *block{findBlock(_region)};
+    if (block == nullptr)
+    {
+        return false;
+    }
+    _image = block->image(_region - block->rect.tl());
+    return true;
+}
+
+bool FeatureCache::getHsv(const cv::Rect &_region, cv::Mat &_hsv) const
+{
+    const Block *block{findBlock(_region)};
+    if (block == nullptr || block->hsv.empty())
+    {
+        return false;
+    }
+    _hsv = block->hsv(_region - block->rect.tl());
+    return true;
+}
+
+void FeatureCache::sampleFeatures(const cv::Point2f &_center, const cv::Size &_windowSize, const cv::Size &_featureSize,
+                                  float _cellSize, std::vector<cv::Mat> &_features) const
+{
+    // Same window as get_subwindow, the parts out of the frame replicate its borders
+    const cv::Rect window{cvFloor(_center.x) + 1 - _windowSize.width / 2, cvFloor(_center.y) + 1 - _windowSize.height / 2,
+                          _windowSize.width, _windowSize.height};
+    const Block *block{findBlock(window & cv::Rect(cv::Point(0, 0), m_frameSize))};
+    if (block == nullptr)
+    {
+        CV_Error(cv::Error::StsBadArg, "The window is not in the feature cache");
+    }
+
+    // Block pixel at the centre of each feature cell
+    const double scaleX{(double)_windowSize.width / (double)_featureSize.width};
+    const double scaleY{(double)_windowSize.height / (double)_featureSize.height};
+    const double offsetX{window.x - block->rect.x + 0.5 * scaleX - 0.5};
+    const double offsetY{window.y - block->rect.y + 0.5 * scaleY - 0.5};
+    auto sample = [&](const cv::Mat &_map, double _mapCellSize, cv::Mat &_feature)
+    {
+        const cv::Matx23d toMap(scaleX / _mapCellSize, 0.0, (offsetX + 0.5) / _mapCellSize - 0.5,
+                                0.0, scaleY / _mapCellSize, (offsetY + 0.5) / _mapCellSize - 0.5);
+        cv::warpAffine(_map, _feature, toMap, _featureSize, cv::INTER_LINEAR | cv::WARP_INVERSE_MAP, cv::BORDER_REPLICATE);
+    };
+    // The features are sampled into the Mats already in _features, which have their size from the last window
+    size_t numFeatures{0};
+    auto nextFeature = [&]() -> cv::Mat &
+    {
+        if (numFeatures == _features.size())
+        {
+            _features.emplace_back();
+        }
+        return _features[numFeatures++];
+    };
+
+    if (m_params.use_hog && !block->hog.empty())
+    {
+        // The map with the closest cell size
+        const HogMap *hogMap{&block->hog[0]};
+        for (const HogMap &map : block->hog)
+        {
+            if (std::abs(map.cellSize - _cellSize) < std::abs(hogMap->cellSize - _cellSize))
+            {
+                hogMap = &map;
+            }
+        }
+        for (const cv::Mat &channel : hogMap->channels)
+        {
+            sample(channel, hogMap->cellSize, nextFeature());
+        }
+    }
+    if (m_params.use_color_names)
+    {
+        for (const cv::Mat &channel : block->colorNames)
+        {
+            sample(channel, 1.0, nextFeature());
+        }
+    }
+    if (m_params.use_gray)
+    {
+        sample(block->gray, 1.0, nextFeature());
+    }
+    if (m_params.use_rgb && block->image.channels() == 3)
+    {
+        // Every channel scaled to [-0.5, 0.5] and centred on its mean, the cache is shared by the trackers
+        // updating in parallel so the scratch is per thread
+        thread_local cv::Mat sampled;
+        thread_local cv::Mat converted;
+        sample(block->image, 1.0, sampled);
+        sampled.convertTo(converted, CV_32F, 1.0 / pixel_range(block->image.depth()), -0.5);
+        cv::subtract(converted, cv::mean(converted), converted);
+        _features.resize(std::max(_features.size(), numFeatures + 3));
+        cv::split(converted, &_features[numFeatures]);
+        numFeatures += 3;
+    }
+    _features.resize(numFeatures);
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "trackerCSRT.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <vector>
+
+namespace sky360lib::tracking
+{
+    /// Features of a frame shared by the trackers following targets on it, see MultiTracker.
+    /// The trackers add the regions they are going to read, overlapping regions are merged in blocks and every
+    /// block is converted (BGR, HSV) and turned into HOG, Color Names and grey maps once per frame.
+    /// The blocks and their maps are kept from frame to frame and rebuilt in place, so they only allocate when
+    /// a block changes its size.
+    /// The trackers then sample their windows from the maps instead of computing the features of their own patch.
+    /// The maps are only read after prepare, so the trackers can sample them from different threads
+    class FeatureCache final
+    {
+    public:
+        explicit FeatureCache(const TrackerCSRT::Params &_params = TrackerCSRT::Params());
+
+        /// Starts a frame without regions, _frame has to stay alive until the end of the frame
+        void beginFrame(const cv::Mat &_frame);
+        /// _cellSize is the size in frame pixels of the cells of the HOG features the region will sample
+        void addRegion(const cv::Rect &_region, float _cellSize);
+        /// Builds the maps of all the regions added since beginFrame
+        void prepare();
+
+        const cv::Size &getFrameSize() const { return m_frameSize; }
+        /// Views of the frame (BGR or single channel, as given) and of the segmentation image (HSV with the hue
+        /// scaled to 0-255, or the 8 bit intensity) over a region, false if the region is not inside one of the blocks
+        bool getImage(const cv::Rect &_region, cv::Mat &_image) const;
+        bool getHsv(const cv::Rect &_region, cv::Mat &_hsv) const;
+        /// Features of the window of _windowSize around _center (as TrackerCSRT crops it) resampled to _featureSize,
+        /// in the order and scale of TrackerCSRT, before the window function. The Mats already in _features are
+        /// reused when they have the size
+        void sampleFeatures(const cv::Point2f &_center, const cv::Size &_windowSize, const cv::Size &_featureSize,
+                            float _cellSize, std::vector<cv::Mat> &_features) const;
+
+    private:
+        struct HogMap
+        {
+            int cellSize;
+            /// The channels are views of the buffer
+            cv::Mat buffer;
+            std::vector<cv::Mat> channels;
+        };
+
+        struct Block
+        {
+            cv::Rect rect;
+            /// Cell sizes of the HOG maps read by the regions of the block
+            std::vector<int> cellSizes;
+            cv::Mat image;
+            /// The segmentation image is converted into hsvBuffer, 8 bit single channel images are used as they are
+            cv::Mat hsvBuffer;
+            cv::Mat hsv;
+            cv::Mat colorNamesBuffer;
+            std::vector<cv::Mat> colorNames;
+            cv::Mat grayImage;
+            cv::Mat gray;
+            std::vector<HogMap> hog;
+        };
+
+        TrackerCSRT::Params m_params;
+        cv::Mat m_frame;
+        cv::Size m_frameSize;
+        std::vector<cv::Rect> m_regions;
+        std::vector<int> m_regionCellSizes;
+        std::vector<cv::Rect> m_mergedRegions;
+        /// The first m_numBlocks blocks are the ones of this frame, the others keep their buffers for the next frames
+        std::vector<Block> m_blocks;
+        size_t m_numBlocks;
+
+        void mergeRegions();
+        void prepareBlock(Block &_block) const;
+        const Block *findBlock(const cv::Rect &_region) const;
+    };
+}
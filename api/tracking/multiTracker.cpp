@@ -0,0 +1,144 @@
+#include "multiTracker.hpp"
+
+#include "coreUtils.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <execution>
+#include <numeric>
+
+using namespace sky360lib::tracking;
+
+MultiTracker::MultiTracker(const TrackerCSRT::Params &_params)
+    : m_params{_params}, m_featureCache{_params}, m_numWorkers{calcAvailableThreads()}, m_nextId{0}
+{
+}
+
+void MultiTracker::update(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets)
+{
+    // All the regions the trackers are going to read, so the cache builds the maps once
+    m_featureCache.beginFrame(_frame);
+    for (const cv::Ptr<TrackerCSRT> &tracker : m_trackers)
+    {
+        m_featureCache.addRegion(tracker->getWorkRegion(_frame.size()), tracker->getFeatureCellSize());
+    }
+    prepareNewTargets(_frame, _newTargets);
+    m_featureCache.prepare();
+
+    // Every tracker only writes its own slot of m_targets and m_tracking.
+    // The pool may run the workers in any order, but each one takes the most expensive tracker left
+    sortByCost();
+    m_tracking.resize(m_trackers.size());
+    m_workers.resize(std::min(m_numWorkers, m_trackers.size()));
+    std::atomic<size_t> nextUpdate{0};
+    std::for_each(
+        std::execution::par,
+        m_workers.begin(),
+        m_workers.end(),
+        [&](size_t)
+        {
+            for (size_t next{nextUpdate.fetch_add(1, std::memory_order_relaxed)}; next < m_updateOrder.size();
+                 next = nextUpdate.fetch_add(1, std::memory_order_relaxed))
+            {
+                const size_t i{m_updateOrder[next]};
+                m_tracking[i] = m_trackers[i]->update(m_featureCache, m_targets[i].bbox) ? 1 : 0;
+            }
+        });
+    removeLost();
+    initNewTargets();
+}
+
+void MultiTracker::addTargets(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets)
+{
+    m_featureCache.beginFrame(_frame);
+    prepareNewTargets(_frame, _newTargets);
+    m_featureCache.prepare();
+    initNewTargets();
+}
+
+bool MultiTracker::removeTarget(int _id)
+{
+    for (size_t i{0}; i < m_targets.size(); ++i)
+    {
+        if (m_targets[i].id == _id)
+        {
+            removeAt(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void MultiTracker::prepareNewTargets(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets)
+{
+    m_newTrackers.clear();
+    m_newTargets = _newTargets;
+    for (const cv::Rect &bbox : m_newTargets)
+    {
+        cv::Ptr<TrackerCSRT> tracker{TrackerCSRT::create(m_params)};
+        m_featureCache.addRegion(tracker->prepareInit(_frame.size(), bbox), tracker->getFeatureCellSize());
+        m_newTrackers.push_back(tracker);
+    }
+}
+
+void MultiTracker::initNewTargets()
+{
+    std::for_each(
+        std::execution::par,
+        m_newTrackers.begin(),
+        m_newTrackers.end(),
+        [&](const cv::Ptr<TrackerCSRT> &tracker)
+        {
+            tracker->init(m_featureCache);
+        });
+    for (size_t i{0}; i < m_newTrackers.size(); ++i)
+    {
+        m_trackers.push_back(m_newTrackers[i]);
+        m_targets.push_back({m_nextId++, m_newTargets[i]});
+    }
+    m_newTrackers.clear();
+}
+
+void MultiTracker::clear()
+{
+    m_trackers.clear();
+    m_targets.clear();
+    m_lostTargets.clear();
+}
+
+void MultiTracker::sortByCost()
+{
+    m_updateCosts.resize(m_trackers.size());
+    for (size_t i{0}; i < m_trackers.size(); ++i)
+    {
+        m_updateCosts[i] = m_trackers[i]->getUpdateCost();
+    }
+    m_updateOrder.resize(m_trackers.size());
+    std::iota(m_updateOrder.begin(), m_updateOrder.end(), 0);
+    std::sort(m_updateOrder.begin(), m_updateOrder.end(),
+              [&](size_t _a, size_t _b)
+              { return m_updateCosts[_a] > m_updateCosts[_b]; });
+}
+
+void MultiTracker::removeLost()
+{
+    m_lostTargets.clear();
+    // From the back, so the tracker moved into a free slot has already been checked
+    for (size_t i{m_trackers.size()}; i-- > 0;)
+    {
+        if (m_tracking[i] != 0)
+        {
+            continue;
+        }
+        m_lostTargets.push_back(m_targets[i].id);
+        removeAt(i);
+    }
+}
+
+void MultiTracker::removeAt(size_t _index)
+{
+    m_trackers[_index] = std::move(m_trackers.back());
+    m_trackers.pop_back();
+    m_targets[_index] = m_targets.back();
+    m_targets.pop_back();
+}
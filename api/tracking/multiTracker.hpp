@@ -0,0 +1,68 @@
+#pragma once
+
+#include "trackerCSRT.hpp"
+#include "featureCache.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <vector>
+
+namespace sky360lib::tracking
+{
+    /// Tracks several targets on the same frames with CSRT trackers that share a FeatureCache,
+    /// so the pixels around targets that are close to each other are converted and turned into features once.
+    /// The trackers are updated in parallel by one worker per thread. The workers take the trackers from a shared index
+    /// over the trackers sorted by cost, so the most expensive ones start first and do not end up alone at the end of the frame
+    class MultiTracker final
+    {
+    public:
+        struct Target
+        {
+            int id;
+            cv::Rect bbox;
+        };
+
+        explicit MultiTracker(const TrackerCSRT::Params &_params = TrackerCSRT::Params());
+
+        /// Follows the current targets on _frame, the ones that are lost are dropped (see getLostTargets),
+        /// then starts tracking _newTargets from this frame. The new targets are appended to getTargets in their order
+        void update(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets = {});
+        /// Starts tracking _newTargets from _frame without updating the current targets, for callers that pick the new
+        /// targets after seeing where the current ones went on the same frame
+        void addTargets(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets);
+        /// Stops tracking a target, false if there is no target with that id
+        bool removeTarget(int _id);
+        void clear();
+
+        /// Targets being tracked after the last update. The buffer is kept between updates, a lost target is
+        /// replaced by the last one so the order is not kept, use the ids to follow the targets
+        const std::vector<Target> &getTargets() const { return m_targets; }
+        /// Ids of the targets lost in the last update
+        const std::vector<int> &getLostTargets() const { return m_lostTargets; }
+        size_t size() const { return m_targets.size(); }
+
+    private:
+        TrackerCSRT::Params m_params;
+        FeatureCache m_featureCache;
+        std::vector<cv::Ptr<TrackerCSRT>> m_trackers;
+        std::vector<Target> m_targets;
+        std::vector<cv::Ptr<TrackerCSRT>> m_newTrackers;
+        std::vector<cv::Rect> m_newTargets;
+        std::vector<int> m_lostTargets;
+        /// Update order of the trackers (most expensive first) and the outcome of each update
+        std::vector<size_t> m_updateOrder;
+        std::vector<float> m_updateCosts;
+        std::vector<uint8_t> m_tracking;
+        /// One task per worker, no more than the trackers
+        size_t m_numWorkers;
+        std::vector<size_t> m_workers;
+        int m_nextId;
+
+        void prepareNewTargets(const cv::Mat &_frame, const std::vector<cv::Rect> &_newTargets);
+        void initNewTargets();
+        void sortByCost();
+        void removeLost();
+        void removeAt(size_t _index);
+    };
+}
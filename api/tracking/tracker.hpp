@@ -1,3 +1,4 @@
 #pragma once
 
-#include "trackerCSRT.hpp"
\ No newline at end of file
+#include "trackerCSRT.hpp"
+#include "multiTracker.hpp"
@@ -8,6 +8,9 @@
 #include "trackerCSRTSegmentation.hpp"
 #include "trackerCSRTUtils.hpp"
 #include "trackerCSRTScaleEstimation.hpp"
+#include "featureCache.hpp"
+
+#include <algorithm>
 
 namespace sky360lib::tracking
 {
@@ -26,6 +29,60 @@ namespace sky360lib::tracking
         void modelUpdateImpl() override {}
     };
 
+    // Buffers of the ADMM of one feature channel
+    struct ADMMWorkspace
+    {
+        Mat Sxy;
+        Mat Sxx;
+        Mat H;
+        Mat L;
+        Mat G;
+        Mat T;
+        Mat h;
+    };
+
+    // Spectra and buffers of calculate_response, update_csr_filter and create_csr_filter, and the patches, features
+    // and segmentation buffers of every update. They keep their size while the target keeps its scale
+    struct CSRWorkspace
+    {
+        std::vector<Mat> features;
+        std::vector<Mat> feature_spectra;
+        std::vector<Mat> new_filter;
+        std::vector<ADMMWorkspace> admm;
+        std::vector<float> new_filter_weights;
+        Mat channel_spectrum;
+        Mat response_spectrum;
+        Mat response;
+
+        // Template window and its features, the features are views of these buffers
+        Mat patch;
+        Mat template_patch;
+        Mat hog_buffer;
+        std::vector<Mat> hog;
+        Mat cn_buffer;
+        std::vector<Mat> cn;
+        Mat gray_patch;
+        Mat gray;
+        Mat gray_feature;
+        Mat rgb_buffer;
+        std::vector<Mat> rgb;
+
+        // Segmentation
+        Mat segmentation_image;
+        std::vector<Mat> histogram_channels;
+        Histogram frame_foreground;
+        Histogram frame_background;
+        Mat segmentation_patch;
+        std::vector<Mat> segmentation_channels;
+        Mat prior_weights;
+        Mat fg_prior;
+        Mat bg_prior;
+        SegmentWorkspace segment;
+        std::pair<Mat, Mat> posteriors;
+        Mat segment_mask;
+        Mat filter_mask;
+    };
+
     class TrackerCSRTImpl final : public TrackerCSRT
     {
     public:
@@ -40,19 +97,36 @@ namespace sky360lib::tracking
         virtual bool update(InputArray image, Rect &boundingBox) CV_OVERRIDE;
         virtual void setInitialMask(InputArray mask) CV_OVERRIDE;
 
+        virtual Rect prepareInit(const Size &frameSize, const Rect &boundingBox) CV_OVERRIDE;
+        virtual void init(const FeatureCache &cache) CV_OVERRIDE;
+        virtual Rect getWorkRegion(const Size &frameSize) const CV_OVERRIDE;
+        virtual float getFeatureCellSize() const CV_OVERRIDE;
+        virtual bool update(const FeatureCache &cache, Rect &boundingBox) CV_OVERRIDE;
+        virtual float getUpdateCost() const CV_OVERRIDE;
+
     protected:
         void update_csr_filter(const Mat &image, const Mat &my_mask);
         void update_histograms(const Mat &image, const Rect &region);
         void extract_histograms(const Mat &image, cv::Rect region, Histogram &hf, Histogram &hb);
-        std::vector<Mat> create_csr_filter(const std::vector<cv::Mat>
-                                               img_features,
-                                           const cv::Mat Y, const cv::Mat P);
-        Mat calculate_response(const Mat &image, const std::vector<Mat> filter);
-        Mat get_location_prior(const Rect& roi, const Size2f& target_size, const Size& img_sz);
+        void create_csr_filter(const std::vector<cv::Mat> &img_features,
+                               const cv::Mat &Y, const cv::Mat &P, std::vector<Mat> &result_filter);
+        void calculate_channel_weights(const std::vector<Mat> &Fftrs, const std::vector<Mat> &filter,
+                                       std::vector<float> &weights);
+        const Mat &calculate_response(const Mat &image, const std::vector<Mat> &filter);
+        void get_location_prior(const Rect& roi, const Size2f& target_size, const Size& img_sz, Mat &fg_prior);
         void segment_region(const Mat &image, const Point2f &object_center,
-                           const Size2f &template_size, const Size &target_size, float scale_factor, Mat &filter_mask);
+                           const Size2f &template_size, const Size &target_size, float scale_factor, Mat &mask);
         Point2f estimate_new_position(const Mat &image);
-        std::vector<Mat> get_features(const Mat &patch, const Size2i &feature_size);
+        Point2f estimate_wide_position(const Mat &image);
+        Rect get_work_region(const Size &frame_size, float max_shift, float max_scale_step) const;
+        void reset_motion_model();
+        bool predict_center(const Size &frame_size, Point2f &predicted) const;
+        Mat get_work_image(const Mat &frame, const Rect &work_region) const;
+        void get_features(const Mat &patch, const Size2i &feature_size, std::vector<Mat> &features);
+        void get_patch_features(const Mat &image, std::vector<Mat> &features);
+        void init_region(const Mat &image, const Mat &hsv_image, const Rect &work_region);
+        bool update_region(const Mat &image, const Mat &hsv_image, const Rect &work_region,
+                           const Size &frame_size, Rect &boundingBox);
 
         bool check_mask_area(const Mat &mat, const double obj_area);
         float current_scale_factor;
@@ -77,10 +151,28 @@ namespace sky360lib::tracking
         Mat default_mask;
         float default_mask_area;
         int cell_size;
+        // Single channel frames only have HOG and grey features
+        bool mono_image;
+        // Peak of the last response and its running average
+        float peak_value;
+        float peak_average;
+        // Constant velocity model of the target centre in frame coordinates and the positions it has been corrected with
+        KalmanFilter motion_filter;
+        int motion_updates;
+        // Rings of windows searched around the last centre when there is no confident prediction and the target is not
+        // in the window at the centre, so a template with the motion padding covers the area of one with the full padding
+        int search_rings;
+        // Set while init/update run through a feature cache
+        const FeatureCache *feature_cache;
+        // Origin of the work region, the tracker runs in its coordinates
+        Point2f work_offset;
+        Rect init_work_region;
+        // Fourier domain buffers, their sizes are fixed at init so the updates reuse them
+        CSRWorkspace workspace;
     };
 
     TrackerCSRTImpl::TrackerCSRTImpl(const TrackerCSRT::Params &parameters) 
-        : params(parameters)
+        : params(parameters), mono_image(false), motion_updates(0), search_rings(0), feature_cache(nullptr)
     {
     }
 
@@ -100,71 +192,68 @@ namespace sky360lib::tracking
         return true;
     }
 
-    Mat TrackerCSRTImpl::calculate_response(const Mat &image, const std::vector<Mat> filter)
+    const Mat &TrackerCSRTImpl::calculate_response(const Mat &image, const std::vector<Mat> &filter)
     {
-        Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-                                  cvFloor(current_scale_factor * template_size.height));
-        resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
-
-        std::vector<Mat> ftrs = get_features(patch, yf.size());
-        std::vector<Mat> Ffeatures = fourier_transform_features(ftrs);
-        Mat resp, res;
-        if (params.use_channel_weights)
+        get_patch_features(image, workspace.features);
+        fourier_transform_features(workspace.features, workspace.feature_spectra);
+        const std::vector<Mat> &Ffeatures = workspace.feature_spectra;
+        Mat &res = workspace.response_spectrum;
+        Mat &resp_ch = workspace.channel_spectrum;
+        res.create(Ffeatures[0].size(), CV_32FC2);
+        res.setTo(Scalar::all(0));
+        for (size_t i = 0; i < Ffeatures.size(); ++i)
         {
-            res = Mat::zeros(Ffeatures[0].size(), CV_32FC2);
-            Mat resp_ch;
-            Mat mul_mat;
-            for (size_t i = 0; i < Ffeatures.size(); ++i)
+            mulSpectrums(Ffeatures[i], filter[i], resp_ch, 0, true);
+            if (params.use_channel_weights)
             {
-                mulSpectrums(Ffeatures[i], filter[i], resp_ch, 0, true);
-                res += (resp_ch * filter_weights[i]);
+                scaleAdd(resp_ch, filter_weights[i], res, res);
             }
-            idft(res, res, DFT_SCALE | DFT_REAL_OUTPUT);
-        }
-        else
-        {
-            res = Mat::zeros(Ffeatures[0].size(), CV_32FC2);
-            Mat resp_ch;
-            for (size_t i = 0; i < Ffeatures.size(); ++i)
+            else
             {
-                mulSpectrums(Ffeatures[i], filter[i], resp_ch, 0, true);
-                res = res + resp_ch;
+                add(res, resp_ch, res);
             }
-            idft(res, res, DFT_SCALE | DFT_REAL_OUTPUT);
         }
-        return res;
+        idft(res, workspace.response, DFT_SCALE | DFT_REAL_OUTPUT);
+        return workspace.response;
     }
 
-    void TrackerCSRTImpl::update_csr_filter(const Mat &image, const Mat &mask)
+    // Weight of each channel: the peak of its response, normalised to sum 1
+    void TrackerCSRTImpl::calculate_channel_weights(const std::vector<Mat> &Fftrs, const std::vector<Mat> &filter,
+                                                    std::vector<float> &weights)
     {
-        Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-                                  cvFloor(current_scale_factor * template_size.height));
-        resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
+        weights.resize(filter.size());
+        float sum_weights = 0;
+        for (size_t i = 0; i < filter.size(); ++i)
+        {
+            mulSpectrums(Fftrs[i], filter[i], workspace.channel_spectrum, 0, true);
+            idft(workspace.channel_spectrum, workspace.response, DFT_SCALE | DFT_REAL_OUTPUT);
+            double max_val;
+            minMaxLoc(workspace.response, NULL, &max_val, NULL, NULL);
+            sum_weights += static_cast<float>(max_val);
+            weights[i] = static_cast<float>(max_val);
+        }
+        for (size_t i = 0; i < weights.size(); ++i)
+        {
+            weights[i] /= sum_weights;
+        }
+    }
 
-        std::vector<Mat> ftrs = get_features(patch, yf.size());
-        std::vector<Mat> Fftrs = fourier_transform_features(ftrs);
-        std::vector<Mat> new_csr_filter = create_csr_filter(Fftrs, yf, mask);
+    void TrackerCSRTImpl::update_csr_filter(const Mat &image, const Mat &mask)
+    {
+        get_patch_features(image, workspace.features);
+        fourier_transform_features(workspace.features, workspace.feature_spectra);
+        create_csr_filter(workspace.feature_spectra, yf, mask, workspace.new_filter);
+        const std::vector<Mat> &new_csr_filter = workspace.new_filter;
         // calculate per channel weights
         if (params.use_channel_weights)
         {
-            Mat current_resp;
-            double max_val;
-            float sum_weights = 0;
-            std::vector<float> new_filter_weights = std::vector<float>(new_csr_filter.size());
-            for (size_t i = 0; i < new_csr_filter.size(); ++i)
-            {
-                mulSpectrums(Fftrs[i], new_csr_filter[i], current_resp, 0, true);
-                idft(current_resp, current_resp, DFT_SCALE | DFT_REAL_OUTPUT);
-                minMaxLoc(current_resp, NULL, &max_val, NULL, NULL);
-                sum_weights += static_cast<float>(max_val);
-                new_filter_weights[i] = static_cast<float>(max_val);
-            }
+            calculate_channel_weights(workspace.feature_spectra, new_csr_filter, workspace.new_filter_weights);
             // update filter weights with new values
             float updated_sum = 0;
             for (size_t i = 0; i < filter_weights.size(); ++i)
             {
                 filter_weights[i] = filter_weights[i] * (1.0f - params.weights_lr) +
-                                    params.weights_lr * (new_filter_weights[i] / sum_weights);
+                                    params.weights_lr * workspace.new_filter_weights[i];
                 updated_sum += filter_weights[i];
             }
             // normalize weights
@@ -175,61 +264,81 @@ namespace sky360lib::tracking
         }
         for (size_t i = 0; i < csr_filter.size(); ++i)
         {
-            csr_filter[i] = (1.0f - params.filter_lr) * csr_filter[i] + params.filter_lr * new_csr_filter[i];
+            addWeighted(csr_filter[i], 1.0f - params.filter_lr, new_csr_filter[i], params.filter_lr, 0.0, csr_filter[i]);
         }
-        std::vector<Mat>().swap(ftrs);
-        std::vector<Mat>().swap(Fftrs);
     }
 
-    std::vector<Mat> TrackerCSRTImpl::get_features(const Mat &patch, const Size2i &feature_size)
+    // The features are views of the buffers of the workspace, features keeps its capacity from frame to frame
+    void TrackerCSRTImpl::get_features(const Mat &patch, const Size2i &feature_size, std::vector<Mat> &features)
     {
-        std::vector<Mat> features;
+        features.clear();
         if (params.use_hog)
         {
-            std::vector<Mat> hog = get_features_hog(patch, cell_size);
-            features.insert(features.end(), hog.begin(),
-                            hog.begin() + params.num_hog_channels_used);
+            get_features_hog(patch, cell_size, workspace.hog_buffer, workspace.hog);
+            features.insert(features.end(), workspace.hog.begin(),
+                            workspace.hog.begin() + params.num_hog_channels_used);
         }
-        if (params.use_color_names)
+        // Color Names and RGB need colour (Color Names 8 bit colour), single channel patches only have HOG and grey
+        if (params.use_color_names && patch.type() == CV_8UC3)
         {
-            std::vector<Mat> cn;
-            cn = get_features_cn(patch, feature_size);
-            features.insert(features.end(), cn.begin(), cn.end());
+            get_features_cn(patch, feature_size, workspace.cn_buffer, workspace.cn);
+            features.insert(features.end(), workspace.cn.begin(), workspace.cn.end());
         }
         if (params.use_gray)
         {
-            Mat gray_m;
-            cvtColor(patch, gray_m, COLOR_BGR2GRAY);
-            resize(gray_m, gray_m, feature_size, 0, 0, INTER_CUBIC);
-            gray_m.convertTo(gray_m, CV_32FC1, 1.0 / 255.0, -0.5);
-            features.push_back(gray_m);
+            if (patch.channels() == 1)
+            {
+                resize(patch, workspace.gray, feature_size, 0, 0, INTER_CUBIC);
+            }
+            else
+            {
+                cvtColor(patch, workspace.gray_patch, COLOR_BGR2GRAY);
+                resize(workspace.gray_patch, workspace.gray, feature_size, 0, 0, INTER_CUBIC);
+            }
+            workspace.gray.convertTo(workspace.gray_feature, CV_32FC1, 1.0 / pixel_range(patch.depth()), -0.5);
+            features.push_back(workspace.gray_feature);
+        }
+        if (params.use_rgb && patch.channels() == 3)
+        {
+            get_features_rgb(patch, feature_size, workspace.rgb_buffer, workspace.rgb);
+            features.insert(features.end(), workspace.rgb.begin(), workspace.rgb.end());
         }
-        if (params.use_rgb)
+    }
+
+    // Features of the template window around object_center, from the feature cache when updating through it
+    void TrackerCSRTImpl::get_patch_features(const Mat &image, std::vector<Mat> &features)
+    {
+        const Size window_size(cvFloor(current_scale_factor * template_size.width),
+                               cvFloor(current_scale_factor * template_size.height));
+        if (feature_cache != nullptr)
         {
-            std::vector<Mat> rgb_features = get_features_rgb(patch, feature_size);
-            features.insert(features.end(), rgb_features.begin(), rgb_features.end());
+            feature_cache->sampleFeatures(object_center + work_offset, window_size, yf.size(), getFeatureCellSize(), features);
+        }
+        else
+        {
+            get_subwindow(image, object_center, window_size.width, window_size.height, workspace.patch);
+            resize(workspace.patch, workspace.template_patch, rescaled_template_size, 0, 0, INTER_CUBIC);
+            get_features(workspace.template_patch, yf.size(), features);
         }
 
         for (size_t i = 0; i < features.size(); ++i)
         {
-            features.at(i) = features.at(i).mul(window);
+            multiply(features[i], window, features[i]);
         }
-        return features;
     }
 
     class ParallelCreateCSRFilter : public ParallelLoopBody
     {
     public:
         ParallelCreateCSRFilter(
-            const std::vector<cv::Mat> img_features,
-            const cv::Mat Y,
-            const cv::Mat P,
+            const std::vector<cv::Mat> &img_features,
+            const cv::Mat &Y,
+            const cv::Mat &P,
             int admm_iterations,
-            std::vector<Mat> &result_filter_) : result_filter(result_filter_)
+            std::vector<ADMMWorkspace> &workspaces_,
+            std::vector<Mat> &result_filter_)
+            : img_features(img_features), Y(Y), P(P), workspaces(workspaces_), result_filter(result_filter_)
         {
-            this->img_features = img_features;
-            this->Y = Y;
-            this->P = P;
             this->admm_iterations = admm_iterations;
         }
         virtual void operator()(const Range &range) const CV_OVERRIDE
@@ -241,32 +350,39 @@ namespace sky360lib::tracking
                 float mu_max = 20.0f;
                 float lambda = mu / 100.0f;
 
-                Mat F = img_features[i];
+                const Mat &F = img_features[i];
+                // every channel has its own buffers, they only allocate the first time
+                ADMMWorkspace &ws = workspaces[i];
 
-                Mat Sxy, Sxx;
-                mulSpectrums(F, Y, Sxy, 0, true);
-                mulSpectrums(F, F, Sxx, 0, true);
+                mulSpectrums(F, Y, ws.Sxy, 0, true);
+                mulSpectrums(F, F, ws.Sxx, 0, true);
 
-                Mat H;
-                H = divide_complex_matrices(Sxy, (Sxx + lambda));
-                idft(H, H, DFT_SCALE | DFT_REAL_OUTPUT);
-                H = H.mul(P);
-                dft(H, H, DFT_COMPLEX_OUTPUT);
-                Mat L = Mat::zeros(H.size(), H.type()); // Lagrangian multiplier
-                Mat G;
+                divide_complex_matrices(ws.Sxy, ws.Sxx, lambda, ws.H);
+                idft(ws.H, ws.h, DFT_SCALE | DFT_REAL_OUTPUT);
+                multiply(ws.h, P, ws.h);
+                dft(ws.h, ws.H, DFT_COMPLEX_OUTPUT);
+                // Lagrangian multiplier
+                ws.L.create(ws.H.size(), ws.H.type());
+                ws.L.setTo(Scalar::all(0));
                 for (int iteration = 0; iteration < admm_iterations; ++iteration)
                 {
-                    G = divide_complex_matrices((Sxy + (mu * H) - L), (Sxx + mu));
-                    idft((mu * G) + L, H, DFT_SCALE | DFT_REAL_OUTPUT);
+                    // G = (Sxy + mu * H - L) / (Sxx + mu)
+                    scaleAdd(ws.H, mu, ws.Sxy, ws.T);
+                    subtract(ws.T, ws.L, ws.T);
+                    divide_complex_matrices(ws.T, ws.Sxx, mu, ws.G);
+                    // H = P * idft(mu * G + L) / (lambda + mu)
+                    scaleAdd(ws.G, mu, ws.L, ws.T);
+                    idft(ws.T, ws.h, DFT_SCALE | DFT_REAL_OUTPUT);
                     float lm = 1.0f / (lambda + mu);
-                    H = H.mul(P * lm);
-                    dft(H, H, DFT_COMPLEX_OUTPUT);
+                    multiply(ws.h, P, ws.h, lm);
+                    dft(ws.h, ws.H, DFT_COMPLEX_OUTPUT);
 
-                    // Update variables for next iteration
-                    L = L + mu * (G - H);
+                    // Update variables for next iteration, L += mu * (G - H)
+                    subtract(ws.G, ws.H, ws.T);
+                    scaleAdd(ws.T, mu, ws.L, ws.L);
                     mu = min(mu_max, beta * mu);
                 }
-                result_filter[i] = H;
+                ws.H.copyTo(result_filter[i]);
             }
         }
 
@@ -277,44 +393,46 @@ namespace sky360lib::tracking
 
     private:
         int admm_iterations;
-        Mat Y;
-        Mat P;
-        std::vector<Mat> img_features;
+        const std::vector<Mat> &img_features;
+        const Mat &Y;
+        const Mat &P;
+        std::vector<ADMMWorkspace> &workspaces;
         std::vector<Mat> &result_filter;
     };
 
-    std::vector<Mat> TrackerCSRTImpl::create_csr_filter(
-        const std::vector<cv::Mat> img_features,
-        const cv::Mat Y,
-        const cv::Mat P)
+    void TrackerCSRTImpl::create_csr_filter(
+        const std::vector<cv::Mat> &img_features,
+        const cv::Mat &Y,
+        const cv::Mat &P,
+        std::vector<Mat> &result_filter)
     {
-        std::vector<Mat> result_filter;
         result_filter.resize(img_features.size());
+        workspace.admm.resize(img_features.size());
         ParallelCreateCSRFilter parallelCreateCSRFilter(img_features, Y, P,
-                                                        params.admm_iterations, result_filter);
+                                                        params.admm_iterations, workspace.admm, result_filter);
         parallel_for_(Range(0, static_cast<int>(result_filter.size())), parallelCreateCSRFilter);
-
-        return result_filter;
     }
 
+    // The prior is single precision like the rest of the segmentation
     inline void fgPrior(const Mat& input, Mat& output, const double max_val, const double minTruc, const double maxTrunc)
     {
         double *dataInPtr = (double*)input.data;
-        double *dataOutPtr = (double*)output.data;
+        float *dataOutPtr = (float*)output.data;
         const size_t numData = input.size().area();
         for (size_t i = 0; i < numData; ++i)
         {
             const double dataTmp = *dataInPtr / max_val;
-            *dataOutPtr = dataTmp < minTruc ? minTruc : (dataTmp > maxTrunc ? maxTrunc : dataTmp);
+            *dataOutPtr = static_cast<float>(dataTmp < minTruc ? minTruc : (dataTmp > maxTrunc ? maxTrunc : dataTmp));
             ++dataInPtr;
             ++dataOutPtr;
         }
     }
 
-    Mat TrackerCSRTImpl::get_location_prior(
+    void TrackerCSRTImpl::get_location_prior(
         const Rect& roi,
         const Size2f& target_size,
-        const Size& img_sz)
+        const Size& img_sz,
+        Mat &fg_prior)
     {
         const int x1 = cvRound(max(min(roi.x - 1, img_sz.width - 1), 0));
         const int y1 = cvRound(max(min(roi.y - 1, img_sz.height - 1), 0));
@@ -330,7 +448,9 @@ namespace sky360lib::tracking
         const double kernel_size_width = 1.0 / (0.5 * static_cast<double>(target_sz.width) * 1.4142 + 1);
         const double kernel_size_height = 1.0 / (0.5 * static_cast<double>(target_sz.height) * 1.4142 + 1);
 
-        cv::Mat kernel_weight{Mat::zeros(1 + cvFloor(y2 - y1), 1 + cvFloor(-(x1 - cx) + (x2 - cx)), CV_64FC1)};
+        cv::Mat &kernel_weight = workspace.prior_weights;
+        kernel_weight.create(1 + cvFloor(y2 - y1), 1 + cvFloor(-(x1 - cx) + (x2 - cx)), CV_64FC1);
+        kernel_weight.setTo(Scalar::all(0));
         double tmp_y = (cy - y1) * (cy - y1) * kernel_size_height * kernel_size_height;
         const double tmp_y_inc = (-2*cy + 2*y1 + 1) * kernel_size_height * kernel_size_height;
         const double tmp_x_init = (cx - x1) * (cx - x1) * kernel_size_width * kernel_size_width;
@@ -353,12 +473,11 @@ namespace sky360lib::tracking
             tmp_y += tmp_y_inc;
         }
 
-        Mat fg_prior{kernel_weight.size(), CV_64FC1};
+        fg_prior.create(kernel_weight.size(), CV_32FC1);
         fgPrior(kernel_weight, fg_prior, max_val, 0.5, 0.9);
         // Mat fg_prior = kernel_weight / max_val;
         // fg_prior.setTo(0.5, fg_prior < 0.5);
         // fg_prior.setTo(0.9, fg_prior > 0.9);
-        return fg_prior;
     }
 
     void TrackerCSRTImpl::segment_region(
@@ -367,27 +486,30 @@ namespace sky360lib::tracking
         const Size2f &template_size,
         const Size &target_size,
         float scale_factor,
-        Mat &filter_mask)
+        Mat &mask)
     {
         Rect valid_pixels;
-        Mat patch = get_subwindow(image, object_center, cvFloor(scale_factor * template_size.width),
-                                  cvFloor(scale_factor * template_size.height), &valid_pixels);
+        Mat &patch = workspace.segmentation_patch;
+        get_subwindow(image, object_center, cvFloor(scale_factor * template_size.width),
+                      cvFloor(scale_factor * template_size.height), patch, &valid_pixels);
         Size2f scaled_target = Size2f(target_size.width * scale_factor,
                                       target_size.height * scale_factor);
-        Mat fg_prior = get_location_prior(
-            Rect(0, 0, patch.size().width, patch.size().height),
-            scaled_target, patch.size());
-
-        std::vector<Mat> img_channels;
-        split(patch, img_channels);
-        std::pair<Mat, Mat> probs = Segment::computePosteriors2(img_channels, 0, 0, patch.cols, patch.rows,
-                                                                p_b, fg_prior, 1.0 - fg_prior, hist_foreground, hist_background);
-
-        Mat mask = Mat::zeros(probs.first.size(), probs.first.type());
+        get_location_prior(Rect(0, 0, patch.size().width, patch.size().height),
+                           scaled_target, patch.size(), workspace.fg_prior);
+        subtract(Scalar::all(1.0), workspace.fg_prior, workspace.bg_prior);
+
+        split(patch, workspace.segmentation_channels);
+        std::pair<Mat, Mat> &probs = workspace.posteriors;
+        Segment::computePosteriors2(workspace.segmentation_channels, 0, 0, patch.cols, patch.rows, p_b,
+                                    workspace.fg_prior, workspace.bg_prior, hist_foreground, hist_background,
+                                    workspace.segment, probs);
+
+        // the posteriors are single precision, the mask is thresholded in place
+        mask.create(probs.first.size(), CV_32FC1);
+        mask.setTo(Scalar::all(0));
         probs.first(valid_pixels).copyTo(mask(valid_pixels));
         double max_resp = get_max(mask);
         threshold(mask, mask, max_resp / 2.0, 1, THRESH_BINARY);
-        mask.convertTo(filter_mask, CV_32FC1, 1.0);
     }
 
     void TrackerCSRTImpl::extract_histograms(const Mat &image, cv::Rect region, Histogram &hf, Histogram &hb)
@@ -410,58 +532,73 @@ namespace sky360lib::tracking
         p_b = 1.0 - ((x2 - x1 + 1) * (y2 - y1 + 1)) /
                         ((double)(outer_x2 - outer_x1 + 1) * (outer_y2 - outer_y1 + 1));
 
-        // split multi-channel image into the std::vector of matrices
-        std::vector<Mat> img_channels(image.channels());
+        // split multi-channel image into the std::vector of matrices, the segmentation image is 8 bit
+        std::vector<Mat> &img_channels = workspace.histogram_channels;
         split(image, img_channels);
-        for (size_t k = 0; k < img_channels.size(); k++)
-        {
-            img_channels.at(k).convertTo(img_channels.at(k), CV_8UC1);
-        }
 
         hf.extractForegroundHistogram(img_channels, Mat(), false, x1, y1, x2, y2);
         hb.extractBackGroundHistogram(img_channels, x1, y1, x2, y2,
                                       outer_x1, outer_y1, outer_x2, outer_y2);
-        std::vector<Mat>().swap(img_channels);
     }
 
     void TrackerCSRTImpl::update_histograms(const Mat &image, const Rect &region)
     {
-        // create temporary histograms
-        Histogram hf(image.channels(), params.histogram_bins);
-        Histogram hb(image.channels(), params.histogram_bins);
+        // histograms of this frame, kept in the workspace
+        Histogram &hf = workspace.frame_foreground;
+        Histogram &hb = workspace.frame_background;
+        hf.clear();
+        hb.clear();
         extract_histograms(image, region, hf, hb);
 
-        // get histogram vectors from temporary histograms
-        std::vector<double> hf_vect_new = hf.getHistogramVector();
-        std::vector<double> hb_vect_new = hb.getHistogramVector();
-        // get histogram vectors from learned histograms
-        std::vector<double> hf_vect = hist_foreground.getHistogramVector();
-        std::vector<double> hb_vect = hist_background.getHistogramVector();
-
         // update histograms - use learning rate
-        for (size_t i = 0; i < hf_vect.size(); i++)
+        hist_foreground.update(hf, params.histogram_lr);
+        hist_background.update(hb, params.histogram_lr);
+    }
+
+    // Searches the window around object_center, and only when the target is not found there the rings of windows
+    // around it, half a template apart. The highest peak above the threshold wins
+    Point2f TrackerCSRTImpl::estimate_wide_position(const Mat &image)
+    {
+        Point2f best_center = estimate_new_position(image);
+        if (!(best_center.x < 0 && best_center.y < 0))
         {
-            hf_vect_new[i] = (1 - params.histogram_lr) * hf_vect[i] +
-                             params.histogram_lr * hf_vect_new[i];
-            hb_vect_new[i] = (1 - params.histogram_lr) * hb_vect[i] +
-                             params.histogram_lr * hb_vect_new[i];
+            return best_center;
         }
-
-        // set learned histograms
-        hist_foreground.setHistogramVector(&hf_vect_new[0]);
-        hist_background.setHistogramVector(&hb_vect_new[0]);
-
-        std::vector<double>().swap(hf_vect);
-        std::vector<double>().swap(hb_vect);
+        const Point2f last_center = object_center;
+        const float center_peak = peak_value;
+        float best_peak = -1.0f;
+        const float step = current_scale_factor * template_size.width / 2.0f;
+        for (int dy = -search_rings; dy <= search_rings; ++dy)
+        {
+            for (int dx = -search_rings; dx <= search_rings; ++dx)
+            {
+                if (dx == 0 && dy == 0)
+                {
+                    continue;
+                }
+                object_center.x = std::clamp(last_center.x + dx * step, 0.0f, static_cast<float>(image_size.width - 1));
+                object_center.y = std::clamp(last_center.y + dy * step, 0.0f, static_cast<float>(image_size.height - 1));
+                const Point2f center = estimate_new_position(image);
+                if (!(center.x < 0 && center.y < 0) && peak_value > best_peak)
+                {
+                    best_peak = peak_value;
+                    best_center = center;
+                }
+            }
+        }
+        object_center = last_center;
+        peak_value = best_peak >= 0.0f ? best_peak : center_peak;
+        return best_center;
     }
 
     Point2f TrackerCSRTImpl::estimate_new_position(const Mat &image)
     {
-        Mat resp = calculate_response(image, csr_filter);
+        const Mat &resp = calculate_response(image, csr_filter);
 
         double max_val;
         Point max_loc;
         minMaxLoc(resp, NULL, &max_val, NULL, &max_loc);
+        peak_value = static_cast<float>(max_val);
         if (max_val < params.psr_threshold)
             return Point2f(-1, -1); // target "lost"
 
@@ -492,20 +629,175 @@ namespace sky360lib::tracking
         return new_center;
     }
 
+    // Part of the frame read by init/update: every window is centred at most max_shift away from object_center
+    // and can grow by the largest scale step of the DSST. Everything runs inside this region, so the cost follows
+    // the target size and not the frame size
+    Rect TrackerCSRTImpl::get_work_region(const Size &frame_size, float max_shift, float max_scale_step) const
+    {
+        const float max_scale = current_scale_factor * max_scale_step;
+        // Histogram regions add 1 / background_ratio of the target on each side
+        const float histogram_ratio = 1.0f + 2.0f / static_cast<float>(std::max(params.background_ratio, 1));
+        const float window_width = max_scale * std::max({template_size.width,
+                                                         max_scale_step * original_target_size.width,
+                                                         histogram_ratio * original_target_size.width});
+        const float window_height = max_scale * std::max({template_size.height,
+                                                          max_scale_step * original_target_size.height,
+                                                          histogram_ratio * original_target_size.height});
+        // Rounding of the windows and the sub-pixel peak
+        const float margin = 2.0f + max_scale * cell_size / rescale_ratio;
+
+        // From floor(center - half) to at least ceil(center + half), with a size that does not depend on where the
+        // centre falls between two pixels, so inside the frame the images and maps of the region keep their size
+        const float half_width = max_shift + window_width / 2.0f + margin;
+        const float half_height = max_shift + window_height / 2.0f + margin;
+        const int x1 = cvFloor(object_center.x - half_width);
+        const int y1 = cvFloor(object_center.y - half_height);
+        return Rect(x1, y1, cvCeil(2.0f * half_width) + 2, cvCeil(2.0f * half_height) + 2) & Rect(Point(0, 0), frame_size);
+    }
+
+    // State (x, y, vx, vy) starting at the current centre with an unknown velocity up to the search radius,
+    // the measurements are as precise as a feature cell
+    void TrackerCSRTImpl::reset_motion_model()
+    {
+        const float target_side = current_scale_factor * std::sqrt(original_target_size.area());
+        const float search_radius = current_scale_factor * template_size.width / 2.0f;
+        const float cell_pixels = std::max(current_scale_factor * cell_size / rescale_ratio, 1.0f);
+        const float velocity_noise = params.motion_noise * target_side;
+
+        motion_filter.init(4, 2, 0, CV_32F);
+        setIdentity(motion_filter.transitionMatrix);
+        motion_filter.transitionMatrix.at<float>(0, 2) = 1.0f;
+        motion_filter.transitionMatrix.at<float>(1, 3) = 1.0f;
+        setIdentity(motion_filter.measurementMatrix);
+        motion_filter.processNoiseCov = Mat::diag(Mat(Matx41f(0.0f, 0.0f, velocity_noise * velocity_noise,
+                                                              velocity_noise * velocity_noise)));
+        setIdentity(motion_filter.measurementNoiseCov, Scalar::all(cell_pixels * cell_pixels));
+        motion_filter.errorCovPost = Mat::diag(Mat(Matx41f(cell_pixels * cell_pixels, cell_pixels * cell_pixels,
+                                                           search_radius * search_radius, search_radius * search_radius)));
+        motion_filter.statePost = (Mat_<float>(4, 1) << object_center.x, object_center.y, 0.0f, 0.0f);
+        motion_updates = 0;
+    }
+
+    // Centre of the target on the next frame, true when the prediction is precise enough to search around it.
+    // Same prediction as KalmanFilter::predict without changing the filter, so getWorkRegion can use it
+    bool TrackerCSRTImpl::predict_center(const Size &frame_size, Point2f &predicted) const
+    {
+        if (!params.use_motion_model || motion_updates < 2)
+        {
+            return false;
+        }
+        // Fixed size copies on the stack
+        const Matx44f F = motion_filter.transitionMatrix;
+        const Matx41f state_post = motion_filter.statePost;
+        const Matx44f cov_post = motion_filter.errorCovPost;
+        const Matx44f process_noise = motion_filter.processNoiseCov;
+        const Matx41f state = F * state_post;
+        const Matx44f cov = F * cov_post * F.t() + process_noise;
+        predicted.x = std::clamp(state(0), 0.0f, static_cast<float>(frame_size.width - 1));
+        predicted.y = std::clamp(state(1), 0.0f, static_cast<float>(frame_size.height - 1));
+
+        const float uncertainty = std::sqrt(std::max(cov(0, 0), cov(1, 1)));
+        return uncertainty < params.motion_confidence * current_scale_factor * template_size.width / 2.0f;
+    }
+
+    // Windows clipped to the frame are extended by get_subwindow with BORDER_REPLICATE from their own copy,
+    // so working on the region gives the same patches as working on the whole frame
+    Mat TrackerCSRTImpl::get_work_image(const Mat &frame, const Rect &work_region) const
+    {
+        // Single channel and 16 bit frames are tracked as they are, without expanding them to 8 bit BGR
+        return frame(work_region);
+    }
+
     // *********************************************************************
     // *                        Update API function                        *
     // *********************************************************************
     bool TrackerCSRTImpl::update(InputArray image_, Rect &boundingBox)
     {
-        Mat image;
-        if (image_.channels() == 1) // treat gray image as color image
-            cvtColor(image_, image, COLOR_GRAY2BGR);
-        else
-            image = image_.getMat();
+        const Mat frame = image_.getMat();
+        const Rect work_region = getWorkRegion(frame.size());
+        feature_cache = nullptr;
+        return update_region(get_work_image(frame, work_region), Mat(), work_region, frame.size(), boundingBox);
+    }
+
+    bool TrackerCSRTImpl::update(const FeatureCache &cache, Rect &boundingBox)
+    {
+        const Rect work_region = getWorkRegion(cache.getFrameSize());
+        Mat image, hsv_img;
+        if (!cache.getImage(work_region, image) || (params.use_segmentation && !cache.getHsv(work_region, hsv_img)))
+        {
+            CV_Error(Error::StsBadArg, "The work region of the tracker is not in the feature cache");
+        }
+        feature_cache = &cache;
+        const bool tracking = update_region(image, hsv_img, work_region, cache.getFrameSize(), boundingBox);
+        feature_cache = nullptr;
+        return tracking;
+    }
+
+    Rect TrackerCSRTImpl::getWorkRegion(const Size &frameSize) const
+    {
+        // The peak of the response can move the target half a template away from where it is searched:
+        // the predicted centre, or the last one and the rings of windows around it
+        float max_shift = current_scale_factor * std::max(template_size.width, template_size.height) / 2.0f;
+        float search_shift = search_rings * current_scale_factor * template_size.width / 2.0f;
+        Point2f predicted;
+        if (predict_center(frameSize, predicted))
+        {
+            search_shift = std::max({search_shift, std::abs(predicted.x - object_center.x),
+                                     std::abs(predicted.y - object_center.y)});
+        }
+        max_shift += search_shift;
+        return get_work_region(frameSize, max_shift, dsst.getMaxScaleStep());
+    }
 
-        object_center = estimate_new_position(image);
-        if (object_center.x < 0 && object_center.y < 0)
+    float TrackerCSRTImpl::getFeatureCellSize() const
+    {
+        // Frame pixels covered by a cell of the features
+        return cell_size * cvFloor(current_scale_factor * template_size.width) / static_cast<float>(rescaled_template_size.width);
+    }
+
+    float TrackerCSRTImpl::getUpdateCost() const
+    {
+        // Features and filter on the template plus HOG on every scale sample
+        const float template_area = static_cast<float>(rescaled_template_size.area());
+        const float channels = static_cast<float>(params.num_hog_channels_used + (mono_image ? 1 : 10 + 1));
+        return template_area * (channels + params.admm_iterations) +
+               static_cast<float>(dsst.getScaleModelArea()) * static_cast<float>(params.number_of_scales);
+    }
+
+    bool TrackerCSRTImpl::update_region(const Mat &image, const Mat &hsv_image, const Rect &work_region,
+                                        const Size &frame_size, Rect &boundingBox)
+    {
+        Point2f predicted;
+        const bool use_prediction = predict_center(frame_size, predicted);
+
+        // Tracking in work region coordinates
+        work_offset = Point2f(static_cast<float>(work_region.x), static_cast<float>(work_region.y));
+        object_center -= work_offset;
+        image_size = work_region.size();
+
+        // Searching around the predicted centre first, around the last one when the target is not found there
+        // or the prediction is not confident. Around the last one the search covers a full padding template
+        Point2f new_center(-1, -1);
+        if (use_prediction)
+        {
+            const Point2f last_center = object_center;
+            object_center = predicted - work_offset;
+            new_center = estimate_new_position(image);
+            object_center = last_center;
+        }
+        if (new_center.x < 0 && new_center.y < 0)
+        {
+            new_center = search_rings > 0 ? estimate_wide_position(image) : estimate_new_position(image);
+        }
+        if (new_center.x < 0 && new_center.y < 0)
+        {
+            object_center += work_offset;
+            image_size = frame_size;
+            // The velocity is learnt again once the target is found
+            motion_updates = 0;
             return false;
+        }
+        object_center = new_center;
 
         current_scale_factor = dsst.getScale(image, object_center);
         // update bouding_box according to new scale and location
@@ -515,28 +807,57 @@ namespace sky360lib::tracking
         bounding_box.height = current_scale_factor * original_target_size.height;
 
         // update tracker
+        // filter_mask gets a copy of default_mask, sharing it would let the next segmentation overwrite it
         if (params.use_segmentation)
         {
-            Mat hsv_img = bgr2hsv(image);
+            const Mat &hsv_img = hsv_image.empty() ? get_segmentation_image(image, workspace.segmentation_image) : hsv_image;
             update_histograms(hsv_img, bounding_box);
-            segment_region(hsv_img, object_center, template_size, original_target_size, current_scale_factor, filter_mask);
-            resize(filter_mask, filter_mask, yf.size(), 0, 0, INTER_NEAREST);
-            if (check_mask_area(filter_mask, default_mask_area))
+            segment_region(hsv_img, object_center, template_size, original_target_size, current_scale_factor,
+                           workspace.segment_mask);
+            // the resized mask has its own buffer, so the dilation does not run in place
+            resize(workspace.segment_mask, workspace.filter_mask, yf.size(), 0, 0, INTER_NEAREST);
+            if (check_mask_area(workspace.filter_mask, default_mask_area))
             {
-                dilate(filter_mask, filter_mask, erode_element);
+                dilate(workspace.filter_mask, filter_mask, erode_element);
             }
             else
             {
-                filter_mask = default_mask;
+                default_mask.copyTo(filter_mask);
             }
         }
         else
         {
-            filter_mask = default_mask;
+            default_mask.copyTo(filter_mask);
         }
 
         update_csr_filter(image, filter_mask);
-        dsst.update(image, object_center);
+        // The scale model is refreshed early when the response peak drops below its running average
+        const bool peak_dropped = peak_value < params.scale_update_peak_ratio * peak_average;
+        peak_average = peak_average > 0.0f ? 0.9f * peak_average + 0.1f * peak_value : peak_value;
+        dsst.update(image, object_center, peak_dropped);
+
+        // Back to frame coordinates
+        object_center += work_offset;
+        bounding_box.x += work_offset.x;
+        bounding_box.y += work_offset.y;
+        image_size = frame_size;
+
+        if (params.use_motion_model)
+        {
+            if (motion_updates == 0)
+            {
+                reset_motion_model();
+            }
+            else
+            {
+                // the measurement is wrapped and not copied
+                Matx21f measurement(object_center.x, object_center.y);
+                motion_filter.predict();
+                motion_filter.correct(Mat(measurement, false));
+            }
+            ++motion_updates;
+        }
+
         boundingBox = bounding_box;
         return true;
     }
@@ -546,32 +867,61 @@ namespace sky360lib::tracking
     // *********************************************************************
     void TrackerCSRTImpl::init(InputArray image_, const Rect &boundingBox)
     {
-        Mat image;
-        if (image_.channels() == 1) // treat gray image as color image
-            cvtColor(image_, image, COLOR_GRAY2BGR);
-        else
-            image = image_.getMat();
+        const Mat frame = image_.getMat();
+        const Rect work_region = prepareInit(frame.size(), boundingBox);
+        feature_cache = nullptr;
+        init_region(get_work_image(frame, work_region), Mat(), work_region);
+    }
+
+    void TrackerCSRTImpl::init(const FeatureCache &cache)
+    {
+        Mat image, hsv_img;
+        if (!cache.getImage(init_work_region, image) || (params.use_segmentation && !cache.getHsv(init_work_region, hsv_img)))
+        {
+            CV_Error(Error::StsBadArg, "The work region of the tracker is not in the feature cache");
+        }
+        feature_cache = &cache;
+        init_region(image, hsv_img, init_work_region);
+        feature_cache = nullptr;
+    }
+
+    // Side of the square template around a target with this padding
+    static float padded_template_side(const Size2f &target_size, float padding)
+    {
+        const float context = padding * sqrt(target_size.width * target_size.height);
+        return (static_cast<float>(cvFloor(target_size.width + context)) +
+                static_cast<float>(cvFloor(target_size.height + context))) / 2.0f;
+    }
 
+    Rect TrackerCSRTImpl::prepareInit(const Size &frameSize, const Rect &boundingBox)
+    {
         current_scale_factor = 1.0;
-        image_size = image.size();
+        image_size = frameSize;
         bounding_box = boundingBox;
         cell_size = cvFloor(std::min(4.0, std::max(1.0, static_cast<double>(
                                                             cvCeil((bounding_box.width * bounding_box.height) / 400.0)))));
         original_target_size = Size(bounding_box.size());
 
-        template_size.width = static_cast<float>(cvFloor(original_target_size.width + params.padding *
-                                                                                          sqrt(original_target_size.width * original_target_size.height)));
-        template_size.height = static_cast<float>(cvFloor(original_target_size.height + params.padding *
-                                                                                            sqrt(original_target_size.width * original_target_size.height)));
-        template_size.width = template_size.height =
-            (template_size.width + template_size.height) / 2.0f;
+        // With the motion model the search follows the prediction, so a smaller padding is enough. Until the
+        // prediction is confident, and once the target is lost, rings of windows cover the full padding
+        const float padding = params.use_motion_model ? params.motion_padding : params.padding;
+        template_size.width = template_size.height = padded_template_side(original_target_size, padding);
+        search_rings = 0;
+        if (params.use_motion_model && params.motion_padding < params.padding)
+        {
+            const float full_side = padded_template_side(original_target_size, params.padding);
+            search_rings = cvCeil((full_side - template_size.width) / template_size.width);
+        }
         rescale_ratio = sqrt((params.template_size * params.template_size) / (template_size.width * template_size.height));
         if (rescale_ratio > 1)
         {
             rescale_ratio = 1;
         }
-        rescaled_template_size = Size2i(cvFloor(template_size.width * rescale_ratio),
-                                        cvFloor(template_size.height * rescale_ratio));
+        // The filters are learnt in the Fourier domain at the feature size, so the rescale ratio is nudged to
+        // give a feature size the DFT handles fast (a product of 2, 3 and 5). The template is square
+        const int feature_side = getOptimalDFTSize(std::max(cvFloor(template_size.width * rescale_ratio) / cell_size, 1));
+        rescaled_template_size = Size2i(feature_side * cell_size, feature_side * cell_size);
+        rescale_ratio = static_cast<float>(rescaled_template_size.width) / template_size.width;
         object_center = Point2f(static_cast<float>(boundingBox.x) + original_target_size.width / 2.0f,
                                 static_cast<float>(boundingBox.y) + original_target_size.height / 2.0f);
 
@@ -594,6 +944,25 @@ namespace sky360lib::tracking
             CV_Error(Error::StsBadArg, "Not a valid window function");
         }
 
+        // Only the region around the target is read, the DSST is not built yet so its largest scale step
+        // comes from the parameters, its pyramid covers that step twice
+        float max_scale_step = std::pow(params.scale_step, static_cast<float>(params.number_of_scales / 2));
+        if (params.use_scale_pyramid)
+        {
+            max_scale_step *= max_scale_step;
+        }
+        init_work_region = get_work_region(frameSize, 0.0f, max_scale_step);
+        return init_work_region;
+    }
+
+    void TrackerCSRTImpl::init_region(const Mat &image, const Mat &hsv_image, const Rect &work_region)
+    {
+        work_offset = Point2f(static_cast<float>(work_region.x), static_cast<float>(work_region.y));
+        mono_image = image.channels() == 1;
+        object_center -= work_offset;
+        bounding_box.x -= work_offset.x;
+        bounding_box.y -= work_offset.y;
+
         Size2i scaled_obj_size = Size2i(cvFloor(original_target_size.width * rescale_ratio / cell_size),
                                         cvFloor(original_target_size.height * rescale_ratio / cell_size));
         // set dummy mask and area;
@@ -606,9 +975,11 @@ namespace sky360lib::tracking
         // initalize segmentation
         if (params.use_segmentation)
         {
-            Mat hsv_img = bgr2hsv(image);
+            const Mat &hsv_img = hsv_image.empty() ? get_segmentation_image(image, workspace.segmentation_image) : hsv_image;
             hist_foreground = Histogram(hsv_img.channels(), params.histogram_bins);
             hist_background = Histogram(hsv_img.channels(), params.histogram_bins);
+            workspace.frame_foreground = Histogram(hsv_img.channels(), params.histogram_bins);
+            workspace.frame_background = Histogram(hsv_img.channels(), params.histogram_bins);
             extract_histograms(hsv_img, bounding_box, hist_foreground, hist_background);
             segment_region(hsv_img, object_center, template_size,
                            original_target_size, current_scale_factor, filter_mask);
@@ -630,45 +1001,42 @@ namespace sky360lib::tracking
             }
             else
             {
-                filter_mask = default_mask;
+                default_mask.copyTo(filter_mask);
             }
         }
         else
         {
-            filter_mask = default_mask;
+            default_mask.copyTo(filter_mask);
         }
 
-        // initialize filter
-        Mat patch = get_subwindow(image, object_center, cvFloor(current_scale_factor * template_size.width),
-                                  cvFloor(current_scale_factor * template_size.height));
-        resize(patch, patch, rescaled_template_size, 0, 0, INTER_CUBIC);
-        std::vector<Mat> patch_ftrs = get_features(patch, yf.size());
-        std::vector<Mat> Fftrs = fourier_transform_features(patch_ftrs);
-        csr_filter = create_csr_filter(Fftrs, yf, filter_mask);
+        // initialize filter, the filter keeps its own copy as the workspace is rewritten by every update
+        get_patch_features(image, workspace.features);
+        fourier_transform_features(workspace.features, workspace.feature_spectra);
+        create_csr_filter(workspace.feature_spectra, yf, filter_mask, workspace.new_filter);
+        csr_filter.resize(workspace.new_filter.size());
+        for (size_t i = 0; i < csr_filter.size(); ++i)
+        {
+            csr_filter[i] = workspace.new_filter[i].clone();
+        }
 
         if (params.use_channel_weights)
         {
-            Mat current_resp;
-            filter_weights = std::vector<float>(csr_filter.size());
-            float chw_sum = 0;
-            for (size_t i = 0; i < csr_filter.size(); ++i)
-            {
-                mulSpectrums(Fftrs[i], csr_filter[i], current_resp, 0, true);
-                idft(current_resp, current_resp, DFT_SCALE | DFT_REAL_OUTPUT);
-                double max_val;
-                minMaxLoc(current_resp, NULL, &max_val, NULL, NULL);
-                chw_sum += static_cast<float>(max_val);
-                filter_weights[i] = static_cast<float>(max_val);
-            }
-            for (size_t i = 0; i < filter_weights.size(); ++i)
-            {
-                filter_weights[i] /= chw_sum;
-            }
+            calculate_channel_weights(workspace.feature_spectra, csr_filter, filter_weights);
         }
 
         // initialize scale search
-        dsst = DSST(image, bounding_box, template_size, params.number_of_scales, params.scale_step,
-                    params.scale_model_max_area, params.scale_sigma_factor, params.scale_lr);
+        dsst = DSST(image, image_size, bounding_box, template_size, params.number_of_scales, params.scale_step,
+                    params.scale_model_max_area, params.scale_sigma_factor, params.scale_lr,
+                    params.use_scale_pyramid, params.scale_model_update_interval);
+        peak_value = 0.0f;
+        peak_average = 0.0f;
+
+        // Back to frame coordinates
+        object_center += work_offset;
+        bounding_box.x += work_offset.x;
+        bounding_box.y += work_offset.y;
+        reset_motion_model();
+        motion_updates = 1;
 
         model = makePtr<TrackerCSRTModel>();
     }
@@ -698,6 +1066,13 @@ namespace sky360lib::tracking
         scale_model_max_area = 512.0f;
         scale_lr = 0.025f;
         scale_step = 1.020f;
+        use_scale_pyramid = true;
+        scale_model_update_interval = 3;
+        scale_update_peak_ratio = 0.8f;
+        use_motion_model = false;
+        motion_padding = 1.5f;
+        motion_noise = 0.05f;
+        motion_confidence = 0.25f;
         histogram_bins = 16;
         background_ratio = 2;
         histogram_lr = 0.04f;
@@ -4,6 +4,8 @@
 
 namespace sky360lib::tracking
 {
+    class FeatureCache;
+
     /** @brief the CSRT tracker
 
     The implementation is based on @cite Lukezic_IJCV2018 Discriminative Correlation Filter with Channel and Spatial Reliability
@@ -19,6 +21,19 @@ namespace sky360lib::tracking
         virtual bool update(cv::InputArray image, cv::Rect &boundingBox) = 0;
         virtual void setInitialMask(cv::InputArray mask) = 0;
 
+        // Tracking through a FeatureCache shared with other trackers, see MultiTracker.
+        // prepareInit sets the target up and returns the region of the frame that init will read,
+        // getWorkRegion returns the region that the next update will read.
+        // Both regions have to be added to the cache before init/update
+        virtual cv::Rect prepareInit(const cv::Size &frameSize, const cv::Rect &boundingBox) = 0;
+        virtual void init(const FeatureCache &cache) = 0;
+        virtual cv::Rect getWorkRegion(const cv::Size &frameSize) const = 0;
+        // Size in frame pixels of the cells of the features of the next update
+        virtual float getFeatureCellSize() const = 0;
+        virtual bool update(const FeatureCache &cache, cv::Rect &boundingBox) = 0;
+        // Relative cost of the next update, grows with the template area and the scale samples
+        virtual float getUpdateCost() const = 0;
+
         struct Params
         {
             Params();
@@ -51,6 +66,13 @@ namespace sky360lib::tracking
             float scale_model_max_area;
             float scale_lr;
             float scale_step;
+            bool use_scale_pyramid; //!< sample the scales from a pyramid of one patch per frame
+            int scale_model_update_interval; //!< frames between updates of the scale model
+            float scale_update_peak_ratio; //!< update the scale model early when the peak drops below this ratio of its average
+            bool use_motion_model; //!< search around the position predicted by a constant velocity Kalman filter
+            float motion_padding; //!< padding of the template when the motion model is used, without a confident prediction the windows searched around the last position cover padding
+            float motion_noise; //!< change of the velocity between frames, relative to the target size
+            float motion_confidence; //!< search at the prediction when its uncertainty is below this ratio of the search radius
 
             float psr_threshold; //!< we lost the target, if the psr is lower than this.
         };
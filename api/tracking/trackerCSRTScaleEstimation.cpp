@@ -7,75 +7,20 @@
 namespace sky360lib::tracking
 {
 
-class ParallelGetScaleFeatures : public ParallelLoopBody
-{
-public:
-    ParallelGetScaleFeatures(
-        Mat img,
-        Point2f pos,
-        Size2f base_target_sz,
-        float current_scale,
-        std::vector<float> &scale_factors,
-        Mat scale_window,
-        Size scale_model_sz,
-        int col_len,
-        Mat &result)
-    {
-        this->img = img;
-        this->pos = pos;
-        this->base_target_sz = base_target_sz;
-        this->current_scale = current_scale;
-        this->scale_factors = scale_factors;
-        this->scale_window = scale_window;
-        this->scale_model_sz = scale_model_sz;
-        this->col_len = col_len;
-        this->result = result;
-    }
-    virtual void operator ()(const Range& range) const CV_OVERRIDE
-    {
-        for (int s = range.start; s < range.end; s++) {
-            Size patch_sz = Size(static_cast<int>(current_scale * scale_factors[s] * base_target_sz.width),
-                    static_cast<int>(current_scale * scale_factors[s] * base_target_sz.height));
-            Mat img_patch = get_subwindow(img, pos, patch_sz.width, patch_sz.height);
-            img_patch.convertTo(img_patch, CV_32FC3);
-            resize(img_patch, img_patch, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
-            std::vector<Mat> hog;
-            hog = get_features_hog(img_patch, 4);
-            for (int i = 0; i < static_cast<int>(hog.size()); ++i) {
-                hog[i] = hog[i].t();
-                hog[i] = scale_window.at<float>(0,s) * hog[i].reshape(0, col_len);
-                hog[i].copyTo(result(Rect(Point(s, i*col_len), hog[i].size())));
-            }
-        }
-    }
-
-    ParallelGetScaleFeatures& operator=(const ParallelGetScaleFeatures &) {
-        return *this;
-    }
-
-private:
-    Mat img;
-    Point2f pos;
-    Size2f base_target_sz;
-    float current_scale;
-    std::vector<float> scale_factors;
-    Mat scale_window;
-    Size scale_model_sz;
-    int col_len;
-    Mat result;
-};
-
-
 DSST::DSST(const Mat &image,
+        Size imageSize,
         Rect2f bounding_box,
         Size2f template_size,
         int numberOfScales,
         float scaleStep,
         float maxModelArea,
         float sigmaFactor,
-        float scaleLearnRate):
+        float scaleLearnRate,
+        bool usePyramid,
+        int updateInterval):
     scales_count(numberOfScales), scale_step(scaleStep), max_model_area(maxModelArea),
-    sigma_factor(sigmaFactor), learn_rate(scaleLearnRate)
+    sigma_factor(sigmaFactor), learn_rate(scaleLearnRate), use_pyramid(usePyramid),
+    update_interval(std::max(updateInterval, 1)), frames_since_update(0)
 {
     original_targ_sz = bounding_box.size();
     Point2f object_center = Point2f(bounding_box.x + original_targ_sz.width / 2,
@@ -90,8 +35,8 @@ DSST::DSST(const Mat &image,
     min_scale_factor = static_cast<float>(pow(scale_step,
             cvCeil(log(max(5.0 / template_size.width, 5.0 / template_size.height)) / log(scale_step))));
     max_scale_factor = static_cast<float>(pow(scale_step,
-            cvFloor(log(min((float)image.rows / (float)bounding_box.width,
-            (float)image.cols / (float)bounding_box.height)) / log(scale_step))));
+            cvFloor(log(min((float)imageSize.height / (float)bounding_box.width,
+            (float)imageSize.width / (float)bounding_box.height)) / log(scale_step))));
     ys = Mat(1, scales_count, CV_32FC1);
     float ss, sf;
     for(int i = 0; i < ys.cols; ++i) {
@@ -112,8 +57,8 @@ DSST::DSST(const Mat &image,
     scale_model_sz = Size(cvFloor(template_size.width * scale_model_factor),
             cvFloor(template_size.height * scale_model_factor));
 
-    Mat scale_resp = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
+    scale_samples.resize(scale_factors.size());
+    const Mat &scale_resp = get_scale_features(image, object_center, current_scale_factor, false);
 
     Mat ysf_row = Mat(ys.size(), CV_32FC2);
     dft(ys, ysf_row, DFT_ROWS | DFT_COMPLEX_OUTPUT, 0);
@@ -130,71 +75,128 @@ DSST::~DSST()
 {
 }
 
-Mat DSST::get_scale_features(
-        Mat img,
-        Point2f pos,
-        Size2f base_target_sz,
-        float current_scale,
-        std::vector<float> &scale_factors,
-        Mat scale_window,
-        Size scale_model_sz)
+// One patch per frame that covers the largest scale of this frame and of the next scale estimate, so the update
+// of the same frame samples it too. The levels are halved while they still have the scale model size
+void DSST::build_scale_pyramid(const Mat &img, const Point2f pos, const float current_scale)
 {
-    Mat result;
-    int col_len = 0;
-    Size patch_sz = Size(cvFloor(current_scale * scale_factors[0] * base_target_sz.width),
-            cvFloor(current_scale * scale_factors[0] * base_target_sz.height));
-    Mat img_patch = get_subwindow(img, pos, patch_sz.width, patch_sz.height);
-    img_patch.convertTo(img_patch, CV_32FC3);
-    resize(img_patch, img_patch, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
-    std::vector<Mat> hog;
-    hog = get_features_hog(img_patch, 4);
-    result = Mat(Size((int)scale_factors.size(), hog[0].cols * hog[0].rows * (int)hog.size()), CV_32F);
-    col_len = hog[0].cols * hog[0].rows;
-    for (int i = 0; i < static_cast<int>(hog.size()); ++i) {
-        hog[i] = hog[i].t();
-        hog[i] = scale_window.at<float>(0,0) * hog[i].reshape(0, col_len);
-        hog[i].copyTo(result(Rect(Point(0, i*col_len), hog[i].size())));
+    pyramid_scale = current_scale * scale_factors[0] * scale_factors[0];
+    pyramid_patch_sz = Size(cvFloor(pyramid_scale * original_targ_sz.width),
+            cvFloor(pyramid_scale * original_targ_sz.height));
+    pyramid_center = pos;
+
+    int levels = 1;
+    for (Size level_sz = pyramid_patch_sz;
+            level_sz.width / 2 >= scale_model_sz.width && level_sz.height / 2 >= scale_model_sz.height;
+            level_sz = Size((level_sz.width + 1) / 2, (level_sz.height + 1) / 2)) {
+        ++levels;
+    }
+    scale_pyramid.resize(levels);
+    get_subwindow(img, pos, pyramid_patch_sz.width, pyramid_patch_sz.height, pyramid_crop);
+    pyramid_crop.convertTo(scale_pyramid[0], CV_32F, 255.0 / pixel_range(pyramid_crop.depth()));
+    for (int l = 1; l < levels; ++l) {
+        pyrDown(scale_pyramid[l - 1], scale_pyramid[l]);
     }
+}
 
-    ParallelGetScaleFeatures parallelGetScaleFeatures(img, pos, base_target_sz,
-            current_scale, scale_factors, scale_window, scale_model_sz, col_len, result);
-    parallel_for_(Range(1, static_cast<int>(scale_factors.size())), parallelGetScaleFeatures);
-    return result;
+// The patch of patch_sz centred as get_subwindow crops it, resampled to the scale model size from the coarsest
+// level where it still has at least that size. Bilinear with the mapping of resize, level l holds pixel x at x / 2^l
+void DSST::sample_scale_pyramid(const Size &patch_sz, Mat &img_patch) const
+{
+    const double x0 = pyramid_patch_sz.width / 2 - patch_sz.width / 2;
+    const double y0 = pyramid_patch_sz.height / 2 - patch_sz.height / 2;
+    int level = 0;
+    double level_step = 1.0;
+    while (level + 1 < static_cast<int>(scale_pyramid.size()) &&
+            patch_sz.width >= 2.0 * level_step * scale_model_sz.width &&
+            patch_sz.height >= 2.0 * level_step * scale_model_sz.height) {
+        ++level;
+        level_step *= 2.0;
+    }
+    const double sx = static_cast<double>(patch_sz.width) / scale_model_sz.width;
+    const double sy = static_cast<double>(patch_sz.height) / scale_model_sz.height;
+    const Matx23d to_level(sx / level_step, 0.0, (x0 + 0.5 * sx - 0.5) / level_step,
+            0.0, sy / level_step, (y0 + 0.5 * sy - 0.5) / level_step);
+    warpAffine(scale_pyramid[level], img_patch, to_level, scale_model_sz, INTER_LINEAR | WARP_INVERSE_MAP, BORDER_REPLICATE);
 }
 
-void DSST::update(const Mat &image, const Point2f object_center)
+const Mat &DSST::get_scale_patch(const Mat &img, const Point2f pos, const float current_scale, const int s,
+        ScaleSample &sample) const
 {
-    Mat scale_features = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
-    Mat Fscale_features;
-    dft(scale_features, Fscale_features, DFT_ROWS | DFT_COMPLEX_OUTPUT);
-    Mat new_sf_num;
-    Mat new_sf_den;
-    Mat new_sf_den_all;
-    mulSpectrums(ysf, Fscale_features, new_sf_num, DFT_ROWS, true);
-    Mat sf_den_all;
-    mulSpectrums(Fscale_features, Fscale_features, new_sf_den_all, DFT_ROWS, true);
-    reduce(new_sf_den_all, new_sf_den, 0, REDUCE_SUM, -1);
+    Size patch_sz = Size(cvFloor(current_scale * scale_factors[s] * original_targ_sz.width),
+            cvFloor(current_scale * scale_factors[s] * original_targ_sz.height));
+    if (use_pyramid) {
+        sample_scale_pyramid(patch_sz, sample.patch);
+        return sample.patch;
+    }
+    get_subwindow(img, pos, patch_sz.width, patch_sz.height, sample.crop);
+    // float patches hold 8 bit values, single channel frames stay single channel
+    sample.crop.convertTo(sample.crop32f, CV_32F, 255.0 / pixel_range(sample.crop.depth()));
+    resize(sample.crop32f, sample.patch, Size(scale_model_sz.width, scale_model_sz.height),0,0,INTER_LINEAR);
+    return sample.patch;
+}
+
+const Mat &DSST::get_scale_features(const Mat &img, const Point2f pos, const float current_scale, bool reuse_pyramid)
+{
+    if (use_pyramid && (!reuse_pyramid || pos != pyramid_center || current_scale * scale_factors[0] > pyramid_scale)) {
+        build_scale_pyramid(img, pos, current_scale);
+    }
 
-    sf_num = (1 - learn_rate) * sf_num + learn_rate * new_sf_num;
-    sf_den = (1 - learn_rate) * sf_den + learn_rate * new_sf_den;
+    // every scale is a column with the 32 HOG channels of its patch one after the other
+    const int hog_channels = 32;
+    const int col_len = (scale_model_sz.width / 4) * (scale_model_sz.height / 4);
+    scale_features.create(col_len * hog_channels, static_cast<int>(scale_factors.size()), CV_32F);
+    parallel_for_(Range(0, static_cast<int>(scale_factors.size())), [&](const Range &range) {
+        for (int s = range.start; s < range.end; s++) {
+            ScaleSample &sample = scale_samples[s];
+            get_features_hog(get_scale_patch(img, pos, current_scale, s, sample), 4, sample.hog_buffer, sample.hog);
+            // the channel goes down the column transposed, cell (x, y) at x * rows + y
+            const float weight = scale_window.at<float>(0,s);
+            for (int i = 0; i < static_cast<int>(sample.hog.size()); ++i) {
+                const Mat &channel = sample.hog[i];
+                for (int y = 0; y < channel.rows; ++y) {
+                    const float *cell = channel.ptr<float>(y);
+                    for (int x = 0; x < channel.cols; ++x) {
+                        scale_features.at<float>(i * col_len + x * channel.rows + y, s) = weight * cell[x];
+                    }
+                }
+            }
+        }
+    });
+    return scale_features;
+}
+
+void DSST::update(const Mat &image, const Point2f object_center, bool force)
+{
+    // Between updates the model keeps the learning it would have had updating every frame
+    ++frames_since_update;
+    if (!force && frames_since_update < update_interval)
+        return;
+    const float rate = 1.0f - std::pow(1.0f - learn_rate, static_cast<float>(frames_since_update));
+    frames_since_update = 0;
+
+    const Mat &features = get_scale_features(image, object_center, current_scale_factor, true);
+    dft(features, scale_spectra, DFT_ROWS | DFT_COMPLEX_OUTPUT);
+    mulSpectrums(ysf, scale_spectra, new_sf_num, DFT_ROWS, true);
+    mulSpectrums(scale_spectra, scale_spectra, scale_spectra_den, DFT_ROWS, true);
+    reduce(scale_spectra_den, new_sf_den, 0, REDUCE_SUM, -1);
+
+    addWeighted(sf_num, 1 - rate, new_sf_num, rate, 0.0, sf_num);
+    addWeighted(sf_den, 1 - rate, new_sf_den, rate, 0.0, sf_den);
 }
 
 float DSST::getScale(const Mat &image, const Point2f object_center)
 {
-    Mat scale_features = get_scale_features(image, object_center, original_targ_sz,
-            current_scale_factor, scale_factors, scale_window, scale_model_sz);
+    const Mat &features = get_scale_features(image, object_center, current_scale_factor, false);
 
-    Mat Fscale_features;
-    dft(scale_features, Fscale_features, DFT_ROWS | DFT_COMPLEX_OUTPUT);
+    dft(features, scale_spectra, DFT_ROWS | DFT_COMPLEX_OUTPUT);
 
-    mulSpectrums(Fscale_features, sf_num, Fscale_features, 0, false);
-    Mat scale_resp;
-    reduce(Fscale_features, scale_resp, 0, REDUCE_SUM, -1);
-    scale_resp = divide_complex_matrices(scale_resp, sf_den + 0.01f);
-    idft(scale_resp, scale_resp, DFT_REAL_OUTPUT|DFT_SCALE);
+    mulSpectrums(scale_spectra, sf_num, scale_spectra, 0, false);
+    reduce(scale_spectra, scale_response_spectrum, 0, REDUCE_SUM, -1);
+    // sf_den + 0.01 only adds to the real part
+    divide_complex_matrices(scale_response_spectrum, sf_den, 0.01f, scale_response_spectrum);
+    idft(scale_response_spectrum, scale_response, DFT_REAL_OUTPUT|DFT_SCALE);
     Point max_loc;
-    minMaxLoc(scale_resp, NULL, NULL, NULL, &max_loc);
+    minMaxLoc(scale_response, NULL, NULL, NULL, &max_loc);
 
     current_scale_factor *= scale_factors[max_loc.x];
     if(current_scale_factor < min_scale_factor)
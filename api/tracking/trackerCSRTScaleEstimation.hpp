@@ -10,15 +10,43 @@ namespace sky360lib::tracking
     {
     public:
         DSST(){};
-        DSST(const Mat &image, Rect2f bounding_box, Size2f template_size, int numberOfScales,
-             float scaleStep, float maxModelArea, float sigmaFactor, float scaleLearnRate);
+        /// image can be a region of the frame, imageSize is the size of the whole frame
+        /// usePyramid samples all the scales from a pyramid of one patch per frame instead of cropping each scale,
+        /// updateInterval is the number of frames between updates of the scale model
+        DSST(const Mat &image, Size imageSize, Rect2f bounding_box, Size2f template_size, int numberOfScales,
+             float scaleStep, float maxModelArea, float sigmaFactor, float scaleLearnRate,
+             bool usePyramid = false, int updateInterval = 1);
         ~DSST();
-        void update(const Mat &image, const Point2f objectCenter);
+        /// Updates the scale model every updateInterval frames, or now with force.
+        /// With the pyramid it samples the one built by getScale for the same frame and center
+        void update(const Mat &image, const Point2f objectCenter, bool force = false);
         float getScale(const Mat &image, const Point2f objecCenter);
+        /// Largest scale factor applied to the target when sampling the scales
+        float getMaxScaleStep() const
+        {
+            if (scale_factors.empty())
+                return 1.0f;
+            return use_pyramid ? scale_factors[0] * scale_factors[0] : scale_factors[0];
+        }
+        int getScaleModelArea() const { return scale_model_sz.area(); }
 
     private:
-        Mat get_scale_features(Mat img, Point2f pos, Size2f base_target_sz, float current_scale,
-                               std::vector<float> &scale_factors, Mat scale_window, Size scale_model_sz);
+        // Buffers of one scale sample, the samples are computed in parallel and each one only writes its own
+        struct ScaleSample
+        {
+            Mat crop;
+            Mat crop32f;
+            Mat patch;
+            Mat hog_buffer;
+            std::vector<Mat> hog;
+        };
+
+        // The features are written to scale_features, which keeps its size from frame to frame
+        const Mat &get_scale_features(const Mat &img, const Point2f pos, const float current_scale, bool reuse_pyramid);
+        const Mat &get_scale_patch(const Mat &img, const Point2f pos, const float current_scale, const int s,
+                                   ScaleSample &sample) const;
+        void build_scale_pyramid(const Mat &img, const Point2f pos, const float current_scale);
+        void sample_scale_pyramid(const Size &patch_sz, Mat &img_patch) const;
 
         Size scale_model_sz;
         Mat ys;
@@ -36,6 +64,26 @@ namespace sky360lib::tracking
         float max_model_area;
         float sigma_factor;
         float learn_rate;
+        bool use_pyramid;
+        int update_interval;
+        int frames_since_update;
+
+        // Pyramid of the patch of the current frame, it covers pyramid_scale around pyramid_center
+        std::vector<Mat> scale_pyramid;
+        Mat pyramid_crop;
+        Size pyramid_patch_sz;
+        Point2f pyramid_center;
+        float pyramid_scale;
+
+        // Features and spectra of the scale samples, reused by every getScale and update
+        std::vector<ScaleSample> scale_samples;
+        Mat scale_features;
+        Mat scale_spectra;
+        Mat scale_spectra_den;
+        Mat new_sf_num;
+        Mat new_sf_den;
+        Mat scale_response_spectrum;
+        Mat scale_response;
 
         Size original_targ_sz;
     };
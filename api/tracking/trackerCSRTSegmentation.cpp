@@ -6,8 +6,10 @@
 
 #include "trackerCSRTSegmentation.hpp"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <vector>
 #include <iostream>
 
@@ -19,58 +21,46 @@ namespace sky360lib::tracking
     {
         m_numBinsPerDim = numBinsPerDimension;
         m_numDim = numDimensions;
+        CV_Assert(m_numDim <= MAX_DIMENSIONS);
         p_size = cvFloor(std::pow(m_numBinsPerDim, m_numDim));
         p_bins.resize(p_size, 0);
         p_dimIdCoef.resize(m_numDim, 1);
         for (int i = 0; i < m_numDim - 1; ++i)
             p_dimIdCoef[i] = static_cast<int>(std::pow(numBinsPerDimension, m_numDim - 1 - i));
+        // 1 / (imgRange/numBinsPerDim)
+        const double rangePerBinInverse = static_cast<double>(m_numBinsPerDim) / 256.0;
+        p_binLut.resize((size_t)m_numDim * 256);
+        for (int dim = 0; dim < m_numDim; ++dim)
+            for (int value = 0; value < 256; ++value)
+                p_binLut[dim * 256 + value] = p_dimIdCoef[dim] * cvFloor(rangePerBinInverse * value);
     }
 
     void Histogram::extractForegroundHistogram(std::vector<cv::Mat> &imgChannels,
                                                cv::Mat weights, bool useMatWeights, int x1, int y1, int x2, int y2)
     {
-        // just for code clarity
-        cv::Mat &img = imgChannels[0];
+        // without weights they are epanechnikov distr. with peek at the center of the image, computed as the pixels are read
+        double cx = x1 + (x2 - x1) / 2.;
+        double cy = y1 + (y2 - y1) / 2.;
+        double kernelSize_width = 1.0 / (0.5 * static_cast<double>(x2 - x1) * 1.4142 + 1); // sqrt(2)
+        double kernelSize_height = 1.0 / (0.5 * static_cast<double>(y2 - y1) * 1.4142 + 1);
 
-        if (!useMatWeights)
-        {
-            // weights are epanechnikov distr. with peek at the center of the image;
-            double cx = x1 + (x2 - x1) / 2.;
-            double cy = y1 + (y2 - y1) / 2.;
-            double kernelSize_width = 1.0 / (0.5 * static_cast<double>(x2 - x1) * 1.4142 + 1); // sqrt(2)
-            double kernelSize_height = 1.0 / (0.5 * static_cast<double>(y2 - y1) * 1.4142 + 1);
-
-            cv::Mat kernelWeight(img.rows, img.cols, CV_64FC1);
-            for (int y = y1; y < y2 + 1; ++y)
-            {
-                double *weightPtr = kernelWeight.ptr<double>(y);
-                double tmp_y = std::pow((cy - y) * kernelSize_height, 2);
-                for (int x = x1; x < x2 + 1; ++x)
-                {
-                    weightPtr[x] = kernelProfile_Epanechnikov(std::pow((cx - x) * kernelSize_width, 2) + tmp_y);
-                }
-            }
-            weights = kernelWeight;
-        }
         // extract pixel values and compute histogram
-        double rangePerBinInverse = static_cast<double>(m_numBinsPerDim) / 256.0; // 1 / (imgRange/numBinsPerDim)
         double sum = 0;
+        const uchar *dataPtr[MAX_DIMENSIONS];
         for (int y = y1; y < y2 + 1; ++y)
         {
-            std::vector<const uchar *> dataPtr(m_numDim);
             for (int dim = 0; dim < m_numDim; ++dim)
                 dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
-            const double *weightPtr = weights.ptr<double>(y);
+            const double *weightPtr = useMatWeights ? weights.ptr<double>(y) : nullptr;
+            const double tmp_y = std::pow((cy - y) * kernelSize_height, 2);
 
             for (int x = x1; x < x2 + 1; ++x)
             {
-                int id = 0;
-                for (int dim = 0; dim < m_numDim; ++dim)
-                {
-                    id += p_dimIdCoef[dim] * cvFloor(rangePerBinInverse * dataPtr[dim][x]);
-                }
-                p_bins[id] += weightPtr[x];
-                sum += weightPtr[x];
+                const double weight = useMatWeights
+                                          ? weightPtr[x]
+                                          : kernelProfile_Epanechnikov(std::pow((cx - x) * kernelSize_width, 2) + tmp_y);
+                p_bins[binIndex(dataPtr, x)] += weight;
+                sum += weight;
             }
         }
         // normalize
@@ -85,12 +75,10 @@ namespace sky360lib::tracking
         int outer_x1, int outer_y1, int outer_x2, int outer_y2)
     {
         // extract pixel values and compute histogram
-        double rangePerBinInverse = static_cast<double>(m_numBinsPerDim) / 256.0; // 1 / (imgRange/numBinsPerDim)
         double sum = 0;
+        const uchar *dataPtr[MAX_DIMENSIONS];
         for (int y = outer_y1; y < outer_y2; ++y)
         {
-
-            std::vector<const uchar *> dataPtr(m_numDim);
             for (int dim = 0; dim < m_numDim; ++dim)
                 dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
 
@@ -99,12 +87,7 @@ namespace sky360lib::tracking
                 if (x >= x1 && x <= x2 && y >= y1 && y <= y2)
                     continue;
 
-                int id = 0;
-                for (int dim = 0; dim < m_numDim; ++dim)
-                {
-                    id += p_dimIdCoef[dim] * cvFloor(rangePerBinInverse * dataPtr[dim][x]);
-                }
-                p_bins[id] += 1.0;
+                p_bins[binIndex(dataPtr, x)] += 1.0;
                 sum += 1.0;
             }
         }
@@ -114,32 +97,39 @@ namespace sky360lib::tracking
             p_bins[i] *= sum;
     }
 
-    cv::Mat Histogram::backProject(std::vector<cv::Mat> &imgChannels)
+    cv::Mat Histogram::backProject(std::vector<cv::Mat> &imgChannels, int depth) const
     {
-        // just for code clarity
-        cv::Mat &img = imgChannels[0];
+        cv::Mat result;
+        backProject(imgChannels, result, depth);
+        return result;
+    }
 
-        cv::Mat backProject(img.rows, img.cols, CV_64FC1);
-        double rangePerBinInverse = static_cast<double>(m_numBinsPerDim) / 256.0; // 1 / (imgRange/numBinsPerDim)
+    void Histogram::backProject(const std::vector<cv::Mat> &imgChannels, cv::Mat &backProject, int depth) const
+    {
+        CV_Assert(depth == CV_64F || depth == CV_32F);
+        // just for code clarity
+        const cv::Mat &img = imgChannels[0];
 
+        backProject.create(img.rows, img.cols, CV_MAKETYPE(depth, 1));
+        const uchar *dataPtr[MAX_DIMENSIONS];
         for (int y = 0; y < img.rows; ++y)
         {
-            double *backProjectPtr = backProject.ptr<double>(y);
-            std::vector<const uchar *> dataPtr(m_numDim);
             for (int dim = 0; dim < m_numDim; ++dim)
                 dataPtr[dim] = imgChannels[dim].ptr<uchar>(y);
 
-            for (int x = 0; x < img.cols; ++x)
+            if (depth == CV_32F)
+            {
+                float *backProjectPtr = backProject.ptr<float>(y);
+                for (int x = 0; x < img.cols; ++x)
+                    backProjectPtr[x] = static_cast<float>(p_bins[binIndex(dataPtr, x)]);
+            }
+            else
             {
-                int id = 0;
-                for (int dim = 0; dim < m_numDim; ++dim)
-                {
-                    id += p_dimIdCoef[dim] * cvFloor(rangePerBinInverse * dataPtr[dim][x]);
-                }
-                backProjectPtr[x] = p_bins[id];
+                double *backProjectPtr = backProject.ptr<double>(y);
+                for (int x = 0; x < img.cols; ++x)
+                    backProjectPtr[x] = p_bins[binIndex(dataPtr, x)];
             }
         }
-        return backProject;
     }
 
     // add new methods
@@ -156,6 +146,20 @@ namespace sky360lib::tracking
         }
     }
 
+    void Histogram::clear()
+    {
+        std::fill(p_bins.begin(), p_bins.end(), 0.0);
+    }
+
+    void Histogram::update(const Histogram &histogram, double rate)
+    {
+        CV_Assert(histogram.p_bins.size() == p_bins.size());
+        for (size_t i = 0; i < p_bins.size(); i++)
+        {
+            p_bins[i] = (1 - rate) * p_bins[i] + rate * histogram.p_bins[i];
+        }
+    }
+
     //-------------------- SEGMENT CLASS --------------------
     std::pair<cv::Mat, cv::Mat> Segment::computePosteriors(
         std::vector<cv::Mat> &imgChannels,
@@ -230,19 +234,68 @@ namespace sky360lib::tracking
         prob_o = p_o * foregroundLikelihood / (p_o * foregroundLikelihood + p_b * backgroundLikelihood);
         cv::Mat prob_b = 1.0 - prob_o;
 
-        std::pair<cv::Mat, cv::Mat> sizedProbs = getRegularizedSegmentation(prob_o, prob_b, fgPriorScaled, bgPriorScaled);
+        SegmentWorkspace workspace;
+        getRegularizedSegmentation(prob_o, prob_b, fgPriorScaled, bgPriorScaled, workspace);
 
         // resize probs to original size
         std::pair<cv::Mat, cv::Mat> probs;
-        cv::resize(sizedProbs.first, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
-        cv::resize(sizedProbs.second, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
+        cv::resize(workspace.Qsum_o, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
+        cv::resize(workspace.Qsum_b, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
 
         return probs;
     }
 
+    // Prior over roi resized to size as CV_32F, 0.5 everywhere without an external source
+    // Single precision priors are resized in place of the previous ones
+    static void scaledPrior(const cv::Mat &prior, const cv::Rect &roi, const cv::Size &size, cv::Mat &scaled)
+    {
+        if (prior.cols == 0)
+        {
+            scaled.create(size, CV_32FC1);
+            scaled.setTo(cv::Scalar(0.5));
+            return;
+        }
+        cv::resize(prior(roi), scaled, size);
+        if (scaled.depth() != CV_32F)
+            scaled.convertTo(scaled, CV_32F);
+    }
+
+    // Turns the likelihoods into the posteriors in place:
+    // prob_o = p_o * l_o * prior_o / (p_o * l_o * prior_o + p_b * l_b * prior_b), prob_b = 1 - prob_o
+    static void bayesPosteriors(cv::Mat &prob_o, cv::Mat &prob_b, const cv::Mat &prior_o, const cv::Mat &prior_b,
+                                float p_o, float p_b)
+    {
+        for (int y = 0; y < prob_o.rows; ++y)
+        {
+            float *o = prob_o.ptr<float>(y);
+            float *b = prob_b.ptr<float>(y);
+            const float *po = prior_o.ptr<float>(y);
+            const float *pb = prior_b.ptr<float>(y);
+            for (int x = 0; x < prob_o.cols; ++x)
+            {
+                const float fg = p_o * o[x] * po[x];
+                const float bg = p_b * b[x] * pb[x];
+                o[x] = fg / (fg + bg);
+                b[x] = 1.0f - o[x];
+            }
+        }
+    }
+
     std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(
         std::vector<cv::Mat> &imgChannels, int x1, int y1, int x2, int y2, double p_b,
         cv::Mat fgPrior, cv::Mat bgPrior, Histogram hist_target, Histogram hist_background)
+    {
+        SegmentWorkspace workspace;
+        std::pair<cv::Mat, cv::Mat> probs;
+        computePosteriors2(imgChannels, x1, y1, x2, y2, p_b, fgPrior, bgPrior, hist_target, hist_background,
+                           workspace, probs);
+        return probs;
+    }
+
+    void Segment::computePosteriors2(
+        const std::vector<cv::Mat> &imgChannels, int x1, int y1, int x2, int y2, double p_b,
+        const cv::Mat &fgPrior, const cv::Mat &bgPrior, const Histogram &hist_target, const Histogram &hist_background,
+        SegmentWorkspace &workspace, std::pair<cv::Mat, cv::Mat> &probs)
     {
         // preprocess and normalize all data
         CV_Assert(imgChannels.size() > 0);
@@ -270,40 +323,26 @@ namespace sky360lib::tracking
 
         // rescale input data
         cv::Rect roiRect_inner = cv::Rect(x1, y1, w, h);
-        std::vector<cv::Mat> imgChannelsROI_inner(imgChannels.size());
+        std::vector<cv::Mat> &imgChannelsROI_inner = workspace.channels;
+        imgChannelsROI_inner.resize(imgChannels.size());
         for (size_t i = 0; i < imgChannels.size(); ++i)
             cv::resize(imgChannels[i](roiRect_inner), imgChannelsROI_inner[i], newSize);
 
-        // initialize priors if there is no external source and rescale
-        cv::Mat fgPriorScaled;
-        if (fgPrior.cols == 0)
-            fgPriorScaled = 0.5 * cv::Mat::ones(newSize, CV_64FC1);
-        else
-            cv::resize(fgPrior(roiRect_inner), fgPriorScaled, newSize);
-        cv::Mat bgPriorScaled;
-        if (bgPrior.cols == 0)
-            bgPriorScaled = 0.5 * cv::Mat::ones(newSize, CV_64FC1);
-        else
-            cv::resize(bgPrior(roiRect_inner), bgPriorScaled, newSize);
+        // initialize priors if there is no external source and rescale, this path works in single precision
+        scaledPrior(fgPrior, roiRect_inner, newSize, workspace.fgPrior);
+        scaledPrior(bgPrior, roiRect_inner, newSize, workspace.bgPrior);
 
-        // backproject pixels likelihood
-        cv::Mat foregroundLikelihood = hist_target.backProject(imgChannelsROI_inner).mul(fgPriorScaled);
-        cv::Mat backgroundLikelihood = hist_background.backProject(imgChannelsROI_inner).mul(bgPriorScaled);
+        // backproject pixels likelihood and convert them to posterior prob. (Bayes rule)
+        hist_target.backProject(imgChannelsROI_inner, workspace.probO, CV_32F);
+        hist_background.backProject(imgChannelsROI_inner, workspace.probB, CV_32F);
+        bayesPosteriors(workspace.probO, workspace.probB, workspace.fgPrior, workspace.bgPrior,
+                        static_cast<float>(p_o), static_cast<float>(p_b));
 
-        // convert likelihoods to posterior prob. (Bayes rule)
-        cv::Mat prob_o(newSize, foregroundLikelihood.type());
-        prob_o = p_o * foregroundLikelihood / (p_o * foregroundLikelihood + p_b * backgroundLikelihood);
-        cv::Mat prob_b = 1.0 - prob_o;
-
-        std::pair<cv::Mat, cv::Mat> sizedProbs = getRegularizedSegmentation(prob_o, prob_b,
-                                                                            fgPriorScaled, bgPriorScaled);
+        getRegularizedSegmentation(workspace.probO, workspace.probB, workspace.fgPrior, workspace.bgPrior, workspace);
 
         // resize probs to original size
-        std::pair<cv::Mat, cv::Mat> probs;
-        cv::resize(sizedProbs.first, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
-        cv::resize(sizedProbs.second, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
-
-        return probs;
+        cv::resize(workspace.Qsum_o, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
+        cv::resize(workspace.Qsum_b, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
     }
 
     std::pair<cv::Mat, cv::Mat> Segment::computePosteriors2(std::vector<cv::Mat> &imgChannels,
@@ -357,172 +396,191 @@ namespace sky360lib::tracking
         prob_o = p_o * foregroundLikelihood / (p_o * foregroundLikelihood + p_b * backgroundLikelihood);
         cv::Mat prob_b = 1.0 - prob_o;
 
-        std::pair<cv::Mat, cv::Mat> sizedProbs = getRegularizedSegmentation(prob_o, prob_b, fgPriorScaled, bgPriorScaled);
+        SegmentWorkspace workspace;
+        getRegularizedSegmentation(prob_o, prob_b, fgPriorScaled, bgPriorScaled, workspace);
 
         // resize probs to original size
         std::pair<cv::Mat, cv::Mat> probs;
-        cv::resize(sizedProbs.first, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
-        cv::resize(sizedProbs.second, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
+        cv::resize(workspace.Qsum_o, probs.first, cv::Size(roiRect_inner.width, roiRect_inner.height));
+        cv::resize(workspace.Qsum_b, probs.second, cv::Size(roiRect_inner.width, roiRect_inner.height));
 
         return probs;
     }
 
+    template <typename T>
     inline void tempOBMult(Mat& Si_o, Mat& Si_b, const Mat& prior_o, const Mat& prior_b)
     {
+        // Si_o = Si_o.mul(prior_o);
+        // Si_b = Si_b.mul(prior_b);
+        // cv::Mat normSi = 1.0 / (Si_o + Si_b);
+        // Si_o = Si_o.mul(normSi);
+        // Si_b = Si_b.mul(normSi);
         const size_t size = prior_o.rows * prior_o.cols;
-        double* dSi_o = (double*)Si_o.data;
-        double* dSi_b = (double*)Si_b.data;
-        double* dprior_o = (double*)prior_o.data;
-        double* dprior_b = (double*)prior_b.data;
+        T* dSi_o = (T*)Si_o.data;
+        T* dSi_b = (T*)Si_b.data;
+        const T* dprior_o = (const T*)prior_o.data;
+        const T* dprior_b = (const T*)prior_b.data;
 
         for (size_t i = 0; i < size; ++i)
         {
-            *dSi_o *= *dprior_o;
-            *dSi_b *= *dprior_b;
-            const double normSi{1.0 / (*dSi_o + *dSi_b)};
-            *dSi_o *= normSi;
-            *dSi_b *= normSi;
-            ++dSi_o;
-            ++dSi_b;
-            ++dprior_o;
-            ++dprior_b;
+            const T so = dSi_o[i] * dprior_o[i];
+            const T sb = dSi_b[i] * dprior_b[i];
+            const T normSi = T(1) / (so + sb);
+            dSi_o[i] = so * normSi;
+            dSi_b[i] = sb * normSi;
         }
-        // Si_o = Si_o.mul(prior_o);
-        // Si_b = Si_b.mul(prior_b);
-        // cv::Mat normSi = 1.0 / (Si_o + Si_b);
-        // Si_o = Si_o.mul(normSi);
-        // Si_b = Si_b.mul(normSi);        
     }
 
+    template <typename T>
     inline void tempOBSumSum(const Mat& Qsum_o, const Mat& Ssum_o, const Mat& Qsum_b, const Mat& Ssum_b, Mat& prior_o, Mat& prior_b)
     {
-            // prior_o = (Qsum_o + Ssum_o) * 0.25;
-            // prior_b = (Qsum_b + Ssum_b) * 0.25;
-            // cv::Mat normPI = 1.0 / (prior_o + prior_b);
-            // prior_o = prior_o.mul(normPI);
-            // prior_b = prior_b.mul(normPI);
+        // prior_o = (Qsum_o + Ssum_o) * 0.25;
+        // prior_b = (Qsum_b + Ssum_b) * 0.25;
+        // cv::Mat normPI = 1.0 / (prior_o + prior_b);
+        // prior_o = prior_o.mul(normPI);
+        // prior_b = prior_b.mul(normPI);
         const size_t size = prior_o.rows * prior_o.cols;
-        double* dQsum_o = (double*)Qsum_o.data;
-        double* dSsum_o = (double*)Ssum_o.data;
-        double* dQsum_b = (double*)Qsum_b.data;
-        double* dSsum_b = (double*)Ssum_b.data;
-        double* dprior_o = (double*)prior_o.data;
-        double* dprior_b = (double*)prior_b.data;
+        const T* dQsum_o = (const T*)Qsum_o.data;
+        const T* dSsum_o = (const T*)Ssum_o.data;
+        const T* dQsum_b = (const T*)Qsum_b.data;
+        const T* dSsum_b = (const T*)Ssum_b.data;
+        T* dprior_o = (T*)prior_o.data;
+        T* dprior_b = (T*)prior_b.data;
 
         for (size_t i = 0; i < size; ++i)
         {
-            *dprior_o = (*dQsum_o + *dSsum_o) * 0.25;
-            *dprior_b = (*dQsum_b + *dSsum_b) * 0.25;
-            const double normPI{1.0 / (*dprior_o + *dprior_b)};
-            *dprior_o *= normPI;
-            *dprior_b *= normPI;
-            ++dQsum_o;
-            ++dSsum_o;
-            ++dQsum_b;
-            ++dSsum_b;
-            ++dprior_o;
-            ++dprior_b;
+            const T po = (dQsum_o[i] + dSsum_o[i]) * T(0.25);
+            const T pb = (dQsum_b[i] + dSsum_b[i]) * T(0.25);
+            const T normPI = T(1) / (po + pb);
+            dprior_o[i] = po * normPI;
+            dprior_b[i] = pb * normPI;
         }
     }
 
-    std::pair<cv::Mat, cv::Mat> Segment::getRegularizedSegmentation(
-        cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b)
+    template <typename T>
+    inline void tempOBPrior(const Mat& prior_o, const Mat& prob_o, const Mat& prior_b, const Mat& prob_b, Mat& P_Io, Mat& P_Ib)
     {
-        int hsize = cvFloor(std::max(1.0, (double)cvFloor(static_cast<double>(prob_b.cols) * 3. / 50. + 0.5)));
-        int lambdaSize = hsize * 2 + 1;
+        // P_Io = prior_o.mul(prob_o) + eps;
+        // P_Ib = prior_b.mul(prob_b) + eps;
+        const size_t size = prior_o.rows * prior_o.cols;
+        const T eps = static_cast<T>(std::numeric_limits<double>::epsilon());
+        const T* dprior_o = (const T*)prior_o.data;
+        const T* dprob_o = (const T*)prob_o.data;
+        const T* dprior_b = (const T*)prior_b.data;
+        const T* dprob_b = (const T*)prob_b.data;
+        T* dP_Io = (T*)P_Io.data;
+        T* dP_Ib = (T*)P_Ib.data;
 
-        // compute gaussian kernel
-        cv::Mat lambda(lambdaSize, lambdaSize, CV_64FC1);
-        double std2 = std::pow(hsize / 3.0, 2);
-        double sumLambda = 0.0;
-        for (int y = -hsize; y < hsize + 1; ++y)
+        for (size_t i = 0; i < size; ++i)
         {
-            double *lambdaPtr = lambda.ptr<double>(y + hsize);
-            double tmp_y = y * y;
-            for (int x = -hsize; x < hsize + 1; ++x)
-            {
-                double tmp_gauss = gaussian(x * x, tmp_y, std2);
-                lambdaPtr[x + hsize] = tmp_gauss;
-                sumLambda += tmp_gauss;
-            }
+            dP_Io[i] = dprior_o[i] * dprob_o[i] + eps;
+            dP_Ib[i] = dprior_b[i] * dprob_b[i] + eps;
         }
-        sumLambda -= lambda.at<double>(hsize, hsize);
-        // set center of kernel to 0
-        lambda.at<double>(hsize, hsize) = 0.0;
-        sumLambda = 1.0 / sumLambda;
-        // normalize kernel to sum to 1
-        lambda = lambda * sumLambda;
+    }
 
-        // create lambda2 kernel
-        cv::Mat lambda2 = lambda.clone();
-        lambda2.at<double>(hsize, hsize) = 1.0;
+    // follows the equations from Kristan et al. ACCV2014 paper
+    //"A graphical model for rapid obstacle image-map estimation from unmanned surface vehicles"
+    // All the buffers are in the workspace and sized before the iterations, T is the depth of the priors
+    template <typename T>
+    static void regularizedSegmentation(
+        cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b, const cv::Mat &lambda, const cv::Mat &lambda2,
+        SegmentWorkspace &workspace)
+    {
+        CV_Assert(prob_o.isContinuous() && prob_b.isContinuous() && prior_o.isContinuous() && prior_b.isContinuous());
+        CV_Assert(prob_o.type() == prior_o.type() && prob_b.type() == prior_b.type() && prior_o.type() == prior_b.type());
 
         double terminateThr = 1e-1;
         double logLike = std::numeric_limits<double>::max();
         int maxIter = 50;
 
         // return values
-        cv::Mat Qsum_o(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Qsum_b(prior_o.rows, prior_o.cols, prior_o.type());
+        cv::Mat &Qsum_o = workspace.Qsum_o;
+        cv::Mat &Qsum_b = workspace.Qsum_b;
 
         // algorithm temporal
-        cv::Mat Si_o(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Si_b(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Ssum_o(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Ssum_b(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Qi_o(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat Qi_b(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat logQo(prior_o.rows, prior_o.cols, prior_o.type());
-        cv::Mat logQb(prior_o.rows, prior_o.cols, prior_o.type());
+        cv::Mat &P_Io = workspace.P_Io;
+        cv::Mat &P_Ib = workspace.P_Ib;
+        cv::Mat &Si_o = workspace.Si_o;
+        cv::Mat &Si_b = workspace.Si_b;
+        cv::Mat &Ssum_o = workspace.Ssum_o;
+        cv::Mat &Ssum_b = workspace.Ssum_b;
+        cv::Mat &Qi_o = workspace.Qi_o;
+        cv::Mat &Qi_b = workspace.Qi_b;
+        cv::Mat &logQo = workspace.logQo;
+        cv::Mat &logQb = workspace.logQb;
+        for (cv::Mat *buffer : {&Qsum_o, &Qsum_b, &P_Io, &P_Ib, &Si_o, &Si_b, &Ssum_o, &Ssum_b, &Qi_o, &Qi_b, &logQo, &logQb})
+        {
+            buffer->create(prior_o.rows, prior_o.cols, prior_o.type());
+        }
 
         for (int i = 0; i < maxIter; ++i)
         {
-            // follows the equations from Kristan et al. ACCV2014 paper
-            //"A graphical model for rapid obstacle image-map estimation from unmanned surface vehicles"
-            cv::Mat P_Io = prior_o.mul(prob_o) + std::numeric_limits<double>::epsilon();
-            cv::Mat P_Ib = prior_b.mul(prob_b) + std::numeric_limits<double>::epsilon();
+            tempOBPrior<T>(prior_o, prob_o, prior_b, prob_b, P_Io, P_Ib);
 
             cv::filter2D(prior_o, Si_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
             cv::filter2D(prior_b, Si_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
-
-            tempOBMult(Si_o, Si_b, prior_o, prior_b);
-            // Si_o = Si_o.mul(prior_o);
-            // Si_b = Si_b.mul(prior_b);
-            // cv::Mat normSi = 1.0 / (Si_o + Si_b);
-            // Si_o = Si_o.mul(normSi);
-            // Si_b = Si_b.mul(normSi);
-
+            tempOBMult<T>(Si_o, Si_b, prior_o, prior_b);
             cv::filter2D(Si_o, Ssum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
             cv::filter2D(Si_b, Ssum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
 
             cv::filter2D(P_Io, Qi_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
             cv::filter2D(P_Ib, Qi_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
-            tempOBMult(Qi_o, Qi_b, P_Io, P_Ib);
-            // Qi_o = Qi_o.mul(P_Io);
-            // Qi_b = Qi_b.mul(P_Ib);
-            // cv::Mat normQi = 1.0 / (Qi_o + Qi_b);
-            // Qi_o = Qi_o.mul(normQi);
-            // Qi_b = Qi_b.mul(normQi);
+            tempOBMult<T>(Qi_o, Qi_b, P_Io, P_Ib);
             cv::filter2D(Qi_o, Qsum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
             cv::filter2D(Qi_b, Qsum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
 
-            tempOBSumSum(Qsum_o, Ssum_o, Qsum_b, Ssum_b, prior_o, prior_b);
-            // prior_o = (Qsum_o + Ssum_o) * 0.25;
-            // prior_b = (Qsum_b + Ssum_b) * 0.25;
-            // cv::Mat normPI = 1.0 / (prior_o + prior_b);
-            // prior_o = prior_o.mul(normPI);
-            // prior_b = prior_b.mul(normPI);
+            tempOBSumSum<T>(Qsum_o, Ssum_o, Qsum_b, Ssum_b, prior_o, prior_b);
 
             // converge ?
             cv::log(Qsum_o, logQo);
             cv::log(Qsum_b, logQb);
-            cv::Scalar mean = cv::sum(logQo + logQb);
-            double logLikeNew = -mean.val[0] / (2 * Qsum_o.rows * Qsum_o.cols);
+            const double sumLog = cv::sum(logQo)[0] + cv::sum(logQb)[0];
+            double logLikeNew = -sumLog / (2 * Qsum_o.rows * Qsum_o.cols);
             if (std::abs(logLike - logLikeNew) < terminateThr)
                 break;
             logLike = logLikeNew;
         }
-        return std::pair<cv::Mat, cv::Mat>(Qsum_o, Qsum_b);
+    }
+
+    void Segment::getRegularizedSegmentation(
+        cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b, SegmentWorkspace &workspace)
+    {
+        int hsize = cvFloor(std::max(1.0, (double)cvFloor(static_cast<double>(prob_b.cols) * 3. / 50. + 0.5)));
+        int lambdaSize = hsize * 2 + 1;
+
+        // compute gaussian kernel
+        cv::Mat &lambda = workspace.lambda64;
+        lambda.create(lambdaSize, lambdaSize, CV_64FC1);
+        double std2 = std::pow(hsize / 3.0, 2);
+        double sumLambda = 0.0;
+        for (int y = -hsize; y < hsize + 1; ++y)
+        {
+            double *lambdaPtr = lambda.ptr<double>(y + hsize);
+            double tmp_y = y * y;
+            for (int x = -hsize; x < hsize + 1; ++x)
+            {
+                double tmp_gauss = gaussian(x * x, tmp_y, std2);
+                lambdaPtr[x + hsize] = tmp_gauss;
+                sumLambda += tmp_gauss;
+            }
+        }
+        sumLambda -= lambda.at<double>(hsize, hsize);
+        // set center of kernel to 0
+        lambda.at<double>(hsize, hsize) = 0.0;
+        sumLambda = 1.0 / sumLambda;
+        // normalize kernel to sum to 1, in the depth of the priors
+        lambda.convertTo(workspace.lambda, prior_o.depth(), sumLambda);
+
+        // create lambda2 kernel
+        workspace.lambda.copyTo(workspace.lambda2);
+        if (prior_o.depth() == CV_32F)
+        {
+            workspace.lambda2.at<float>(hsize, hsize) = 1.0f;
+            regularizedSegmentation<float>(prob_o, prob_b, prior_o, prior_b, workspace.lambda, workspace.lambda2, workspace);
+            return;
+        }
+        workspace.lambda2.at<double>(hsize, hsize) = 1.0;
+        regularizedSegmentation<double>(prob_o, prob_b, prior_o, prior_b, workspace.lambda, workspace.lambda2, workspace);
     }
 
 } // cv namespace
@@ -9,6 +9,9 @@ namespace sky360lib::tracking
     class Histogram
     {
     public:
+        /// Largest number of channels of the images, the row pointers of the channels stay on the stack
+        static constexpr int MAX_DIMENSIONS = 4;
+
         int m_numBinsPerDim;
         int m_numDim;
 
@@ -19,14 +22,34 @@ namespace sky360lib::tracking
         void extractBackGroundHistogram(std::vector<cv::Mat> &imgChannels,
                                         int x1, int y1, int x2, int y2, int outer_x1, int outer_y1,
                                         int outer_x2, int outer_y2);
-        cv::Mat backProject(std::vector<cv::Mat> &imgChannels);
+        /// Bin probability of every pixel, depth is CV_64F or CV_32F
+        cv::Mat backProject(std::vector<cv::Mat> &imgChannels, int depth = CV_64F) const;
+        /// Same into backProject, which is reused when it has the size and type
+        void backProject(const std::vector<cv::Mat> &imgChannels, cv::Mat &backProject, int depth) const;
         std::vector<double> getHistogramVector();
         void setHistogramVector(double *vector);
+        /// Empties the bins, so the histogram can be extracted again
+        void clear();
+        /// Moves the bins towards those of histogram, which has the same dimensions: bins = (1 - rate) * bins + rate * histogram
+        void update(const Histogram &histogram, double rate);
 
     private:
         int p_size;
         std::vector<double> p_bins;
         std::vector<int> p_dimIdCoef;
+        // Offset of each 8 bit value in the bins, per dimension: p_dimIdCoef[dim] * floor(value * numBins / 256)
+        std::vector<int> p_binLut;
+
+        inline int binIndex(const uchar *const *dataPtr, int x) const
+        {
+            const int *lut = p_binLut.data();
+            int id = 0;
+            for (int dim = 0; dim < m_numDim; ++dim, lut += 256)
+            {
+                id += lut[dataPtr[dim][x]];
+            }
+            return id;
+        }
 
         inline double kernelProfile_Epanechnikov(double x)
         {
@@ -34,6 +57,32 @@ namespace sky360lib::tracking
         }
     };
 
+    /// Buffers of Segment::computePosteriors2, a tracker keeps one so segmenting patches of the same size
+    /// every frame does not allocate
+    struct SegmentWorkspace
+    {
+        std::vector<cv::Mat> channels;
+        cv::Mat fgPrior;
+        cv::Mat bgPrior;
+        cv::Mat probO;
+        cv::Mat probB;
+        cv::Mat lambda64;
+        cv::Mat lambda;
+        cv::Mat lambda2;
+        cv::Mat Qsum_o;
+        cv::Mat Qsum_b;
+        cv::Mat P_Io;
+        cv::Mat P_Ib;
+        cv::Mat Si_o;
+        cv::Mat Si_b;
+        cv::Mat Ssum_o;
+        cv::Mat Ssum_b;
+        cv::Mat Qi_o;
+        cv::Mat Qi_b;
+        cv::Mat logQo;
+        cv::Mat logQb;
+    };
+
     class Segment
     {
     public:
@@ -43,12 +92,18 @@ namespace sky360lib::tracking
         static std::pair<cv::Mat, cv::Mat> computePosteriors2(std::vector<cv::Mat> &imgChannels,
                                                               int x1, int y1, int x2, int y2, double p_b, cv::Mat fgPrior,
                                                               cv::Mat bgPrior, Histogram hist_target, Histogram hist_background);
+        /// Same posteriors written to probs, with every buffer in workspace
+        static void computePosteriors2(const std::vector<cv::Mat> &imgChannels,
+                                       int x1, int y1, int x2, int y2, double p_b, const cv::Mat &fgPrior,
+                                       const cv::Mat &bgPrior, const Histogram &hist_target, const Histogram &hist_background,
+                                       SegmentWorkspace &workspace, std::pair<cv::Mat, cv::Mat> &probs);
         static std::pair<cv::Mat, cv::Mat> computePosteriors2(std::vector<cv::Mat> &imgChannels,
                                                               cv::Mat fgPrior, cv::Mat bgPrior, Histogram hist_target, Histogram hist_background);
 
     private:
-        static std::pair<cv::Mat, cv::Mat> getRegularizedSegmentation(cv::Mat &prob_o,
-                                                                      cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b);
+        // The segmentation is left in workspace.Qsum_o and workspace.Qsum_b
+        static void getRegularizedSegmentation(cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b,
+                                               SegmentWorkspace &workspace);
 
         inline static double gaussian(double x2, double y2, double std2)
         {
@@ -3,7 +3,10 @@
 // of this distribution and at http://opencv.org/license.html.
 
 #include "precomp.hpp"
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <vector>
 
 #include "trackerCSRTUtils.hpp"
 
@@ -51,49 +54,78 @@ namespace sky360lib::tracking
 
     std::vector<Mat> fourier_transform_features(const std::vector<Mat> &M)
     {
-        std::vector<Mat> out(M.size());
+        std::vector<Mat> out;
+        fourier_transform_features(M, out);
+        return out;
+    }
+
+    void fourier_transform_features(const std::vector<Mat> &M, std::vector<Mat> &out)
+    {
+        out.resize(M.size());
         Mat channel;
-        // iterate over channels and convert them to Fourier domain
+        // iterate over channels and convert them to Fourier domain, into the spectra already in out when they fit
         for (size_t k = 0; k < M.size(); k++)
         {
-            M[k].convertTo(channel, CV_32F);
-            dft(channel, channel, DFT_COMPLEX_OUTPUT);
-            out[k] = (channel);
+            if (M[k].depth() == CV_32F)
+            {
+                dft(M[k], out[k], DFT_COMPLEX_OUTPUT);
+            }
+            else
+            {
+                M[k].convertTo(channel, CV_32F);
+                dft(channel, out[k], DFT_COMPLEX_OUTPUT);
+            }
         }
-        return out;
     }
 
     Mat divide_complex_matrices(const Mat &A, const Mat &B)
     {
-        std::vector<Mat> va, vb;
-        split(A, va);
-        split(B, vb);
-
-        Mat a = va.at(0);
-        Mat b = va.at(1);
-        Mat c = vb.at(0);
-        Mat d = vb.at(1);
-
-        Mat div = c.mul(c) + d.mul(d);
-        Mat real_part = (a.mul(c) + b.mul(d));
-        Mat im_part = (b.mul(c) - a.mul(d));
-        divide(real_part, div, real_part);
-        divide(im_part, div, im_part);
-
-        std::vector<Mat> tmp(2);
-        tmp[0] = real_part;
-        tmp[1] = im_part;
         Mat res;
-        merge(tmp, res);
+        divide_complex_matrices(A, B, 0.0f, res);
         return res;
     }
 
+    void divide_complex_matrices(const Mat &A, const Mat &B, const float b_offset, Mat &dst)
+    {
+        CV_Assert(A.type() == CV_32FC2 && B.type() == CV_32FC2 && A.size() == B.size());
+        dst.create(A.size(), CV_32FC2);
+        for (int y = 0; y < A.rows; y++)
+        {
+            const float *a = A.ptr<float>(y);
+            const float *b = B.ptr<float>(y);
+            float *d = dst.ptr<float>(y);
+            for (int x = 0; x < 2 * A.cols; x += 2)
+            {
+                const float c = b[x] + b_offset;
+                const float e = b[x + 1];
+                const float div = c * c + e * e;
+                const float re = a[x] * c + a[x + 1] * e;
+                const float im = a[x + 1] * c - a[x] * e;
+                d[x] = re / div;
+                d[x + 1] = im / div;
+            }
+        }
+    }
+
     Mat get_subwindow(
         const Mat &image,
         const Point2f center,
         const int w,
         const int h,
         Rect *valid_pixels)
+    {
+        Mat subwin;
+        get_subwindow(image, center, w, h, subwin, valid_pixels);
+        return subwin;
+    }
+
+    void get_subwindow(
+        const Mat &image,
+        const Point2f center,
+        const int w,
+        const int h,
+        Mat &subwin,
+        Rect *valid_pixels)
     {
         int startx = cvFloor(center.x) + 1 - (cvFloor(w / 2));
         int starty = cvFloor(center.y) + 1 - (cvFloor(h / 2));
@@ -121,14 +153,14 @@ namespace sky360lib::tracking
             padding_bottom = roi.y + roi.height - image.rows;
             roi.height = image.rows - roi.y;
         }
-        Mat subwin = image(roi).clone();
-        copyMakeBorder(subwin, subwin, padding_top, padding_bottom, padding_left, padding_right, BORDER_REPLICATE);
+        // The border replicates the window itself and not the pixels of the image around it
+        copyMakeBorder(image(roi), subwin, padding_top, padding_bottom, padding_left, padding_right,
+                       BORDER_REPLICATE | BORDER_ISOLATED);
 
         if (valid_pixels != NULL)
         {
             *valid_pixels = Rect(padding_left, padding_top, roi.width, roi.height);
         }
-        return subwin;
     }
 
     float subpixel_peak(const Mat &response, const std::string &s, const Point2f &p)
@@ -290,190 +322,204 @@ namespace sky360lib::tracking
         return cheb_rows * cheb_cols;
     }
 
-    static void computeHOG32D(const Mat &imageM, Mat &featM, const int sbin, const int pad_x, const int pad_y)
+    // Scratch buffers of computeHOG32F, one set per thread as the DSST computes its scales in parallel
+    struct HOGBuffers
     {
-        const int dimHOG = 32;
-        CV_Assert(pad_x >= 0);
-        CV_Assert(pad_y >= 0);
-        CV_Assert(imageM.channels() == 3);
-        CV_Assert(imageM.depth() == CV_64F);
-
+        std::vector<float> dx;
+        std::vector<float> dy;
+        std::vector<float> magnitude;
+        std::vector<float> bestDot;
+        std::vector<int> orientation;
+        std::vector<float> hist;
+        std::vector<float> norm;
+    };
+
+    // HOG with 18 contrast sensitive, 9 contrast insensitive, 4 texture and 1 truncation channels
+    // (Felzenszwalb et al. with a one cell padding) in single precision.
+    // The gradients and the orientations are computed a row at a time in loops without dependencies between the
+    // pixels, so the compiler vectorises them, only the bilinear histogram votes are scattered.
+    // image is interleaved BGR or single channel, the features are written planar: channel c of cell (x, y) goes to
+    // features[c * planeStride + y * rowStride + x], with (width / sbin) x (height / sbin) cells
+    template <typename T, int Channels>
+    static void computeHOG32F(const T *const image, const size_t imageStride, const int width, const int height,
+                              const float scale, const int sbin, float *const features, const size_t planeStride,
+                              const size_t rowStride)
+    {
+        constexpr int dimHOG = 32;
+        constexpr int numOrient = 18;
+        constexpr int halfOrient = numOrient / 2;
         // epsilon to avoid division by zero
-        const double eps = 0.0001;
-        // number of orientations
-        const int numOrient = 18;
+        constexpr float eps = 0.0001f;
         // unit vectors to compute gradient orientation
-        const double uu[9] = {1.000, 0.9397, 0.7660, 0.5000, 0.1736, -0.1736, -0.5000, -0.7660, -0.9397};
-        const double vv[9] = {0.000, 0.3420, 0.6428, 0.8660, 0.9848, 0.9848, 0.8660, 0.6428, 0.3420};
-
-        // image size
-        const Size imageSize = imageM.size();
-        // block size
-        // int bW = cvRound((double)imageSize.width/(double)sbin);
-        // int bH = cvRound((double)imageSize.height/(double)sbin);
-        int bW = cvFloor((double)imageSize.width / (double)sbin);
-        int bH = cvFloor((double)imageSize.height / (double)sbin);
-        const Size blockSize(bW, bH);
-        // size of HOG features
-        int oW = max(blockSize.width - 2, 0) + 2 * pad_x;
-        int oH = max(blockSize.height - 2, 0) + 2 * pad_y;
-        Size outSize = Size(oW, oH);
-        // size of visible
-        const Size visible = blockSize * sbin;
-
-        // initialize historgram, norm, output feature matrices
-        Mat histM = Mat::zeros(Size(blockSize.width * numOrient, blockSize.height), CV_64F);
-        Mat normM = Mat::zeros(Size(blockSize.width, blockSize.height), CV_64F);
-        featM = Mat::zeros(Size(outSize.width * dimHOG, outSize.height), CV_64F);
-
-        // get the stride of each matrix
-        const size_t imStride = imageM.step1();
-        const size_t histStride = histM.step1();
-        const size_t normStride = normM.step1();
-        const size_t featStride = featM.step1();
-
-        // calculate the zero offset
-        const double *im = imageM.ptr<double>(0);
-        double *const hist = histM.ptr<double>(0);
-        double *const norm = normM.ptr<double>(0);
-        double *const feat = featM.ptr<double>(0);
-
-        for (int y = 1; y < visible.height - 1; y++)
-        {
-            for (int x = 1; x < visible.width - 1; x++)
+        static const float uu[halfOrient] = {1.000f, 0.9397f, 0.7660f, 0.5000f, 0.1736f, -0.1736f, -0.5000f, -0.7660f, -0.9397f};
+        static const float vv[halfOrient] = {0.000f, 0.3420f, 0.6428f, 0.8660f, 0.9848f, 0.9848f, 0.8660f, 0.6428f, 0.3420f};
+
+        const int bW = width / sbin;
+        const int bH = height / sbin;
+        const int visibleW = bW * sbin;
+        const int visibleH = bH * sbin;
+
+        thread_local HOGBuffers buffers;
+        buffers.dx.resize(visibleW);
+        buffers.dy.resize(visibleW);
+        buffers.magnitude.resize(visibleW);
+        buffers.bestDot.resize(visibleW);
+        buffers.orientation.resize(visibleW);
+        buffers.hist.assign((size_t)bW * bH * numOrient, 0.0f);
+        buffers.norm.resize((size_t)bW * bH);
+        float *const dxRow = buffers.dx.data();
+        float *const dyRow = buffers.dy.data();
+        float *const magRow = buffers.magnitude.data();
+        float *const bestDot = buffers.bestDot.data();
+        int *const bestO = buffers.orientation.data();
+        float *const hist = buffers.hist.data();
+        float *const norm = buffers.norm.data();
+        const size_t histStride = (size_t)bW * numOrient;
+
+        const float invSbin = 1.0f / static_cast<float>(sbin);
+        for (int y = 1; y < visibleH - 1; y++)
+        {
+            const T *const row = image + y * imageStride;
+            const T *const rowUp = row - imageStride;
+            const T *const rowDown = row + imageStride;
+            if constexpr (Channels == 1)
             {
-                // OpenCV uses an interleaved format: BGR-BGR-BGR
-                const double *s = im + 3 * min(x, imageM.cols - 2) + min(y, imageM.rows - 2) * imStride;
-
-                // blue image channel
-                double dyb = *(s + imStride) - *(s - imStride);
-                double dxb = *(s + 3) - *(s - 3);
-                double vb = dxb * dxb + dyb * dyb;
-
-                // green image channel
-                s += 1;
-                double dyg = *(s + imStride) - *(s - imStride);
-                double dxg = *(s + 3) - *(s - 3);
-                double vg = dxg * dxg + dyg * dyg;
-
-                // red image channel
-                s += 1;
-                double dy = *(s + imStride) - *(s - imStride);
-                double dx = *(s + 3) - *(s - 3);
-                double v = dx * dx + dy * dy;
-
-                // pick the channel with the strongest gradient
-                if (vg > v)
+                for (int x = 1; x < visibleW - 1; x++)
                 {
-                    v = vg;
-                    dx = dxg;
-                    dy = dyg;
+                    const float dx = static_cast<float>(row[x + 1]) - static_cast<float>(row[x - 1]);
+                    const float dy = static_cast<float>(rowDown[x]) - static_cast<float>(rowUp[x]);
+                    dxRow[x] = dx;
+                    dyRow[x] = dy;
+                    magRow[x] = std::sqrt(dx * dx + dy * dy) * scale;
+                    bestDot[x] = 0.0f;
+                    bestO[x] = 0;
                 }
-                if (vb > v)
+            }
+            else
+            {
+                // strongest gradient of the three channels, red first and then green and blue if they are stronger
+                for (int x = 1; x < visibleW - 1; x++)
                 {
-                    v = vb;
-                    dx = dxb;
-                    dy = dyb;
+                    const float dxb = static_cast<float>(row[3 * x + 3]) - static_cast<float>(row[3 * x - 3]);
+                    const float dyb = static_cast<float>(rowDown[3 * x]) - static_cast<float>(rowUp[3 * x]);
+                    const float dxg = static_cast<float>(row[3 * x + 4]) - static_cast<float>(row[3 * x - 2]);
+                    const float dyg = static_cast<float>(rowDown[3 * x + 1]) - static_cast<float>(rowUp[3 * x + 1]);
+                    const float dxr = static_cast<float>(row[3 * x + 5]) - static_cast<float>(row[3 * x - 1]);
+                    const float dyr = static_cast<float>(rowDown[3 * x + 2]) - static_cast<float>(rowUp[3 * x + 2]);
+                    const float vb = dxb * dxb + dyb * dyb;
+                    const float vg = dxg * dxg + dyg * dyg;
+                    const float vr = dxr * dxr + dyr * dyr;
+
+                    const bool green = vg > vr;
+                    float v = green ? vg : vr;
+                    float dx = green ? dxg : dxr;
+                    float dy = green ? dyg : dyr;
+                    const bool blue = vb > v;
+                    v = blue ? vb : v;
+                    dxRow[x] = blue ? dxb : dx;
+                    dyRow[x] = blue ? dyb : dy;
+                    magRow[x] = std::sqrt(v) * scale;
+                    bestDot[x] = 0.0f;
+                    bestO[x] = 0;
                 }
-
-                // snap to one of the 18 orientations
-                double best_dot = 0;
-                int best_o = 0;
-                for (int o = 0; o < (int)numOrient / 2; o++)
+            }
+            // snap to one of the 18 orientations
+            for (int o = 0; o < halfOrient; o++)
+            {
+                for (int x = 1; x < visibleW - 1; x++)
                 {
-                    double dot = uu[o] * dx + vv[o] * dy;
-                    if (dot > best_dot)
-                    {
-                        best_dot = dot;
-                        best_o = o;
-                    }
-                    else if (-dot > best_dot)
-                    {
-                        best_dot = -dot;
-                        best_o = o + (int)(numOrient / 2);
-                    }
+                    const float dot = uu[o] * dxRow[x] + vv[o] * dyRow[x];
+                    const bool positive = dot > bestDot[x];
+                    const bool negative = !positive && -dot > bestDot[x];
+                    bestDot[x] = positive ? dot : (negative ? -dot : bestDot[x]);
+                    bestO[x] = positive ? o : (negative ? o + halfOrient : bestO[x]);
                 }
+            }
 
-                // add to 4 historgrams around pixel using bilinear interpolation
-                double yp = ((double)y + 0.5) / (double)sbin - 0.5;
-                double xp = ((double)x + 0.5) / (double)sbin - 0.5;
-                int iyp = (int)cvFloor(yp);
-                int ixp = (int)cvFloor(xp);
-                double vy0 = yp - iyp;
-                double vx0 = xp - ixp;
-                double vy1 = 1.0 - vy0;
-                double vx1 = 1.0 - vx0;
-                v = sqrt(v);
+            // add to 4 historgrams around pixel using bilinear interpolation
+            const float yp = (static_cast<float>(y) + 0.5f) * invSbin - 0.5f;
+            const int iyp = cvFloor(yp);
+            const float vy0 = yp - static_cast<float>(iyp);
+            const float vy1 = 1.0f - vy0;
+            for (int x = 1; x < visibleW - 1; x++)
+            {
+                const float xp = (static_cast<float>(x) + 0.5f) * invSbin - 0.5f;
+                const int ixp = cvFloor(xp);
+                const float vx0 = xp - static_cast<float>(ixp);
+                const float vx1 = 1.0f - vx0;
+                const float v = magRow[x];
+                const ptrdiff_t cell = iyp * (ptrdiff_t)histStride + ixp * numOrient + bestO[x];
 
                 // fill the value into the 4 neighborhood cells
                 if (iyp >= 0 && ixp >= 0)
-                    *(hist + iyp * histStride + ixp * numOrient + best_o) += vy1 * vx1 * v;
-
-                if (iyp >= 0 && ixp + 1 < blockSize.width)
-                    *(hist + iyp * histStride + (ixp + 1) * numOrient + best_o) += vx0 * vy1 * v;
-
-                if (iyp + 1 < blockSize.height && ixp >= 0)
-                    *(hist + (iyp + 1) * histStride + ixp * numOrient + best_o) += vy0 * vx1 * v;
-
-                if (iyp + 1 < blockSize.height && ixp + 1 < blockSize.width)
-                    *(hist + (iyp + 1) * histStride + (ixp + 1) * numOrient + best_o) += vy0 * vx0 * v;
-
-            } // for y
-        }     // for x
+                    hist[cell] += vy1 * vx1 * v;
+                if (iyp >= 0 && ixp + 1 < bW)
+                    hist[cell + numOrient] += vx0 * vy1 * v;
+                if (iyp + 1 < bH && ixp >= 0)
+                    hist[cell + histStride] += vy0 * vx1 * v;
+                if (iyp + 1 < bH && ixp + 1 < bW)
+                    hist[cell + histStride + numOrient] += vy0 * vx0 * v;
+            }
+        }
 
         // compute the energy in each block by summing over orientation
-        for (int y = 0; y < blockSize.height; y++)
+        for (size_t c = 0; c < (size_t)bW * bH; c++)
+        {
+            const float *src = hist + c * numOrient;
+            float sum = 0.0f;
+            for (int o = 0; o < halfOrient; o++)
+            {
+                const float h = src[o] + src[o + halfOrient];
+                sum += h * h;
+            }
+            norm[c] = sum;
+        }
+
+        // border cells only have the truncation feature
+        for (int c = 0; c < dimHOG; c++)
         {
-            const double *src = hist + y * histStride;
-            double *dst = norm + y * normStride;
-            double const *const dst_end = dst + blockSize.width;
-            // for each cell
-            while (dst < dst_end)
+            const float value = c == dimHOG - 1 ? 1.0f : 0.0f;
+            for (int y = 0; y < bH; y++)
             {
-                *dst = 0;
-                for (int o = 0; o < (int)(numOrient / 2); o++)
+                float *const dst = features + c * planeStride + y * rowStride;
+                if (y == 0 || y == bH - 1)
                 {
-                    *dst += (*src + *(src + numOrient / 2)) *
-                            (*src + *(src + numOrient / 2));
-                    src++;
+                    std::fill(dst, dst + bW, value);
+                }
+                else if (bW > 0)
+                {
+                    dst[0] = value;
+                    dst[bW - 1] = value;
                 }
-                dst++;
-                src += numOrient / 2;
             }
         }
 
         // compute the features
-        for (int y = pad_y; y < outSize.height - pad_y; y++)
+        for (int y = 1; y < bH - 1; y++)
         {
-            for (int x = pad_x; x < outSize.width - pad_x; x++)
+            for (int x = 1; x < bW - 1; x++)
             {
-                double *dst = feat + y * featStride + x * dimHOG;
-                double *p, n1, n2, n3, n4;
-                const double *src;
-
-                p = norm + (y - pad_y + 1) * normStride + (x - pad_x + 1);
-                n1 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
-                p = norm + (y - pad_y) * normStride + (x - pad_x + 1);
-                n2 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
-                p = norm + (y - pad_y + 1) * normStride + x - pad_x;
-                n3 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
-                p = norm + (y - pad_y) * normStride + x - pad_x;
-                n4 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
-
-                double t1 = 0.0, t2 = 0.0, t3 = 0.0, t4 = 0.0;
+                const float *p = norm + y * bW + x;
+                const float n1 = 1.0f / std::sqrt(p[0] + p[1] + p[bW] + p[bW + 1] + eps);
+                p = norm + (y - 1) * bW + x;
+                const float n2 = 1.0f / std::sqrt(p[0] + p[1] + p[bW] + p[bW + 1] + eps);
+                p = norm + y * bW + x - 1;
+                const float n3 = 1.0f / std::sqrt(p[0] + p[1] + p[bW] + p[bW + 1] + eps);
+                p = norm + (y - 1) * bW + x - 1;
+                const float n4 = 1.0f / std::sqrt(p[0] + p[1] + p[bW] + p[bW + 1] + eps);
+
+                float *const dst = features + y * rowStride + x;
+                const float *const src = hist + y * histStride + x * numOrient;
+                float t1 = 0.0f, t2 = 0.0f, t3 = 0.0f, t4 = 0.0f;
 
                 // contrast-sesitive features
-                src = hist + (y - pad_y + 1) * histStride + (x - pad_x + 1) * numOrient;
                 for (int o = 0; o < numOrient; o++)
                 {
-                    double val = *src;
-                    double h1 = min(val * n1, 0.2);
-                    double h2 = min(val * n2, 0.2);
-                    double h3 = min(val * n3, 0.2);
-                    double h4 = min(val * n4, 0.2);
-                    *(dst++) = 0.5 * (h1 + h2 + h3 + h4);
-
-                    src++;
+                    const float h1 = std::min(src[o] * n1, 0.2f);
+                    const float h2 = std::min(src[o] * n2, 0.2f);
+                    const float h3 = std::min(src[o] * n3, 0.2f);
+                    const float h4 = std::min(src[o] * n4, 0.2f);
+                    dst[o * planeStride] = 0.5f * (h1 + h2 + h3 + h4);
                     t1 += h1;
                     t2 += h2;
                     t3 += h3;
@@ -481,101 +527,204 @@ namespace sky360lib::tracking
                 }
 
                 // contrast-insensitive features
-                src = hist + (y - pad_y + 1) * histStride + (x - pad_x + 1) * numOrient;
-                for (int o = 0; o < numOrient / 2; o++)
+                for (int o = 0; o < halfOrient; o++)
                 {
-                    double sum = *src + *(src + numOrient / 2);
-                    double h1 = min(sum * n1, 0.2);
-                    double h2 = min(sum * n2, 0.2);
-                    double h3 = min(sum * n3, 0.2);
-                    double h4 = min(sum * n4, 0.2);
-                    *(dst++) = 0.5 * (h1 + h2 + h3 + h4);
-                    src++;
+                    const float sum = src[o] + src[o + halfOrient];
+                    const float h1 = std::min(sum * n1, 0.2f);
+                    const float h2 = std::min(sum * n2, 0.2f);
+                    const float h3 = std::min(sum * n3, 0.2f);
+                    const float h4 = std::min(sum * n4, 0.2f);
+                    dst[(numOrient + o) * planeStride] = 0.5f * (h1 + h2 + h3 + h4);
                 }
 
                 // texture features
-                *(dst++) = 0.2357 * t1;
-                *(dst++) = 0.2357 * t2;
-                *(dst++) = 0.2357 * t3;
-                *(dst++) = 0.2357 * t4;
+                dst[(numOrient + halfOrient) * planeStride] = 0.2357f * t1;
+                dst[(numOrient + halfOrient + 1) * planeStride] = 0.2357f * t2;
+                dst[(numOrient + halfOrient + 2) * planeStride] = 0.2357f * t3;
+                dst[(numOrient + halfOrient + 3) * planeStride] = 0.2357f * t4;
                 // truncation feature
-                *dst = 0;
-            } // for x
-        }     // for y
-        // Truncation features
-        for (int m = 0; m < featM.rows; m++)
-        {
-            for (int n = 0; n < featM.cols; n += dimHOG)
-            {
-                if (m > pad_y - 1 && m < featM.rows - pad_y && n > pad_x * dimHOG - 1 && n < featM.cols - pad_x * dimHOG)
-                    continue;
+                dst[(dimHOG - 1) * planeStride] = 0.0f;
+            }
+        }
+    }
 
-                featM.at<double>(m, n + dimHOG - 1) = 1;
-            } // for x
-        }     // for y
+    template <int Channels>
+    static void computeHOG32FDepth(const Mat &im, const int bin_size, float *const feat, const size_t planeStride,
+                              const size_t rowStride)
+    {
+        // The gradient magnitudes are scaled to the [0, 1] range of the pixels, the orientations do not depend on it
+        if (im.depth() == CV_8U)
+        {
+            computeHOG32F<uchar, Channels>(im.ptr<uchar>(0), im.step1(), im.cols, im.rows, 1.0f / 255.0f, bin_size,
+                                           feat, planeStride, rowStride);
+        }
+        else if (im.depth() == CV_16U)
+        {
+            computeHOG32F<ushort, Channels>(im.ptr<ushort>(0), im.step1(), im.cols, im.rows, 1.0f / 65535.0f, bin_size,
+                                            feat, planeStride, rowStride);
+        }
+        else if (im.depth() == CV_32F)
+        {
+            // float patches hold 8 bit values
+            computeHOG32F<float, Channels>(im.ptr<float>(0), im.step1(), im.cols, im.rows, 1.0f / 255.0f, bin_size,
+                                           feat, planeStride, rowStride);
+        }
+        else
+        {
+            Mat im_;
+            im.convertTo(im_, CV_32F);
+            computeHOG32F<float, Channels>(im_.ptr<float>(0), im_.step1(), im_.cols, im_.rows, 1.0f / 255.0f, bin_size,
+                                           feat, planeStride, rowStride);
+        }
     }
 
     std::vector<Mat> get_features_hog(const Mat &im, const int bin_size)
     {
         Mat hogmatrix;
-        Mat im_;
-        im.convertTo(im_, CV_64FC3, 1.0 / 255.0);
-        computeHOG32D(im_, hogmatrix, bin_size, 1, 1);
-        hogmatrix.convertTo(hogmatrix, CV_32F);
-        Size hog_size = im.size();
-        hog_size.width /= bin_size;
-        hog_size.height /= bin_size;
-        Mat hogc(hog_size, CV_32FC(32), hogmatrix.data);
         std::vector<Mat> features;
-        split(hogc, features);
+        get_features_hog(im, bin_size, hogmatrix, features);
         return features;
     }
 
-    std::vector<Mat> get_features_cn(const Mat &ppatch_data, const Size &output_size)
+    void get_features_hog(const Mat &im, const int bin_size, Mat &hogmatrix, std::vector<Mat> &features)
     {
-        Mat patch_data = ppatch_data.clone();
-        Vec3b &pixel = patch_data.at<Vec3b>(0, 0);
-        unsigned index;
+        CV_Assert(im.channels() == 3 || im.channels() == 1);
+        CV_Assert(bin_size > 0);
+        constexpr int dimHOG = 32;
+        const int bW = im.cols / bin_size;
+        const int bH = im.rows / bin_size;
+
+        // All the channels in one buffer, every channel is a continuous bW x bH view of it
+        hogmatrix.create(dimHOG * bH, bW, CV_32F);
+        float *const feat = hogmatrix.ptr<float>(0);
+        const size_t planeStride = (size_t)bW * bH;
+        if (im.channels() == 1)
+        {
+            computeHOG32FDepth<1>(im, bin_size, feat, planeStride, bW);
+        }
+        else
+        {
+            computeHOG32FDepth<3>(im, bin_size, feat, planeStride, bW);
+        }
 
-        Mat cnFeatures = Mat::zeros(patch_data.rows, patch_data.cols, CV_32FC(10));
+        features.resize(dimHOG);
+        for (int c = 0; c < dimHOG; c++)
+        {
+            features[c] = hogmatrix.rowRange(c * bH, (c + 1) * bH);
+        }
+    }
 
-        for (int i = 0; i < patch_data.rows; i++)
+    // ColorNames with one plane per name, so each output plane gathers from a single 128 KB table
+    static const float *get_color_names_planes()
+    {
+        constexpr int numColors = 32 * 32 * 32;
+        constexpr int numNames = 10;
+        static const std::vector<float> planes = []
         {
-            for (int j = 0; j < patch_data.cols; j++)
+            std::vector<float> table((size_t)numColors * numNames);
+            for (int index = 0; index < numColors; index++)
             {
-                pixel = patch_data.at<Vec3b>(i, j);
-                index = (unsigned)(cvFloor((float)pixel[2] / 8) + 32 * cvFloor((float)pixel[1] / 8) + 32 * 32 * cvFloor((float)pixel[0] / 8));
+                for (int k = 0; k < numNames; k++)
+                {
+                    table[(size_t)k * numColors + index] = ColorNames[index][k];
+                }
+            }
+            return table;
+        }();
+        return planes.data();
+    }
+
+    std::vector<Mat> get_features_cn(const Mat &ppatch_data, const Size &output_size)
+    {
+        Mat buffer;
+        std::vector<Mat> features;
+        get_features_cn(ppatch_data, output_size, buffer, features);
+        return features;
+    }
 
-                // copy the values
-                for (int k = 0; k < 10; k++)
+    void get_features_cn(const Mat &ppatch_data, const Size &output_size, Mat &buffer, std::vector<Mat> &result)
+    {
+        CV_Assert(ppatch_data.type() == CV_8UC3);
+        constexpr int numColors = 32 * 32 * 32;
+        constexpr int numNames = 10;
+        const float *const table = get_color_names_planes();
+        const int rows = ppatch_data.rows;
+        const int cols = ppatch_data.cols;
+
+        // All the names in one buffer, every name is a continuous view of it. The names are computed straight
+        // into the output buffer when they do not need to be resized
+        const bool resized = output_size.width > 0 && output_size.height > 0 && output_size != ppatch_data.size();
+        thread_local Mat patchNames;
+        Mat &cnFeatures = resized ? patchNames : buffer;
+        cnFeatures.create(numNames * rows, cols, CV_32F);
+        thread_local std::vector<int> indexes;
+        indexes.resize(cols);
+        int *const index = indexes.data();
+        for (int i = 0; i < rows; i++)
+        {
+            // 5 bits per channel, red in the low bits
+            const uchar *const pixel = ppatch_data.ptr<uchar>(i);
+            for (int j = 0; j < cols; j++)
+            {
+                index[j] = (pixel[3 * j + 2] >> 3) | ((pixel[3 * j + 1] >> 3) << 5) | ((pixel[3 * j] >> 3) << 10);
+            }
+            for (int k = 0; k < numNames; k++)
+            {
+                const float *const names = table + (size_t)k * numColors;
+                float *const dst = cnFeatures.ptr<float>(k * rows + i);
+                for (int j = 0; j < cols; j++)
                 {
-                    cnFeatures.at<Vec<float, 10>>(i, j)[k] = (float)ColorNames[index][k];
+                    dst[j] = names[index[j]];
                 }
             }
         }
-        std::vector<Mat> result;
-        split(cnFeatures, result);
-        for (size_t i = 0; i < result.size(); i++)
+
+        result.resize(numNames);
+        if (resized)
         {
-            if (output_size.width > 0 && output_size.height > 0)
+            // resize writes straight into the planes of the output buffer as they already have its size and type
+            buffer.create(numNames * output_size.height, output_size.width, CV_32F);
+            for (int k = 0; k < numNames; k++)
             {
-                resize(result.at(i), result.at(i), output_size, INTER_CUBIC);
+                result[k] = buffer.rowRange(k * output_size.height, (k + 1) * output_size.height);
+                resize(cnFeatures.rowRange(k * rows, (k + 1) * rows), result[k], output_size, 0, 0, INTER_CUBIC);
+            }
+        }
+        else
+        {
+            for (int k = 0; k < numNames; k++)
+            {
+                result[k] = cnFeatures.rowRange(k * rows, (k + 1) * rows);
             }
         }
-        return result;
     }
 
     std::vector<Mat> get_features_rgb(const Mat &patch, const Size &output_size)
     {
-        std::vector<Mat> channels;
-        split(patch, channels);
-        for (size_t k = 0; k < channels.size(); k++)
+        Mat buffer;
+        std::vector<Mat> features;
+        get_features_rgb(patch, output_size, buffer, features);
+        return features;
+    }
+
+    void get_features_rgb(const Mat &patch, const Size &output_size, Mat &buffer, std::vector<Mat> &features)
+    {
+        // Every channel scaled to [-0.5, 0.5] and centred on its mean, then resized bilinearly
+        thread_local Mat converted;
+        thread_local Mat resized;
+        patch.convertTo(converted, CV_32F, 1.0 / pixel_range(patch.depth()), -0.5);
+        subtract(converted, mean(converted), converted);
+        resize(converted, resized, output_size);
+
+        const int channels = patch.channels();
+        buffer.create(channels * output_size.height, output_size.width, CV_32F);
+        features.resize(channels);
+        for (int k = 0; k < channels; k++)
         {
-            channels[k].convertTo(channels[k], CV_32F, 1.0 / 255.0, -0.5);
-            channels[k] = channels[k] - mean(channels[k])[0];
-            resize(channels[k], channels[k], output_size, INTER_CUBIC);
+            features[k] = buffer.rowRange(k * output_size.height, (k + 1) * output_size.height);
         }
-        return channels;
+        // split writes into the views as they already have the size and type of its outputs
+        split(resized, features.data());
     }
 
     double get_max(const Mat &m)
@@ -592,14 +741,58 @@ namespace sky360lib::tracking
         return val;
     }
 
+    // Hue of an 8 bit HSV image from 0-180 to 0-255 in place, rounded as convertTo does
+    static void scale_hue(Mat &hsv_img)
+    {
+        const float hue_scale = 255.0f / 180.0f;
+        for (int y = 0; y < hsv_img.rows; y++)
+        {
+            uchar *pixel = hsv_img.ptr<uchar>(y);
+            for (int x = 0; x < hsv_img.cols; x++)
+            {
+                pixel[3 * x] = saturate_cast<uchar>(pixel[3 * x] * hue_scale);
+            }
+        }
+    }
+
+    Mat get_segmentation_image(const Mat &img)
+    {
+        Mat buffer;
+        return get_segmentation_image(img, buffer);
+    }
+
+    const Mat &get_segmentation_image(const Mat &img, Mat &buffer)
+    {
+        if (img.depth() == CV_8U && img.channels() == 1)
+        {
+            return img;
+        }
+        // the histograms work on 8 bit values
+        const double scale = 255.0 / pixel_range(img.depth());
+        if (img.channels() == 1)
+        {
+            img.convertTo(buffer, CV_8U, scale);
+            return buffer;
+        }
+        if (img.depth() == CV_8U)
+        {
+            cvtColor(img, buffer, COLOR_BGR2HSV);
+        }
+        else
+        {
+            thread_local Mat img8;
+            img.convertTo(img8, CV_8U, scale);
+            cvtColor(img8, buffer, COLOR_BGR2HSV);
+        }
+        scale_hue(buffer);
+        return buffer;
+    }
+
     Mat bgr2hsv(const Mat &img)
     {
         Mat hsv_img;
         cvtColor(img, hsv_img, COLOR_BGR2HSV);
-        std::vector<Mat> hsv_img_channels;
-        split(hsv_img, hsv_img_channels);
-        hsv_img_channels.at(0).convertTo(hsv_img_channels.at(0), CV_8UC1, 255.0 / 180.0);
-        merge(hsv_img_channels, hsv_img);
+        scale_hue(hsv_img);
         return hsv_img;
     }
 
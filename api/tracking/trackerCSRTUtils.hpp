@@ -22,9 +22,15 @@ namespace sky360lib::tracking
     Mat circshift(Mat matrix, int dx, int dy);
     Mat gaussian_shaped_labels(const float sigma, const int w, const int h);
     std::vector<Mat> fourier_transform_features(const std::vector<Mat> &M);
+    void fourier_transform_features(const std::vector<Mat> &M, std::vector<Mat> &out);
     Mat divide_complex_matrices(const Mat &A, const Mat &B);
+    // dst = A / (B + b_offset), b_offset only added to the real part. dst is reused when it has the size and type
+    void divide_complex_matrices(const Mat &A, const Mat &B, const float b_offset, Mat &dst);
     Mat get_subwindow(const Mat &image, const Point2f center,
                       const int w, const int h, Rect *valid_pixels = NULL);
+    // Same window written to subwin, which is reused when it has the size and type
+    void get_subwindow(const Mat &image, const Point2f center,
+                       const int w, const int h, Mat &subwin, Rect *valid_pixels = NULL);
 
     float subpixel_peak(const Mat &response, const std::string &s, const Point2f &p);
     double get_max(const Mat &m);
@@ -35,8 +41,24 @@ namespace sky360lib::tracking
     Mat get_chebyshev_win(Size sz, float attenuation);
 
     std::vector<Mat> get_features_rgb(const Mat &patch, const Size &output_size);
+    // im is BGR or single channel, 8 or 16 bits or float with 8 bit values
     std::vector<Mat> get_features_hog(const Mat &im, const int bin_size);
     std::vector<Mat> get_features_cn(const Mat &im, const Size &output_size);
+    // The features as views of buffer, which is reused with the views in features when they have the same size,
+    // so extracting them every frame from patches of the same size does not allocate
+    void get_features_rgb(const Mat &patch, const Size &output_size, Mat &buffer, std::vector<Mat> &features);
+    void get_features_hog(const Mat &im, const int bin_size, Mat &buffer, std::vector<Mat> &features);
+    void get_features_cn(const Mat &im, const Size &output_size, Mat &buffer, std::vector<Mat> &features);
 
     Mat bgr2hsv(const Mat &img);
+    // Image the segmentation histograms are built on: HSV for BGR, the 8 bit intensity for single channel images
+    Mat get_segmentation_image(const Mat &img);
+    // Same image, written to buffer (reused when it has the size and type) unless img already is 8 bit intensity
+    const Mat &get_segmentation_image(const Mat &img, Mat &buffer);
+
+    // Largest value of the pixels of an image of this depth, 16 bit frames keep their full range
+    inline double pixel_range(int depth)
+    {
+        return depth == CV_16U ? 65535.0 : 255.0;
+    }
 }
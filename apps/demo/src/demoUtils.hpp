@@ -2,6 +2,9 @@
 
 #include <opencv2/videoio.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 inline double bbox_overlap(const cv::Rect& bbox1, const cv::Rect& bbox2)
 {
     // determine the coordinates of the intersection rectangle
@@ -40,13 +43,14 @@ inline bool bbox1_contain_bbox2(const cv::Rect& bbox1, const cv::Rect& bbox2)
 // Utility function to convert key points in to a bounding box
 // The bounding box is used for track validation (if enabled) and will be displayed by the visualiser
 // as it tracks a point of interest (blob) on the frame
+// The keypoints from the blob detector are centred on the blob and sized to it, so the box is the square around them
 inline cv::Rect kp_to_bbox(const cv::KeyPoint &kp)
 {
-    static const float scale = 20.0f;
-    return cv::Rect((int)(kp.pt.x - (scale * kp.size * 0.5f)),
-                    (int)(kp.pt.y - (scale * kp.size * 0.5f)),
-                    (int)(scale * kp.size),
-                    (int)(scale * kp.size));
+    const int size = std::max(1, (int)std::ceil(kp.size));
+    return cv::Rect((int)std::lround(kp.pt.x - size * 0.5f),
+                    (int)std::lround(kp.pt.y - size * 0.5f),
+                    size,
+                    size);
 }
 
 inline size_t calc_centre_point_distance(const cv::Rect& bbox1, const cv::Rect& bbox2)
@@ -2,8 +2,10 @@
 
 #include <opencv2/videoio.hpp>
 
+#include <algorithm>
 #include <vector>
 
+#include "tracker.hpp"
 #include "demoUtils.hpp"
 #include "demoTracker.hpp"
 
@@ -69,25 +71,32 @@ public:
     // function to create trackers from extracted keypoints
     void create_trackers_from_keypoints(const std::vector<cv::KeyPoint> &key_points, const cv::Mat &frame)
     {
+        m_new_bboxes.clear();
         for (const cv::KeyPoint &kp : key_points)
         {
             cv::Rect bbox = kp_to_bbox(kp);
 
             // Initialize tracker with first frame and bounding box
-            if (!is_bbox_being_tracked(m_live_trackers, bbox))
-                create_and_add_tracker(frame, bbox);
+            if (!is_bbox_being_tracked(m_live_trackers, bbox) && !is_bbox_being_added(bbox))
+                m_new_bboxes.push_back(bbox);
         }
+        add_trackers(frame);
     }
 
-    // function to create an add the tracker to the list of active trackers
-    void create_and_add_tracker(const cv::Mat &frame, const cv::Rect &bbox)
+    // function to start tracking m_new_bboxes from the frame and add their trackers to the list of active trackers
+    void add_trackers(const cv::Mat &frame)
     {
-        ++m_total_trackers_started;
+        if (m_new_bboxes.empty())
+            return;
 
-        DemoTracker tracker(m_settings.trackerSettings, m_total_trackers_started, frame, bbox);
-        cv::Rect retBbox;
-        tracker.update(frame, retBbox);
-        m_live_trackers.push_back(tracker);
+        m_multi_tracker.addTargets(frame, m_new_bboxes);
+        // The new targets are the last ones of the multi tracker
+        const std::vector<MultiTracker::Target> &targets = m_multi_tracker.getTargets();
+        for (size_t i = targets.size() - m_new_bboxes.size(); i < targets.size(); ++i)
+        {
+            ++m_total_trackers_started;
+            m_live_trackers.emplace_back(m_settings.trackerSettings, targets[i].id, targets[i].bbox);
+        }
     }
 
     struct compareRect
@@ -101,18 +110,32 @@ public:
     };
 
     // function to update existing trackers and if a target is not tracked then create a new tracker to track the target
-    // trackers are run on seperate threads in the hope to speed up the applicaiton by taking advantage of parallelism
+    // the multi tracker runs the trackers in parallel
     void update_trackers(const std::vector<cv::Rect> &bboxes, const cv::Mat &frame)
     {
         std::vector<cv::Rect> unmatched_bboxes(bboxes);
-        std::vector<DemoTracker*> failed_trackers;
-        //int tracker_count = m_live_trackers.size();
+        m_multi_tracker.update(frame);
+
+        // remove the trackers that lost their target
+        for (int id : m_multi_tracker.getLostTargets())
+            remove_live_tracker(id);
 
-        for (DemoTracker tracker : m_live_trackers)
+        // validate the targets, the ones that stayed still for too long are dropped
+        m_dropped_targets.clear();
+        for (const MultiTracker::Target &target : m_multi_tracker.getTargets())
         {
-            cv::Rect retBbox;
-            if (!tracker.update(frame, retBbox))
-                failed_trackers.push_back(&tracker);
+            if (!find_live_tracker(target.id).update(target.bbox))
+                m_dropped_targets.push_back(target.id);
+        }
+        for (int id : m_dropped_targets)
+        {
+            m_multi_tracker.removeTarget(id);
+            remove_live_tracker(id);
+        }
+
+        for (const MultiTracker::Target &target : m_multi_tracker.getTargets())
+        {
+            const cv::Rect &retBbox = target.bbox;
             for (const cv::Rect &new_bbox : bboxes)
             {
                 auto bboxIt = std::find_if(unmatched_bboxes.begin(), unmatched_bboxes.end(), compareRect(new_bbox));
@@ -126,22 +149,16 @@ public:
                 }
             }
         }
-        // remove failed trackers from live tracking
-        for (DemoTracker* trackerPtr : failed_trackers)
-        {
-            auto trackerIt = std::find_if(m_live_trackers.begin(), m_live_trackers.end(), 
-                [trackerPtr](DemoTracker t){ return &t == trackerPtr;});
-            m_live_trackers.erase(trackerIt);
-            ++m_total_trackers_finished;
-        }
         // Add new detections to live tracker
+        m_new_bboxes.clear();
         for (const cv::Rect &new_bbox : unmatched_bboxes)
         {
             // Hit max trackers?
-            if (m_live_trackers.size() < m_settings.max_active_trackers)
-                if (!is_bbox_being_tracked(m_live_trackers, new_bbox))
-                    create_and_add_tracker(frame, new_bbox);
+            if (m_live_trackers.size() + m_new_bboxes.size() < m_settings.max_active_trackers)
+                if (!is_bbox_being_tracked(m_live_trackers, new_bbox) && !is_bbox_being_added(new_bbox))
+                    m_new_bboxes.push_back(new_bbox);
         }
+        add_trackers(frame);
     }
 
     // // function to initialise objects, using cuda streams apparently its important to allocated memory once versus over and over
@@ -265,10 +282,43 @@ public:
 
 
 private:
+    using MultiTracker = sky360lib::tracking::MultiTracker;
+
     Settings m_settings;
     int m_total_trackers_finished;
     int m_total_trackers_started;
+    MultiTracker m_multi_tracker;
+    // Validation state of the targets of the multi tracker, found by id
     std::vector<DemoTracker> m_live_trackers;
+    // Kept between frames
+    std::vector<cv::Rect> m_new_bboxes;
+    std::vector<int> m_dropped_targets;
+
+    DemoTracker &find_live_tracker(int id)
+    {
+        return *std::find_if(m_live_trackers.begin(), m_live_trackers.end(),
+                             [id](const DemoTracker &t) { return t.get_id() == id; });
+    }
+
+    void remove_live_tracker(int id)
+    {
+        DemoTracker &tracker = find_live_tracker(id);
+        if (&tracker != &m_live_trackers.back())
+            tracker = std::move(m_live_trackers.back());
+        m_live_trackers.pop_back();
+        ++m_total_trackers_finished;
+    }
+
+    // a detection overlapping one already picked this frame is the same target
+    bool is_bbox_being_added(const cv::Rect &bbox) const
+    {
+        for (const cv::Rect &new_bbox : m_new_bboxes)
+        {
+            if (bbox1_contain_bbox2(new_bbox, bbox) || bbox_overlap(new_bbox, bbox) > 0)
+                return true;
+        }
+        return false;
+    }
 };
 
 inline bool is_bbox_being_tracked(const std::vector<DemoTracker> &live_trackers, const cv::Rect &bbox)
@@ -31,6 +31,9 @@ enum BGSType
     Vibe,
     WMV,
     WMVCL
+#ifdef SKY360_USE_HALIDE
+    ,WMVHalide
+#endif
 };
 std::unique_ptr<sky360lib::bgs::CoreBgs> bgsPtr{nullptr};
 
@@ -76,6 +79,7 @@ int main(int argc, const char **argv)
     std::cout << "Available number of concurrent threads = " << std::thread::hardware_concurrency() << std::endl;
 
     bgsPtr = createBGS(BGSType::WMV);
+    bgsPtr->setTrackDirtyRows(true);
     cv::VideoCapture cap;
 
     if (argc > 1)
@@ -211,7 +215,19 @@ std::unique_ptr<sky360lib::bgs::CoreBgs> createBGS(BGSType _type)
     case BGSType::WMV:
         return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
     case BGSType::WMVCL:
-        return std::make_unique<sky360lib::bgs::WeightedMovingVarianceCL>();
+        try
+        {
+            return std::make_unique<sky360lib::bgs::WeightedMovingVarianceCL>();
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << e.what() << ", falling back to WMV on the CPU" << std::endl;
+            return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
+        }
+#ifdef SKY360_USE_HALIDE
+    case BGSType::WMVHalide:
+        return std::make_unique<sky360lib::bgs::WeightedMovingVarianceHalide>();
+#endif
     default:
         return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
     }
@@ -272,7 +288,7 @@ inline void findBlobs(const cv::Mat &image, std::vector<cv::Rect> &blobs)
 {
     EASY_FUNCTION(profiler::colors::Blue);
 
-    blobDetector.detect(image, blobs);
+    blobDetector.detect(image, blobs, &bgsPtr->getDirtyRows());
 }
 
 int getIntArg(std::string arg)
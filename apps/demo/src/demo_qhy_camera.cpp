@@ -6,6 +6,7 @@
 #include <easy/profiler.h>
 
 #include "qhyCamera.hpp"
+#include "autoStretch.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/ocl.hpp>
@@ -32,7 +33,9 @@ enum BGSType
     Vibe,
     WMV,
     WMVCL
-    //,WMVHalide
+#ifdef SKY360_USE_HALIDE
+    ,WMVHalide
+#endif
 };
 std::unique_ptr<sky360lib::bgs::CoreBgs> bgsPtr{nullptr};
 
@@ -43,6 +46,9 @@ sky360lib::blobs::ConnectedBlobDetection blobDetector;
 /////////////////////////////////////////////////////////////
 // Camera Detector
 sky360lib::camera::QHYCamera qhyCamera;
+// 16 bit frames are stretched to 8 bits for processing, display and recording
+sky360lib::camera::AutoStretch autoStretch;
+cv::Mat rawFrame;
 
 /////////////////////////////////////////////////////////////
 // Function Definitions
@@ -50,7 +56,7 @@ std::unique_ptr<sky360lib::bgs::CoreBgs> createBGS(BGSType _type);
 inline void appyPreProcess(const cv::Mat &input, cv::Mat &output);
 inline void appyBGS(const cv::Mat &input, cv::Mat &output);
 inline void drawBboxes(std::vector<cv::KeyPoint> &keypoints, const cv::Mat &frame);
-inline std::vector<cv::Rect> findBlobs(const cv::Mat &image);
+inline void findBlobs(const cv::Mat &image, std::vector<cv::Rect> &blobs);
 inline void drawBboxes(std::vector<cv::Rect> &keypoints, const cv::Mat &frame);
 inline void outputBoundingBoxes(std::vector<cv::Rect> &bboxes);
 bool openQQYCamera();
@@ -77,6 +83,7 @@ int main(int argc, const char **argv)
     std::cout << "Available number of concurrent threads = " << concurrentThreads << std::endl;
 
     bgsPtr = createBGS(BGSType::WMV);
+    bgsPtr->setTrackDirtyRows(true);
 
     if (cv::ocl::haveOpenCL())
     {
@@ -128,7 +135,7 @@ int main(int argc, const char **argv)
             appyPreProcess(frame, processedFrame);
             appyBGS(processedFrame, bgsMask);
             if (doBlobDetection)
-                bboxes = findBlobs(bgsMask);
+                findBlobs(bgsMask, bboxes);
             double endProcessedTime = getAbsoluteTime();
             EASY_END_BLOCK;
             EASY_BLOCK("Drawing bboxes");
@@ -233,9 +240,19 @@ std::unique_ptr<sky360lib::bgs::CoreBgs> createBGS(BGSType _type)
     case BGSType::WMV:
         return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
     case BGSType::WMVCL:
-        return std::make_unique<sky360lib::bgs::WeightedMovingVarianceCL>();
-    // case BGSType::WMVHalide:
-    //     return std::make_unique<sky360lib::bgs::WeightedMovingVarianceHalide>();
+        try
+        {
+            return std::make_unique<sky360lib::bgs::WeightedMovingVarianceCL>();
+        }
+        catch (const std::runtime_error &e)
+        {
+            std::cout << e.what() << ", falling back to WMV on the CPU" << std::endl;
+            return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
+        }
+#ifdef SKY360_USE_HALIDE
+    case BGSType::WMVHalide:
+        return std::make_unique<sky360lib::bgs::WeightedMovingVarianceHalide>();
+#endif
     default:
         return std::make_unique<sky360lib::bgs::WeightedMovingVariance>();
     }
@@ -286,14 +303,11 @@ inline void drawBboxes(std::vector<cv::Rect> &bboxes, const cv::Mat &frame)
 }
 
 // Finds the connected components in the image and returns a list of bounding boxes
-inline std::vector<cv::Rect> findBlobs(const cv::Mat &image)
+inline void findBlobs(const cv::Mat &image, std::vector<cv::Rect> &blobs)
 {
     EASY_FUNCTION(profiler::colors::Blue);
 
-    std::vector<cv::Rect> blobs;
-    blobDetector.detect(image, blobs);
-
-    return blobs;
+    blobDetector.detect(image, blobs, &bgsPtr->getDirtyRows());
 }
 
 bool openQQYCamera()
@@ -323,7 +337,11 @@ bool openQQYCamera()
 
 inline bool getQhyCameraImage(cv::Mat &cameraFrame)
 {
-    return qhyCamera.getFrame(cameraFrame, true);
+    if (!qhyCamera.getFrame(rawFrame, true))
+    {
+        return false;
+    }
+    return autoStretch.apply(rawFrame, cameraFrame);
 }
 
 bool openVideo(const cv::Mat &frame)
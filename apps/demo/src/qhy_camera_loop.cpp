@@ -6,6 +6,7 @@
 #include <easy/profiler.h>
 
 #include "qhyCamera.hpp"
+#include "autoStretch.hpp"
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/videoio.hpp>
@@ -21,6 +22,9 @@ cv::VideoWriter videoWriter;
 /////////////////////////////////////////////////////////////
 // Camera Detector
 sky360lib::camera::QHYCamera qhyCamera;
+// 16 bit frames are stretched to 8 bits for processing, display and recording
+sky360lib::camera::AutoStretch autoStretch;
+cv::Mat rawFrame;
 
 /////////////////////////////////////////////////////////////
 // Function Definitions
@@ -172,7 +176,11 @@ bool openQQYCamera()
 
 inline bool getQhyCameraImage(cv::Mat &cameraFrame)
 {
-    return qhyCamera.getFrame(cameraFrame, true);
+    if (!qhyCamera.getFrame(rawFrame, true))
+    {
+        return false;
+    }
+    return autoStretch.apply(rawFrame, cameraFrame);
 }
 
 bool openVideo(const cv::Mat &frame)
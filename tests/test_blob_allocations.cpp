@@ -0,0 +1,199 @@
+// Counts the heap allocations of ConnectedBlobDetection: after a warm-up pass over the frames, detecting on the same
+// frames again must not allocate, in both mask formats, with and without dirty rows and an intensity image.
+// operator new and the OpenCV Mat allocator are both hooked, so vector growth and Mat buffers are counted.
+
+#include "connectedBlobDetection.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <vector>
+
+using namespace sky360lib;
+using namespace sky360lib::blobs;
+
+static std::atomic<bool> g_countAllocations{false};
+static std::atomic<size_t> g_numAllocations{0};
+
+static void *countedAlloc(std::size_t _size)
+{
+    if (g_countAllocations.load(std::memory_order_relaxed))
+    {
+        g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    void *const ptr{std::malloc(_size == 0 ? 1 : _size)};
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static void *countedAlignedAlloc(std::size_t _size, std::align_val_t _alignment)
+{
+    if (g_countAllocations.load(std::memory_order_relaxed))
+    {
+        g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    const std::size_t alignment{(std::size_t)_alignment};
+    void *const ptr{std::aligned_alloc(alignment, (_size + alignment - 1) / alignment * alignment)};
+    if (ptr == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void *operator new(std::size_t _size) { return countedAlloc(_size); }
+void *operator new[](std::size_t _size) { return countedAlloc(_size); }
+void *operator new(std::size_t _size, std::align_val_t _alignment) { return countedAlignedAlloc(_size, _alignment); }
+void *operator new[](std::size_t _size, std::align_val_t _alignment) { return countedAlignedAlloc(_size, _alignment); }
+void operator delete(void *_ptr) noexcept { std::free(_ptr); }
+void operator delete[](void *_ptr) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::size_t) noexcept { std::free(_ptr); }
+void operator delete[](void *_ptr, std::size_t) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::align_val_t) noexcept { std::free(_ptr); }
+void operator delete[](void *_ptr, std::align_val_t) noexcept { std::free(_ptr); }
+void operator delete(void *_ptr, std::size_t, std::align_val_t) noexcept { std::free(_ptr); }
+void operator delete[](void *_ptr, std::size_t, std::align_val_t) noexcept { std::free(_ptr); }
+
+/// Mat buffers come from cv::fastMalloc and not operator new, they are counted through the default Mat allocator
+class CountingMatAllocator final : public cv::MatAllocator
+{
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *_allocator)
+        : m_allocator{_allocator}
+    {
+    }
+
+    cv::UMatData *allocate(int _dims, const int *_sizes, int _type, void *_data, size_t *_step,
+                           cv::AccessFlag _flags, cv::UMatUsageFlags _usageFlags) const override
+    {
+        if (_data == nullptr && g_countAllocations.load(std::memory_order_relaxed))
+        {
+            g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return m_allocator->allocate(_dims, _sizes, _type, _data, _step, _flags, _usageFlags);
+    }
+
+    bool allocate(cv::UMatData *_data, cv::AccessFlag _accessFlags, cv::UMatUsageFlags _usageFlags) const override
+    {
+        return m_allocator->allocate(_data, _accessFlags, _usageFlags);
+    }
+
+    void deallocate(cv::UMatData *_data) const override
+    {
+        m_allocator->deallocate(_data);
+    }
+
+private:
+    cv::MatAllocator *m_allocator;
+};
+
+static const int NUM_FRAMES{8};
+static const cv::Size FRAME_SIZE{640, 360};
+
+struct Frame
+{
+    cv::Mat mask;
+    cv::Mat packedMask;
+    cv::Mat intensity;
+    std::vector<cv::Range> dirtyRows;
+};
+
+static std::vector<Frame> makeFrames()
+{
+    cv::RNG rng{0xb10b5};
+    std::vector<Frame> frames(NUM_FRAMES);
+    for (int f{0}; f < NUM_FRAMES; ++f)
+    {
+        Frame &frame{frames[f]};
+        frame.mask = cv::Mat::zeros(FRAME_SIZE, CV_8UC1);
+        frame.intensity.create(FRAME_SIZE, CV_16UC1);
+        rng.fill(frame.intensity, cv::RNG::UNIFORM, 0.0, 4096.0);
+        // A different number of blobs in every frame, the busiest one is not the first
+        const int numBlobs{10 + ((f * 37) % NUM_FRAMES) * 12};
+        for (int i{0}; i < numBlobs; ++i)
+        {
+            const cv::Point center{rng.uniform(0, FRAME_SIZE.width), rng.uniform(0, FRAME_SIZE.height)};
+            cv::circle(frame.mask, center, rng.uniform(2, 9), cv::Scalar(255), cv::FILLED);
+        }
+        frame.packedMask.create(FRAME_SIZE.height, packedMaskWidth(FRAME_SIZE.width), CV_8UC1);
+        packMask(frame.mask, frame.packedMask);
+        for (int y{0}; y < FRAME_SIZE.height; ++y)
+        {
+            if (maskRowHasForeground(frame.mask.ptr<uint8_t>(y), FRAME_SIZE.width))
+            {
+                if (!frame.dirtyRows.empty() && frame.dirtyRows.back().end == y)
+                {
+                    ++frame.dirtyRows.back().end;
+                }
+                else
+                {
+                    frame.dirtyRows.emplace_back(y, y + 1);
+                }
+            }
+        }
+    }
+    return frames;
+}
+
+static bool runCase(const char *_name, MaskFormat _maskFormat, bool _useDirtyRows, const std::vector<Frame> &_frames)
+{
+    ConnectedBlobDetection detector;
+    detector.setMaskFormat(_maskFormat);
+    std::vector<cv::Rect> bboxes;
+    std::vector<cv::KeyPoint> keyPoints;
+    std::vector<Blob> blobs;
+
+    const auto detectAll = [&](const Frame &_frame)
+    {
+        const cv::Mat &mask{_maskFormat == MaskFormat::PackedBits ? _frame.packedMask : _frame.mask};
+        const std::vector<cv::Range> *dirtyRows{_useDirtyRows ? &_frame.dirtyRows : nullptr};
+        detector.detect(mask, bboxes, dirtyRows);
+        detector.detectKP(mask, keyPoints, dirtyRows);
+        detector.detectBlobs(mask, blobs, _frame.intensity, dirtyRows);
+    };
+
+    for (const Frame &frame : _frames)
+    {
+        detectAll(frame);
+    }
+
+    g_numAllocations = 0;
+    g_countAllocations = true;
+    for (int f{NUM_FRAMES - 1}; f >= 0; --f)
+    {
+        detectAll(_frames[f]);
+    }
+    g_countAllocations = false;
+
+    if (g_numAllocations > 0)
+    {
+        std::cerr << _name << ": " << g_numAllocations << " allocations after the warm-up" << std::endl;
+        return false;
+    }
+    std::cout << _name << ": ok" << std::endl;
+    return true;
+}
+
+int main()
+{
+    CountingMatAllocator matAllocator{cv::Mat::getStdAllocator()};
+    cv::Mat::setDefaultAllocator(&matAllocator);
+
+    const std::vector<Frame> frames{makeFrames()};
+
+    bool passed{true};
+    passed = runCase("bytes", MaskFormat::Bytes, false, frames) && passed;
+    passed = runCase("bytes dirty rows", MaskFormat::Bytes, true, frames) && passed;
+    passed = runCase("packed", MaskFormat::PackedBits, false, frames) && passed;
+    passed = runCase("packed dirty rows", MaskFormat::PackedBits, true, frames) && passed;
+
+    cv::Mat::setDefaultAllocator(nullptr);
+    return passed ? 0 : 1;
+}
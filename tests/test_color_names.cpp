@@ -0,0 +1,104 @@
+// Compares the Color Names features of the CSRT tracker (get_features_cn) with the per pixel implementation
+// they replaced, over random 8 bit BGR patches, without a resize and resized to several sizes.
+// Both gather the same table values and resize each name plane alone, so they have to be identical.
+
+#include "trackerCSRTUtils.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <iostream>
+#include <vector>
+
+namespace sky360lib::tracking
+{
+    extern const float ColorNames[][10];
+}
+
+// The implementation get_features_cn replaced, reading the pixels with at<> and the table index with cvFloor
+static std::vector<cv::Mat> getFeaturesCNReference(const cv::Mat &ppatch_data, const cv::Size &output_size)
+{
+    cv::Mat patch_data = ppatch_data.clone();
+    cv::Vec3b &pixel = patch_data.at<cv::Vec3b>(0, 0);
+    unsigned index;
+
+    cv::Mat cnFeatures = cv::Mat::zeros(patch_data.rows, patch_data.cols, CV_32FC(10));
+
+    for (int i = 0; i < patch_data.rows; i++)
+    {
+        for (int j = 0; j < patch_data.cols; j++)
+        {
+            pixel = patch_data.at<cv::Vec3b>(i, j);
+            index = (unsigned)(cvFloor((float)pixel[2] / 8) + 32 * cvFloor((float)pixel[1] / 8) + 32 * 32 * cvFloor((float)pixel[0] / 8));
+
+            // copy the values
+            for (int k = 0; k < 10; k++)
+            {
+                cnFeatures.at<cv::Vec<float, 10>>(i, j)[k] = (float)sky360lib::tracking::ColorNames[index][k];
+            }
+        }
+    }
+    std::vector<cv::Mat> result;
+    cv::split(cnFeatures, result);
+    for (size_t i = 0; i < result.size(); i++)
+    {
+        if (output_size.width > 0 && output_size.height > 0)
+        {
+            cv::resize(result.at(i), result.at(i), output_size, 0, 0, cv::INTER_CUBIC);
+        }
+    }
+    return result;
+}
+
+static bool compare(const char *_name, const cv::Size &_patchSize, const cv::Size &_outputSize,
+                    const std::vector<cv::Mat> &_features, const std::vector<cv::Mat> &_expected)
+{
+    if (_features.size() != _expected.size())
+    {
+        std::cerr << _name << " " << _patchSize << " to " << _outputSize << ": " << _features.size() << " names instead of " << _expected.size() << std::endl;
+        return false;
+    }
+    for (size_t k{0}; k < _expected.size(); ++k)
+    {
+        if (_features[k].size() != _expected[k].size() || _features[k].type() != CV_32FC1 ||
+            cv::norm(_features[k], _expected[k], cv::NORM_INF) != 0.0)
+        {
+            std::cerr << _name << " " << _patchSize << " to " << _outputSize << ": name " << k << " differs from the reference" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    const cv::Size patchSizes[]{{1, 1}, {16, 16}, {37, 23}, {80, 64}};
+    // An empty size keeps the patch size
+    const cv::Size outputSizes[]{{0, 0}, {16, 16}, {25, 19}, {96, 72}};
+
+    cv::RNG rng{0xc0102};
+    // The buffer overload writes into the same buffer for every case, like the trackers do from frame to frame
+    cv::Mat buffer;
+    std::vector<cv::Mat> features;
+    bool passed{true};
+    for (const cv::Size &patchSize : patchSizes)
+    {
+        cv::Mat patch{patchSize, CV_8UC3};
+        rng.fill(patch, cv::RNG::UNIFORM, 0, 256);
+        for (const cv::Size &outputSize : outputSizes)
+        {
+            const std::vector<cv::Mat> expected{getFeaturesCNReference(patch, outputSize)};
+            passed = compare("returning", patchSize, outputSize, sky360lib::tracking::get_features_cn(patch, outputSize), expected) && passed;
+            sky360lib::tracking::get_features_cn(patch, outputSize, buffer, features);
+            passed = compare("buffer", patchSize, outputSize, features, expected) && passed;
+        }
+        // Same output size as the patch, the reference resizes to the same size
+        const std::vector<cv::Mat> expected{getFeaturesCNReference(patch, patchSize)};
+        passed = compare("same size", patchSize, patchSize, sky360lib::tracking::get_features_cn(patch, patchSize), expected) && passed;
+    }
+    if (passed)
+    {
+        std::cout << "ok" << std::endl;
+    }
+    return passed ? 0 : 1;
+}
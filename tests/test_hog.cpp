@@ -0,0 +1,330 @@
+// Compares the single precision HOG of the CSRT tracker (get_features_hog) with the double precision implementation
+// it replaced, for 8 bit, 16 bit and float images with one and three channels and several cell sizes.
+
+#include "trackerCSRTUtils.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+static const double TOLERANCE{2e-6};
+
+// The double precision HOG that computeHOG32F replaced. The only change is that it takes the pixels unscaled and
+// applies _scale to the gradient magnitude, like computeHOG32F: scaling the pixels first adds rounding noise to the
+// gradients that breaks the exact ties between colour channels differently than the float code
+static void computeHOG32D(const cv::Mat &imageM, cv::Mat &featM, const int sbin, const int pad_x, const int pad_y, const double _scale)
+{
+    const int dimHOG = 32;
+    CV_Assert(pad_x >= 0);
+    CV_Assert(pad_y >= 0);
+    CV_Assert(imageM.channels() == 3);
+    CV_Assert(imageM.depth() == CV_64F);
+
+    // epsilon to avoid division by zero
+    const double eps = 0.0001;
+    // number of orientations
+    const int numOrient = 18;
+    // unit vectors to compute gradient orientation
+    const double uu[9] = {1.000, 0.9397, 0.7660, 0.5000, 0.1736, -0.1736, -0.5000, -0.7660, -0.9397};
+    const double vv[9] = {0.000, 0.3420, 0.6428, 0.8660, 0.9848, 0.9848, 0.8660, 0.6428, 0.3420};
+
+    // image size
+    const cv::Size imageSize = imageM.size();
+    // block size
+    int bW = cvFloor((double)imageSize.width / (double)sbin);
+    int bH = cvFloor((double)imageSize.height / (double)sbin);
+    const cv::Size blockSize(bW, bH);
+    // size of HOG features
+    int oW = std::max(blockSize.width - 2, 0) + 2 * pad_x;
+    int oH = std::max(blockSize.height - 2, 0) + 2 * pad_y;
+    cv::Size outSize = cv::Size(oW, oH);
+    // size of visible
+    const cv::Size visible = blockSize * sbin;
+
+    // initialize historgram, norm, output feature matrices
+    cv::Mat histM = cv::Mat::zeros(cv::Size(blockSize.width * numOrient, blockSize.height), CV_64F);
+    cv::Mat normM = cv::Mat::zeros(cv::Size(blockSize.width, blockSize.height), CV_64F);
+    featM = cv::Mat::zeros(cv::Size(outSize.width * dimHOG, outSize.height), CV_64F);
+
+    // get the stride of each matrix
+    const size_t imStride = imageM.step1();
+    const size_t histStride = histM.step1();
+    const size_t normStride = normM.step1();
+    const size_t featStride = featM.step1();
+
+    // calculate the zero offset
+    const double *im = imageM.ptr<double>(0);
+    double *const hist = histM.ptr<double>(0);
+    double *const norm = normM.ptr<double>(0);
+    double *const feat = featM.ptr<double>(0);
+
+    for (int y = 1; y < visible.height - 1; y++)
+    {
+        for (int x = 1; x < visible.width - 1; x++)
+        {
+            // OpenCV uses an interleaved format: BGR-BGR-BGR
+            const double *s = im + 3 * std::min(x, imageM.cols - 2) + std::min(y, imageM.rows - 2) * imStride;
+
+            // blue image channel
+            double dyb = *(s + imStride) - *(s - imStride);
+            double dxb = *(s + 3) - *(s - 3);
+            double vb = dxb * dxb + dyb * dyb;
+
+            // green image channel
+            s += 1;
+            double dyg = *(s + imStride) - *(s - imStride);
+            double dxg = *(s + 3) - *(s - 3);
+            double vg = dxg * dxg + dyg * dyg;
+
+            // red image channel
+            s += 1;
+            double dy = *(s + imStride) - *(s - imStride);
+            double dx = *(s + 3) - *(s - 3);
+            double v = dx * dx + dy * dy;
+
+            // pick the channel with the strongest gradient
+            if (vg > v)
+            {
+                v = vg;
+                dx = dxg;
+                dy = dyg;
+            }
+            if (vb > v)
+            {
+                v = vb;
+                dx = dxb;
+                dy = dyb;
+            }
+
+            // snap to one of the 18 orientations
+            double best_dot = 0;
+            int best_o = 0;
+            for (int o = 0; o < (int)numOrient / 2; o++)
+            {
+                double dot = uu[o] * dx + vv[o] * dy;
+                if (dot > best_dot)
+                {
+                    best_dot = dot;
+                    best_o = o;
+                }
+                else if (-dot > best_dot)
+                {
+                    best_dot = -dot;
+                    best_o = o + (int)(numOrient / 2);
+                }
+            }
+
+            // add to 4 historgrams around pixel using bilinear interpolation
+            double yp = ((double)y + 0.5) / (double)sbin - 0.5;
+            double xp = ((double)x + 0.5) / (double)sbin - 0.5;
+            int iyp = (int)cvFloor(yp);
+            int ixp = (int)cvFloor(xp);
+            double vy0 = yp - iyp;
+            double vx0 = xp - ixp;
+            double vy1 = 1.0 - vy0;
+            double vx1 = 1.0 - vx0;
+            v = sqrt(v) * _scale;
+
+            // fill the value into the 4 neighborhood cells
+            if (iyp >= 0 && ixp >= 0)
+                *(hist + iyp * histStride + ixp * numOrient + best_o) += vy1 * vx1 * v;
+
+            if (iyp >= 0 && ixp + 1 < blockSize.width)
+                *(hist + iyp * histStride + (ixp + 1) * numOrient + best_o) += vx0 * vy1 * v;
+
+            if (iyp + 1 < blockSize.height && ixp >= 0)
+                *(hist + (iyp + 1) * histStride + ixp * numOrient + best_o) += vy0 * vx1 * v;
+
+            if (iyp + 1 < blockSize.height && ixp + 1 < blockSize.width)
+                *(hist + (iyp + 1) * histStride + (ixp + 1) * numOrient + best_o) += vy0 * vx0 * v;
+
+        } // for y
+    }     // for x
+
+    // compute the energy in each block by summing over orientation
+    for (int y = 0; y < blockSize.height; y++)
+    {
+        const double *src = hist + y * histStride;
+        double *dst = norm + y * normStride;
+        double const *const dst_end = dst + blockSize.width;
+        // for each cell
+        while (dst < dst_end)
+        {
+            *dst = 0;
+            for (int o = 0; o < (int)(numOrient / 2); o++)
+            {
+                *dst += (*src + *(src + numOrient / 2)) *
+                        (*src + *(src + numOrient / 2));
+                src++;
+            }
+            dst++;
+            src += numOrient / 2;
+        }
+    }
+
+    // compute the features
+    for (int y = pad_y; y < outSize.height - pad_y; y++)
+    {
+        for (int x = pad_x; x < outSize.width - pad_x; x++)
+        {
+            double *dst = feat + y * featStride + x * dimHOG;
+            double *p, n1, n2, n3, n4;
+            const double *src;
+
+            p = norm + (y - pad_y + 1) * normStride + (x - pad_x + 1);
+            n1 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
+            p = norm + (y - pad_y) * normStride + (x - pad_x + 1);
+            n2 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
+            p = norm + (y - pad_y + 1) * normStride + x - pad_x;
+            n3 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
+            p = norm + (y - pad_y) * normStride + x - pad_x;
+            n4 = 1.0f / sqrt(*p + *(p + 1) + *(p + normStride) + *(p + normStride + 1) + eps);
+
+            double t1 = 0.0, t2 = 0.0, t3 = 0.0, t4 = 0.0;
+
+            // contrast-sesitive features
+            src = hist + (y - pad_y + 1) * histStride + (x - pad_x + 1) * numOrient;
+            for (int o = 0; o < numOrient; o++)
+            {
+                double val = *src;
+                double h1 = std::min(val * n1, 0.2);
+                double h2 = std::min(val * n2, 0.2);
+                double h3 = std::min(val * n3, 0.2);
+                double h4 = std::min(val * n4, 0.2);
+                *(dst++) = 0.5 * (h1 + h2 + h3 + h4);
+
+                src++;
+                t1 += h1;
+                t2 += h2;
+                t3 += h3;
+                t4 += h4;
+            }
+
+            // contrast-insensitive features
+            src = hist + (y - pad_y + 1) * histStride + (x - pad_x + 1) * numOrient;
+            for (int o = 0; o < numOrient / 2; o++)
+            {
+                double sum = *src + *(src + numOrient / 2);
+                double h1 = std::min(sum * n1, 0.2);
+                double h2 = std::min(sum * n2, 0.2);
+                double h3 = std::min(sum * n3, 0.2);
+                double h4 = std::min(sum * n4, 0.2);
+                *(dst++) = 0.5 * (h1 + h2 + h3 + h4);
+                src++;
+            }
+
+            // texture features
+            *(dst++) = 0.2357 * t1;
+            *(dst++) = 0.2357 * t2;
+            *(dst++) = 0.2357 * t3;
+            *(dst++) = 0.2357 * t4;
+            // truncation feature
+            *dst = 0;
+        } // for x
+    }     // for y
+    // Truncation features
+    for (int m = 0; m < featM.rows; m++)
+    {
+        for (int n = 0; n < featM.cols; n += dimHOG)
+        {
+            if (m > pad_y - 1 && m < featM.rows - pad_y && n > pad_x * dimHOG - 1 && n < featM.cols - pad_x * dimHOG)
+                continue;
+
+            featM.at<double>(m, n + dimHOG - 1) = 1;
+        } // for x
+    }     // for y
+}
+
+// Smooth structure plus noise, so the cells get both strong edges and a spread of orientations
+static cv::Mat makeImage(cv::RNG &_rng, const cv::Size &_size, int _type, double _maxValue)
+{
+    cv::Mat structure{_size, CV_32FC(CV_MAT_CN(_type))};
+    _rng.fill(structure, cv::RNG::UNIFORM, 0.0, _maxValue);
+    cv::GaussianBlur(structure, structure, cv::Size(0, 0), 3.0);
+    cv::Mat noise{_size, structure.type()};
+    _rng.fill(noise, cv::RNG::NORMAL, 0.0, _maxValue * 0.05);
+    structure += noise;
+    cv::Mat image;
+    structure.convertTo(image, _type);
+    return image;
+}
+
+static bool runCase(const char *_name, const cv::Mat &_image, int _cellSize, double _scale)
+{
+    const std::vector<cv::Mat> features{sky360lib::tracking::get_features_hog(_image, _cellSize)};
+
+    // The reference only takes 3 channels, a single channel image is the same as three equal channels
+    cv::Mat image64;
+    _image.convertTo(image64, CV_64F);
+    if (image64.channels() == 1)
+    {
+        cv::Mat channels[]{image64, image64, image64};
+        cv::merge(channels, 3, image64);
+    }
+    cv::Mat expected;
+    computeHOG32D(image64, expected, _cellSize, 1, 1, _scale);
+    if (features.size() != 32 || features[0].size() != cv::Size(expected.cols / 32, expected.rows))
+    {
+        std::cerr << _name << " cell " << _cellSize << ": the features do not have the size of the reference" << std::endl;
+        return false;
+    }
+
+    double maxError{0.0};
+    for (int c{0}; c < (int)features.size(); ++c)
+    {
+        for (int y{0}; y < features[c].rows; ++y)
+        {
+            for (int x{0}; x < features[c].cols; ++x)
+            {
+                const double error{std::abs(features[c].at<float>(y, x) - expected.at<double>(y, x * 32 + c))};
+                maxError = std::max(maxError, error);
+            }
+        }
+    }
+    if (maxError > TOLERANCE)
+    {
+        std::cerr << _name << " cell " << _cellSize << " " << _image.cols << "x" << _image.rows << ": max error " << maxError << std::endl;
+        return false;
+    }
+    std::cout << _name << " cell " << _cellSize << " " << _image.cols << "x" << _image.rows << ": ok, max error " << maxError << std::endl;
+    return true;
+}
+
+int main()
+{
+    struct TestCase
+    {
+        const char *name;
+        int type;
+        double maxValue;
+        double scale;
+    };
+    // Float patches hold 8 bit values
+    const TestCase cases[]{
+        {"8 bits mono", CV_8UC1, 255.0, 1.0 / 255.0},
+        {"8 bits colour", CV_8UC3, 255.0, 1.0 / 255.0},
+        {"16 bits mono", CV_16UC1, 65535.0, 1.0 / 65535.0},
+        {"16 bits colour", CV_16UC3, 65535.0, 1.0 / 65535.0},
+        {"float mono", CV_32FC1, 255.0, 1.0 / 255.0},
+        {"float colour", CV_32FC3, 255.0, 1.0 / 255.0}};
+    const cv::Size sizes[]{{64, 48}, {97, 61}};
+    const int cellSizes[]{1, 2, 4, 6};
+
+    cv::RNG rng{0x4067};
+    bool passed{true};
+    for (const TestCase &testCase : cases)
+    {
+        for (const cv::Size &size : sizes)
+        {
+            const cv::Mat image{makeImage(rng, size, testCase.type, testCase.maxValue)};
+            for (const int cellSize : cellSizes)
+            {
+                passed = runCase(testCase.name, image, cellSize, testCase.scale) && passed;
+            }
+        }
+    }
+    return passed ? 0 : 1;
+}
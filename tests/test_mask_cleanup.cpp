@@ -0,0 +1,183 @@
+// Runs WeightedMovingVariance with the 3x3 mask cleanup on one split and on several, in both mask formats and on
+// Bayer input, and checks that the masks and the dirty rows do not depend on the number of splits.
+// The single split run is itself checked against a vote computed with cv::boxFilter on the mask without cleanup.
+
+#include "WeightedMovingVariance/WeightedMovingVariance.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+using namespace sky360lib::bgs;
+
+static const int NUM_FRAMES{6};
+// Splits of uneven heights, one of them a single row
+static const cv::Size FRAME_SIZE{203, 61};
+static const size_t NUM_SPLITS[]{2, 3, 7, 60};
+static const int MIN_VOTES{5};
+
+struct TestCase
+{
+    const char *name;
+    int type;
+    CoreBgs::InputFormat inputFormat;
+    sky360lib::MaskFormat maskFormat;
+};
+
+static void runFrames(CoreBgs &_bgs, const TestCase &_case, std::vector<cv::Mat> &_masks, std::vector<std::vector<cv::Range>> &_dirtyRows,
+                      int _minVotes = MIN_VOTES)
+{
+    _bgs.setInputFormat(_case.inputFormat);
+    _bgs.setMaskFormat(_case.maskFormat);
+    _bgs.setMaskCleanup(_minVotes);
+    _bgs.setTrackDirtyRows(true);
+
+    cv::RNG rng{0xc1ea4};
+    cv::Mat frame{FRAME_SIZE, _case.type};
+    const double scale{CV_MAT_DEPTH(_case.type) == CV_16U ? 256.0 : 1.0};
+    for (int f{0}; f < NUM_FRAMES; ++f)
+    {
+        // Sparse bright blocks over a dark background, so the vote both removes and keeps pixels
+        rng.fill(frame, cv::RNG::UNIFORM, 0.0, 8.0 * scale);
+        for (int i{0}; i < 40; ++i)
+        {
+            const cv::Rect block{rng.uniform(0, FRAME_SIZE.width - 4), rng.uniform(0, FRAME_SIZE.height - 4), rng.uniform(1, 4), rng.uniform(1, 4)};
+            frame(block).setTo(cv::Scalar::all(200.0 * scale));
+        }
+        cv::Mat mask;
+        _bgs.apply(frame, mask);
+        _masks.push_back(mask.clone());
+        _dirtyRows.push_back(_bgs.getDirtyRows());
+    }
+}
+
+/// Votes with the frame borders as background, then fuses the Bayer quads as the subtractor does after its vote
+static cv::Mat referenceCleanup(const cv::Mat &_rawMask, bool _bayer)
+{
+    cv::Mat votes;
+    cv::boxFilter(_rawMask != 0, votes, CV_16U, cv::Size(3, 3), cv::Point(-1, -1), false, cv::BORDER_CONSTANT);
+    // != gives 255 per pixel, boxFilter adds them up
+    cv::Mat mask{votes >= MIN_VOTES * 255};
+    if (_bayer)
+    {
+        for (int y{0}; y < mask.rows; y += 2)
+        {
+            uint8_t *const row0{mask.ptr<uint8_t>(y)};
+            uint8_t *const row1{(y + 1) < mask.rows ? mask.ptr<uint8_t>(y + 1) : row0};
+            for (int x{0}; x < mask.cols; x += 2)
+            {
+                const int x1{std::min(x + 1, mask.cols - 1)};
+                const uint8_t quad{std::max(std::max(row0[x], row0[x1]), std::max(row1[x], row1[x1]))};
+                row0[x] = row0[x1] = row1[x] = row1[x1] = quad;
+            }
+        }
+    }
+    return mask;
+}
+
+static std::vector<cv::Range> referenceDirtyRows(const cv::Mat &_mask)
+{
+    std::vector<cv::Range> dirtyRows;
+    for (int y{0}; y < _mask.rows; ++y)
+    {
+        if (cv::countNonZero(_mask.row(y)) > 0)
+        {
+            if (!dirtyRows.empty() && dirtyRows.back().end == y)
+            {
+                ++dirtyRows.back().end;
+            }
+            else
+            {
+                dirtyRows.emplace_back(y, y + 1);
+            }
+        }
+    }
+    return dirtyRows;
+}
+
+static bool checkReference(const TestCase &_case, const std::vector<cv::Mat> &_masks, const std::vector<std::vector<cv::Range>> &_dirtyRows)
+{
+    // The raw masks come from the same frames without the cleanup. The kernels do not depend on the Bayer layout,
+    // only the quad fusion does, so the sensels are read as plain pixels and the quads fused after the vote
+    const TestCase rawCase{_case.name, _case.type, CoreBgs::InputFormat::Default, sky360lib::MaskFormat::Bytes};
+    WeightedMovingVariance raw{WeightedMovingVarianceParams{}, 1};
+    std::vector<cv::Mat> rawMasks;
+    std::vector<std::vector<cv::Range>> rawDirtyRows;
+    runFrames(raw, rawCase, rawMasks, rawDirtyRows, 0);
+
+    for (int f{0}; f < NUM_FRAMES; ++f)
+    {
+        const cv::Mat expected{referenceCleanup(rawMasks[f], _case.inputFormat == CoreBgs::InputFormat::BayerCFA)};
+        cv::Mat mask{_masks[f]};
+        if (_case.maskFormat == sky360lib::MaskFormat::PackedBits)
+        {
+            sky360lib::unpackMask(_masks[f], mask, FRAME_SIZE.width);
+        }
+        if (cv::countNonZero(mask != expected) > 0)
+        {
+            std::cerr << _case.name << ": frame " << f << " differs from the reference vote" << std::endl;
+            return false;
+        }
+        if (_dirtyRows[f] != referenceDirtyRows(expected))
+        {
+            std::cerr << _case.name << ": dirty rows of frame " << f << " differ from the reference vote" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool runCase(const TestCase &_case)
+{
+    WeightedMovingVariance reference{WeightedMovingVarianceParams{}, 1};
+    std::vector<cv::Mat> expectedMasks;
+    std::vector<std::vector<cv::Range>> expectedDirtyRows;
+    runFrames(reference, _case, expectedMasks, expectedDirtyRows);
+    if (!checkReference(_case, expectedMasks, expectedDirtyRows))
+    {
+        return false;
+    }
+
+    for (const size_t numSplits : NUM_SPLITS)
+    {
+        WeightedMovingVariance wmv{WeightedMovingVarianceParams{}, numSplits};
+        std::vector<cv::Mat> masks;
+        std::vector<std::vector<cv::Range>> dirtyRows;
+        runFrames(wmv, _case, masks, dirtyRows);
+        for (int f{0}; f < NUM_FRAMES; ++f)
+        {
+            if (cv::countNonZero(masks[f] != expectedMasks[f]) > 0)
+            {
+                std::cerr << _case.name << ": frame " << f << " differs with " << numSplits << " splits" << std::endl;
+                return false;
+            }
+            if (dirtyRows[f] != expectedDirtyRows[f])
+            {
+                std::cerr << _case.name << ": dirty rows of frame " << f << " differ with " << numSplits << " splits" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << _case.name << ": ok" << std::endl;
+    return true;
+}
+
+int main()
+{
+    const TestCase cases[]{
+        {"mono bytes", CV_8UC1, CoreBgs::InputFormat::Default, sky360lib::MaskFormat::Bytes},
+        {"mono packed", CV_8UC1, CoreBgs::InputFormat::Default, sky360lib::MaskFormat::PackedBits},
+        {"colour packed", CV_8UC3, CoreBgs::InputFormat::Default, sky360lib::MaskFormat::PackedBits},
+        {"bayer bytes", CV_16UC1, CoreBgs::InputFormat::BayerCFA, sky360lib::MaskFormat::Bytes},
+        {"bayer packed", CV_16UC1, CoreBgs::InputFormat::BayerCFA, sky360lib::MaskFormat::PackedBits}};
+
+    bool passed{true};
+    for (const TestCase &testCase : cases)
+    {
+        passed = runCase(testCase) && passed;
+    }
+    return passed ? 0 : 1;
+}
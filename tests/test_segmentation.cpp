@@ -0,0 +1,266 @@
+// Compares the single precision segmentation of the CSRT tracker (Segment::computePosteriors2 with a workspace) with
+// the double precision implementation it replaced, on the same patches, histograms and priors.
+// Both run the same regularisation, so the posteriors have to agree within TOLERANCE.
+
+#include "trackerCSRTSegmentation.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+
+using namespace sky360lib::tracking;
+
+/// The posteriors are probabilities, float keeps about 7 digits and the regularisation runs up to 50 iterations
+static const double TOLERANCE{1e-4};
+
+/// Back projection with the cvFloor bin index of the double precision implementation
+static cv::Mat referenceBackProject(Histogram &_hist, const std::vector<cv::Mat> &_channels)
+{
+    const std::vector<double> bins{_hist.getHistogramVector()};
+    const double rangePerBinInverse{_hist.m_numBinsPerDim / 256.0};
+    cv::Mat backProject(_channels[0].rows, _channels[0].cols, CV_64FC1);
+    for (int y{0}; y < backProject.rows; ++y)
+    {
+        for (int x{0}; x < backProject.cols; ++x)
+        {
+            int id{0};
+            for (int dim{0}; dim < _hist.m_numDim; ++dim)
+            {
+                const int coef{(int)std::pow(_hist.m_numBinsPerDim, _hist.m_numDim - 1 - dim)};
+                id += coef * cvFloor(rangePerBinInverse * _channels[dim].at<uchar>(y, x));
+            }
+            backProject.at<double>(y, x) = bins[id];
+        }
+    }
+    return backProject;
+}
+
+/// getRegularizedSegmentation before it moved to single precision, with the matrix expressions of the paper
+static std::pair<cv::Mat, cv::Mat> referenceRegularizedSegmentation(cv::Mat &prob_o, cv::Mat &prob_b, cv::Mat &prior_o, cv::Mat &prior_b)
+{
+    const int hsize{cvFloor(std::max(1.0, (double)cvFloor(static_cast<double>(prob_b.cols) * 3. / 50. + 0.5)))};
+    const int lambdaSize{hsize * 2 + 1};
+
+    cv::Mat lambda(lambdaSize, lambdaSize, CV_64FC1);
+    const double std2{std::pow(hsize / 3.0, 2)};
+    double sumLambda{0.0};
+    for (int y{-hsize}; y < hsize + 1; ++y)
+    {
+        for (int x{-hsize}; x < hsize + 1; ++x)
+        {
+            const double gauss{std::exp(-(x * x + y * y) / (2 * std2)) / (2 * CV_PI * std2)};
+            lambda.at<double>(y + hsize, x + hsize) = gauss;
+            sumLambda += gauss;
+        }
+    }
+    sumLambda -= lambda.at<double>(hsize, hsize);
+    lambda.at<double>(hsize, hsize) = 0.0;
+    lambda = lambda * (1.0 / sumLambda);
+    cv::Mat lambda2{lambda.clone()};
+    lambda2.at<double>(hsize, hsize) = 1.0;
+
+    double logLike{std::numeric_limits<double>::max()};
+    cv::Mat Qsum_o, Qsum_b, Si_o, Si_b, Ssum_o, Ssum_b, Qi_o, Qi_b;
+    for (int i{0}; i < 50; ++i)
+    {
+        const cv::Mat P_Io = prior_o.mul(prob_o) + std::numeric_limits<double>::epsilon();
+        const cv::Mat P_Ib = prior_b.mul(prob_b) + std::numeric_limits<double>::epsilon();
+
+        cv::filter2D(prior_o, Si_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        cv::filter2D(prior_b, Si_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        Si_o = Si_o.mul(prior_o);
+        Si_b = Si_b.mul(prior_b);
+        const cv::Mat normSi = 1.0 / (Si_o + Si_b);
+        Si_o = Si_o.mul(normSi);
+        Si_b = Si_b.mul(normSi);
+        cv::filter2D(Si_o, Ssum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        cv::filter2D(Si_b, Ssum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+
+        cv::filter2D(P_Io, Qi_o, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        cv::filter2D(P_Ib, Qi_b, -1, lambda, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        Qi_o = Qi_o.mul(P_Io);
+        Qi_b = Qi_b.mul(P_Ib);
+        const cv::Mat normQi = 1.0 / (Qi_o + Qi_b);
+        Qi_o = Qi_o.mul(normQi);
+        Qi_b = Qi_b.mul(normQi);
+        cv::filter2D(Qi_o, Qsum_o, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+        cv::filter2D(Qi_b, Qsum_b, -1, lambda2, cv::Point(-1, -1), 0, cv::BORDER_REFLECT);
+
+        prior_o = (Qsum_o + Ssum_o) * 0.25;
+        prior_b = (Qsum_b + Ssum_b) * 0.25;
+        const cv::Mat normPI = 1.0 / (prior_o + prior_b);
+        prior_o = prior_o.mul(normPI);
+        prior_b = prior_b.mul(normPI);
+
+        cv::Mat logQo, logQb;
+        cv::log(Qsum_o, logQo);
+        cv::log(Qsum_b, logQb);
+        const double logLikeNew{-cv::sum(logQo + logQb)[0] / (2 * Qsum_o.rows * Qsum_o.cols)};
+        if (std::abs(logLike - logLikeNew) < 1e-1)
+        {
+            break;
+        }
+        logLike = logLikeNew;
+    }
+    return {Qsum_o, Qsum_b};
+}
+
+/// computePosteriors2 with p_b before it moved to single precision
+static std::pair<cv::Mat, cv::Mat> referencePosteriors(const std::vector<cv::Mat> &_channels, const cv::Rect &_region, double _p_b,
+                                                       const cv::Mat &_fgPrior, const cv::Mat &_bgPrior,
+                                                       Histogram &_histTarget, Histogram &_histBackground)
+{
+    const double p_o{1. - _p_b};
+    const double factor{std::min(1.0, std::sqrt(1000.0 / _region.area()))};
+    const cv::Size newSize(cvFloor(_region.width * factor), cvFloor(_region.height * factor));
+
+    std::vector<cv::Mat> channels(_channels.size());
+    for (size_t i{0}; i < _channels.size(); ++i)
+    {
+        cv::resize(_channels[i](_region), channels[i], newSize);
+    }
+    cv::Mat fgPriorScaled, bgPriorScaled;
+    if (_fgPrior.empty())
+    {
+        fgPriorScaled = 0.5 * cv::Mat::ones(newSize, CV_64FC1);
+        bgPriorScaled = 0.5 * cv::Mat::ones(newSize, CV_64FC1);
+    }
+    else
+    {
+        cv::resize(_fgPrior(_region), fgPriorScaled, newSize);
+        cv::resize(_bgPrior(_region), bgPriorScaled, newSize);
+    }
+
+    const cv::Mat foregroundLikelihood = referenceBackProject(_histTarget, channels).mul(fgPriorScaled);
+    const cv::Mat backgroundLikelihood = referenceBackProject(_histBackground, channels).mul(bgPriorScaled);
+    cv::Mat prob_o = p_o * foregroundLikelihood / (p_o * foregroundLikelihood + _p_b * backgroundLikelihood);
+    cv::Mat prob_b = 1.0 - prob_o;
+    const std::pair<cv::Mat, cv::Mat> sizedProbs{referenceRegularizedSegmentation(prob_o, prob_b, fgPriorScaled, bgPriorScaled)};
+
+    std::pair<cv::Mat, cv::Mat> probs;
+    cv::resize(sizedProbs.first, probs.first, _region.size());
+    cv::resize(sizedProbs.second, probs.second, _region.size());
+    return probs;
+}
+
+struct TestCase
+{
+    const char *name;
+    cv::Size patchSize;
+    /// Region segmented inside the patch
+    cv::Rect region;
+    bool usePrior;
+};
+
+/// 8 bit HSV like patch, a noisy ellipse of one colour on a noisy background of another
+static std::vector<cv::Mat> makePatch(const cv::Size &_size, cv::RNG &_rng)
+{
+    cv::Mat patch{_size, CV_8UC3, cv::Scalar(100, 60, 120)};
+    cv::ellipse(patch, cv::Point(_size.width / 2, _size.height / 2), cv::Size(_size.width / 5, _size.height / 4), 0.0, 0.0, 360.0,
+                cv::Scalar(20, 200, 210), cv::FILLED);
+    cv::Mat noise{_size, CV_8UC3};
+    _rng.fill(noise, cv::RNG::UNIFORM, 0, 40);
+    cv::add(patch, noise, patch);
+    std::vector<cv::Mat> channels;
+    cv::split(patch, channels);
+    return channels;
+}
+
+/// Location prior of the tracker: 0.9 in the middle of the region down to 0.5 at its border
+static cv::Mat makePrior(const cv::Size &_size, const cv::Rect &_region)
+{
+    cv::Mat prior{_size, CV_32FC1, cv::Scalar(0.5)};
+    const cv::Point2f center{_region.x + _region.width / 2.0f, _region.y + _region.height / 2.0f};
+    for (int y{_region.y}; y < _region.y + _region.height; ++y)
+    {
+        for (int x{_region.x}; x < _region.x + _region.width; ++x)
+        {
+            const float dx{2.0f * (x - center.x) / _region.width};
+            const float dy{2.0f * (y - center.y) / _region.height};
+            prior.at<float>(y, x) = std::max(0.5f, 0.9f - 0.4f * (dx * dx + dy * dy));
+        }
+    }
+    return prior;
+}
+
+static bool compare(const char *_name, const char *_which, const cv::Mat &_probs, const cv::Mat &_expected)
+{
+    cv::Mat probs64;
+    _probs.convertTo(probs64, CV_64F);
+    if (_probs.type() != CV_32FC1 || _probs.size() != _expected.size())
+    {
+        std::cerr << _name << ": the " << _which << " posteriors are not " << _expected.size() << " floats" << std::endl;
+        return false;
+    }
+    const double maxDiff{cv::norm(probs64, _expected, cv::NORM_INF)};
+    if (!(maxDiff <= TOLERANCE))
+    {
+        std::cerr << _name << ": the " << _which << " posteriors differ by " << maxDiff << " from the reference" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool runCase(const TestCase &_case, SegmentWorkspace &_workspace)
+{
+    cv::RNG rng{0x5e9};
+    const std::vector<cv::Mat> channels{makePatch(_case.patchSize, rng)};
+    const cv::Rect &region{_case.region};
+    const int x1{region.x};
+    const int y1{region.y};
+    const int x2{region.x + region.width - 1};
+    const int y2{region.y + region.height - 1};
+
+    // The histograms of the tracker, the foreground over the region and the background around it
+    std::vector<cv::Mat> histogramChannels{channels};
+    Histogram histTarget{3, 16};
+    Histogram histBackground{3, 16};
+    histTarget.extractForegroundHistogram(histogramChannels, cv::Mat(), false, x1, y1, x2, y2);
+    histBackground.extractBackGroundHistogram(histogramChannels, x1, y1, x2, y2, 0, 0, _case.patchSize.width, _case.patchSize.height);
+    const double p_b{1.0 - (double)region.area() / _case.patchSize.area()};
+
+    cv::Mat fgPrior, bgPrior, fgPrior64, bgPrior64;
+    if (_case.usePrior)
+    {
+        fgPrior = makePrior(_case.patchSize, region);
+        cv::subtract(cv::Scalar::all(1.0), fgPrior, bgPrior);
+        fgPrior.convertTo(fgPrior64, CV_64F);
+        bgPrior.convertTo(bgPrior64, CV_64F);
+    }
+
+    const std::pair<cv::Mat, cv::Mat> expected{referencePosteriors(channels, region, p_b, fgPrior64, bgPrior64, histTarget, histBackground)};
+    std::pair<cv::Mat, cv::Mat> probs;
+    Segment::computePosteriors2(channels, x1, y1, x2, y2, p_b, fgPrior, bgPrior, histTarget, histBackground, _workspace, probs);
+    if (!compare(_case.name, "foreground", probs.first, expected.first) ||
+        !compare(_case.name, "background", probs.second, expected.second))
+    {
+        return false;
+    }
+    std::cout << _case.name << ": ok" << std::endl;
+    return true;
+}
+
+int main()
+{
+    const TestCase cases[]{
+        {"small region", {40, 32}, {6, 5, 28, 22}, true},
+        {"small region without prior", {40, 32}, {6, 5, 28, 22}, false},
+        {"resized region", {160, 120}, {40, 30, 80, 60}, true},
+        {"resized region without prior", {160, 120}, {40, 30, 80, 60}, false},
+        {"region at the corner", {96, 80}, {0, 0, 60, 50}, true}};
+
+    // The workspace is reused from case to case, like the tracker does from frame to frame
+    SegmentWorkspace workspace;
+    bool passed{true};
+    for (const TestCase &testCase : cases)
+    {
+        passed = runCase(testCase, workspace) && passed;
+    }
+    return passed ? 0 : 1;
+}
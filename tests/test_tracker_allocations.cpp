@@ -0,0 +1,185 @@
+// Counts the Mat buffers allocated by TrackerCSRT::update and MultiTracker::update: after a warm-up on the first
+// frames, following the same targets on the next frames must not allocate any. The targets move without changing
+// their size and stay inside the frame, so every patch, map, feature and spectrum keeps its size.
+// Only the OpenCV Mat allocator is hooked: cv::dft, resize and the filters allocate their plans and scratch with
+// operator new on every call, which the trackers cannot avoid, while everything they keep between frames is a Mat.
+
+#include "tracker.hpp"
+
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <atomic>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+using namespace sky360lib::tracking;
+
+static std::atomic<bool> g_countAllocations{false};
+static std::atomic<size_t> g_numAllocations{0};
+
+/// Mat buffers come from cv::fastMalloc and not operator new, they are counted through the default Mat allocator
+class CountingMatAllocator final : public cv::MatAllocator
+{
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *_allocator)
+        : m_allocator{_allocator}
+    {
+    }
+
+    cv::UMatData *allocate(int _dims, const int *_sizes, int _type, void *_data, size_t *_step,
+                           cv::AccessFlag _flags, cv::UMatUsageFlags _usageFlags) const override
+    {
+        if (_data == nullptr && g_countAllocations.load(std::memory_order_relaxed))
+        {
+            g_numAllocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return m_allocator->allocate(_dims, _sizes, _type, _data, _step, _flags, _usageFlags);
+    }
+
+    bool allocate(cv::UMatData *_data, cv::AccessFlag _accessFlags, cv::UMatUsageFlags _usageFlags) const override
+    {
+        return m_allocator->allocate(_data, _accessFlags, _usageFlags);
+    }
+
+    void deallocate(cv::UMatData *_data) const override
+    {
+        m_allocator->deallocate(_data);
+    }
+
+private:
+    cv::MatAllocator *m_allocator;
+};
+
+static const int NUM_FRAMES{16};
+static const int NUM_WARMUP_FRAMES{6};
+static const cv::Size FRAME_SIZE{960, 540};
+static const cv::Size TARGET_SIZE{24, 24};
+/// Far enough apart that their work regions are separate blocks of the feature cache
+static const cv::Point TARGET_STARTS[]{{148, 258}, {468, 258}, {788, 258}};
+
+/// Bounding box of target t on frame f, every target moves 3 pixels right and 2 down every 2 frames
+static cv::Rect targetBBox(int _target, int _frame)
+{
+    const cv::Point start{TARGET_STARTS[_target]};
+    return {start.x + (_frame * 3) / 2, start.y + _frame, TARGET_SIZE.width, TARGET_SIZE.height};
+}
+
+/// Textured colour targets on a fixed noisy grey background
+static std::vector<cv::Mat> makeFrames()
+{
+    cv::RNG rng{0x7ac4e5};
+    cv::Mat background{FRAME_SIZE, CV_8UC3};
+    rng.fill(background, cv::RNG::UNIFORM, 88, 104);
+    std::vector<cv::Mat> targets;
+    for (size_t t{0}; t < std::size(TARGET_STARTS); ++t)
+    {
+        // 4x4 pixel cells of random colours
+        cv::Mat cells{TARGET_SIZE / 4, CV_8UC3};
+        rng.fill(cells, cv::RNG::UNIFORM, 0, 256);
+        cv::Mat target;
+        cv::resize(cells, target, TARGET_SIZE, 0, 0, cv::INTER_NEAREST);
+        targets.push_back(target);
+    }
+
+    std::vector<cv::Mat> frames(NUM_FRAMES);
+    for (int f{0}; f < NUM_FRAMES; ++f)
+    {
+        frames[f] = background.clone();
+        for (size_t t{0}; t < targets.size(); ++t)
+        {
+            targets[t].copyTo(frames[f](targetBBox((int)t, f)));
+        }
+    }
+    return frames;
+}
+
+static TrackerCSRT::Params makeParams()
+{
+    TrackerCSRT::Params params;
+    // One scale, so the target keeps its size and the buffers that follow it keep theirs
+    params.number_of_scales = 1;
+    return params;
+}
+
+static bool checkAllocations(const char *_name)
+{
+    if (g_numAllocations > 0)
+    {
+        std::cerr << _name << ": " << g_numAllocations << " Mat allocations after the warm-up" << std::endl;
+        return false;
+    }
+    std::cout << _name << ": ok" << std::endl;
+    return true;
+}
+
+static bool runTrackerCSRT(const std::vector<cv::Mat> &_frames)
+{
+    std::vector<cv::Ptr<TrackerCSRT>> trackers;
+    for (size_t t{0}; t < std::size(TARGET_STARTS); ++t)
+    {
+        trackers.push_back(TrackerCSRT::create(makeParams()));
+        trackers.back()->init(_frames[0], targetBBox((int)t, 0));
+    }
+
+    g_numAllocations = 0;
+    cv::Rect bbox;
+    for (int f{1}; f < NUM_FRAMES; ++f)
+    {
+        g_countAllocations = f >= NUM_WARMUP_FRAMES;
+        for (const cv::Ptr<TrackerCSRT> &tracker : trackers)
+        {
+            if (!tracker->update(_frames[f], bbox))
+            {
+                g_countAllocations = false;
+                std::cerr << "TrackerCSRT::update: a target was lost on frame " << f << std::endl;
+                return false;
+            }
+        }
+    }
+    g_countAllocations = false;
+    return checkAllocations("TrackerCSRT::update");
+}
+
+static bool runMultiTracker(const std::vector<cv::Mat> &_frames)
+{
+    std::vector<cv::Rect> bboxes;
+    for (size_t t{0}; t < std::size(TARGET_STARTS); ++t)
+    {
+        bboxes.push_back(targetBBox((int)t, 0));
+    }
+    MultiTracker multiTracker{makeParams()};
+    multiTracker.addTargets(_frames[0], bboxes);
+
+    g_numAllocations = 0;
+    for (int f{1}; f < NUM_FRAMES; ++f)
+    {
+        g_countAllocations = f >= NUM_WARMUP_FRAMES;
+        multiTracker.update(_frames[f]);
+        if (!multiTracker.getLostTargets().empty())
+        {
+            g_countAllocations = false;
+            std::cerr << "MultiTracker::update: a target was lost on frame " << f << std::endl;
+            return false;
+        }
+    }
+    g_countAllocations = false;
+    return checkAllocations("MultiTracker::update");
+}
+
+int main()
+{
+    // Never destroyed, the per thread scratch Mats of the trackers are released when their threads end, after main
+    CountingMatAllocator *const matAllocator{new CountingMatAllocator{cv::Mat::getStdAllocator()}};
+    cv::Mat::setDefaultAllocator(matAllocator);
+
+    const std::vector<cv::Mat> frames{makeFrames()};
+
+    bool passed{true};
+    passed = runTrackerCSRT(frames) && passed;
+    passed = runMultiTracker(frames) && passed;
+
+    cv::Mat::setDefaultAllocator(nullptr);
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,107 @@
+// Runs WeightedMovingVarianceCL on whatever OpenCL runtime is installed (POCL on machines without a GPU)
+// and compares its masks with the CPU WeightedMovingVariance for the four kernels and both input depths.
+// The masks handed out before the first one is ready have to be all background.
+// Exits with 77 (skipped) when there is no OpenCL device.
+
+#include "WeightedMovingVariance/WeightedMovingVariance.hpp"
+#include "WeightedMovingVariance/WeightedMovingVarianceCL.hpp"
+
+#include <opencv2/core.hpp>
+
+#include <iostream>
+#include <stdexcept>
+
+using namespace sky360lib::bgs;
+
+static const int SKIP_TEST{77};
+static const int NUM_FRAMES{8};
+// Not a multiple of the pipeline chunks, so the last chunk is longer
+static const cv::Size FRAME_SIZE{333, 187};
+
+struct TestCase
+{
+    const char *name;
+    int type;
+    bool enableThreshold;
+    // Frames are uniform noise up to this value, over the whole 16 bit range the sqrt kernels saturate
+    double maxValue;
+};
+
+static bool runCase(const TestCase &_case)
+{
+    const WeightedMovingVarianceParams params{true, _case.enableThreshold, WeightedMovingVarianceParams::DEFAULT_THRESHOLD_VALUE,
+                                              WeightedMovingVarianceParams::DEFAULT_WEIGHTS[0],
+                                              WeightedMovingVarianceParams::DEFAULT_WEIGHTS[1],
+                                              WeightedMovingVarianceParams::DEFAULT_WEIGHTS[2]};
+    WeightedMovingVariance wmv{params, 1};
+    WeightedMovingVarianceCL wmvCL{params};
+
+    cv::RNG rng{0x5ca1ab1e};
+    cv::Mat frame{FRAME_SIZE, _case.type};
+    cv::Mat mask, expected;
+    // Anything but background, apply writes into it as it already has the right size
+    cv::Mat maskCL{FRAME_SIZE, CV_8UC1, cv::Scalar(255)};
+    for (int f{0}; f < NUM_FRAMES; ++f)
+    {
+        rng.fill(frame, cv::RNG::UNIFORM, 0.0, _case.maxValue);
+        wmv.apply(frame, mask);
+        wmvCL.apply(frame, maskCL);
+
+        if (f < 3 && cv::countNonZero(maskCL) > 0)
+        {
+            std::cerr << _case.name << ": the mask handed out on frame " << f << " is not all background" << std::endl;
+            return false;
+        }
+        // The OpenCL backend hands out the mask of the previous frame, the first one is ready on the fourth frame
+        if (f >= 3)
+        {
+            // The CPU build may fuse multiplies and adds, the kernels do not, so a value can land on the other side
+            // of a rounding or of the threshold. Allow one level of difference and a few flipped pixels
+            cv::Mat diff;
+            cv::absdiff(expected, maskCL, diff);
+            const int maxAllowed{_case.enableThreshold ? 0 : 1};
+            const int numDifferent{cv::countNonZero(diff > maxAllowed)};
+            const int maxDifferent{FRAME_SIZE.area() / 10000};
+            if (numDifferent > maxDifferent)
+            {
+                std::cerr << _case.name << ": frame " << f - 1 << " has " << numDifferent << " pixels that differ from the CPU mask" << std::endl;
+                return false;
+            }
+        }
+        mask.copyTo(expected);
+    }
+    std::cout << _case.name << ": ok" << std::endl;
+    return true;
+}
+
+int main()
+{
+    const TestCase cases[]{
+        {"mono 8 bits threshold", CV_8UC1, true, 160.0},
+        {"mono 8 bits", CV_8UC1, false, 256.0},
+        {"mono 16 bits threshold", CV_16UC1, true, 40000.0},
+        {"mono 16 bits", CV_16UC1, false, 65536.0},
+        {"mono 16 bits low", CV_16UC1, false, 400.0},
+        {"colour 8 bits threshold", CV_8UC3, true, 160.0},
+        {"colour 8 bits", CV_8UC3, false, 256.0},
+        {"colour 16 bits threshold", CV_16UC3, true, 40000.0},
+        {"colour 16 bits", CV_16UC3, false, 65536.0},
+        {"colour 16 bits low", CV_16UC3, false, 400.0}};
+
+    try
+    {
+        WeightedMovingVarianceCL probe;
+    }
+    catch (const std::runtime_error &e)
+    {
+        std::cout << "No OpenCL device, skipping: " << e.what() << std::endl;
+        return SKIP_TEST;
+    }
+
+    bool passed{true};
+    for (const TestCase &testCase : cases)
+    {
+        passed = runCase(testCase) && passed;
+    }
+    return passed ? 0 : 1;
+}
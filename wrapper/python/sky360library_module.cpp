@@ -11,10 +11,12 @@
 
 #include "bgs.hpp"
 #include "connectedBlobDetection.hpp"
+#include "autoStretch.hpp"
 
 namespace py = pybind11;
 using namespace sky360lib::bgs;
 using namespace sky360lib::blobs;
+using namespace sky360lib::camera;
 
 PYBIND11_MODULE(pysky360, m)
 {
@@ -24,20 +26,72 @@ PYBIND11_MODULE(pysky360, m)
     py::object version = py::cast("1.0.0");
     m.attr("__version__") = version;
 
+    py::enum_<CoreBgs::InputFormat>(m, "InputFormat")
+        .value("Default", CoreBgs::InputFormat::Default)
+        .value("BayerCFA", CoreBgs::InputFormat::BayerCFA);
+
+    py::enum_<sky360lib::MaskFormat>(m, "MaskFormat")
+        .value("Bytes", sky360lib::MaskFormat::Bytes)
+        .value("PackedBits", sky360lib::MaskFormat::PackedBits);
+
     py::class_<Vibe>(m, "Vibe")
         .def(py::init<>())
         .def("apply", &Vibe::applyRet)
-        .def("getBackgroundImage", &Vibe::getBackgroundImage);
+        .def("getBackgroundImage", &Vibe::getBackgroundImage)
+        .def("setInputFormat", &Vibe::setInputFormat)
+        .def("setMaskFormat", &Vibe::setMaskFormat)
+        .def("setMaskCleanup", &Vibe::setMaskCleanup);
     py::class_<WeightedMovingVariance>(m, "WeightedMovingVariance")
         .def(py::init<>())
         .def("apply", &WeightedMovingVariance::applyRet)
-        .def("getBackgroundImage", &WeightedMovingVariance::getBackgroundImage);
+        .def("getBackgroundImage", &WeightedMovingVariance::getBackgroundImage)
+        .def("setInputFormat", &WeightedMovingVariance::setInputFormat)
+        .def("setMaskFormat", &WeightedMovingVariance::setMaskFormat)
+        .def("setMaskCleanup", &WeightedMovingVariance::setMaskCleanup);
+#ifdef SKY360_USE_HALIDE
+    py::class_<WeightedMovingVarianceHalide>(m, "WeightedMovingVarianceHalide")
+        .def(py::init<>())
+        .def("apply", &WeightedMovingVarianceHalide::applyRet)
+        .def("getBackgroundImage", &WeightedMovingVarianceHalide::getBackgroundImage)
+        .def("setInputFormat", &WeightedMovingVarianceHalide::setInputFormat)
+        .def("setMaskFormat", &WeightedMovingVarianceHalide::setMaskFormat)
+        .def("setMaskCleanup", &WeightedMovingVarianceHalide::setMaskCleanup);
+#endif
+
+    py::class_<Blob>(m, "Blob")
+        .def_readonly("bbox", &Blob::bbox)
+        .def_readonly("area", &Blob::area)
+        .def_property_readonly("centroid", [](const Blob &_blob)
+                               { return py::make_tuple(_blob.centroid.x, _blob.centroid.y); })
+        .def_property_readonly("weightedCentroid", [](const Blob &_blob)
+                               { return py::make_tuple(_blob.weightedCentroid.x, _blob.weightedCentroid.y); })
+        .def_readonly("size", &Blob::size)
+        .def("toKeyPoint", &Blob::toKeyPoint)
+        .def_readonly("mu20", &Blob::mu20)
+        .def_readonly("mu11", &Blob::mu11)
+        .def_readonly("mu02", &Blob::mu02)
+        .def_readonly("minIntensity", &Blob::minIntensity)
+        .def_readonly("maxIntensity", &Blob::maxIntensity)
+        .def_readonly("sumIntensity", &Blob::sumIntensity);
 
     py::class_<ConnectedBlobDetection>(m, "ConnectedBlobDetection")
         .def(py::init<>())
-        .def("detect", &ConnectedBlobDetection::detectKP)
+        .def("detect", py::overload_cast<const cv::Mat &>(&ConnectedBlobDetection::detectKP))
         .def("detectBB", &ConnectedBlobDetection::detectRet)
+        .def("detectBlobs", &ConnectedBlobDetection::detectBlobsRet, py::arg("image"), py::arg("intensity") = cv::Mat())
         .def("setSizeThreshold", &ConnectedBlobDetection::setSizeThreshold)
         .def("setAreaThreshold", &ConnectedBlobDetection::setAreaThreshold)
-        .def("setMinDistance", &ConnectedBlobDetection::setMinDistance);
+        .def("setMinDistance", &ConnectedBlobDetection::setMinDistance)
+        .def("setMaskFormat", &ConnectedBlobDetection::setMaskFormat);
+
+    py::class_<AutoStretch>(m, "AutoStretch")
+        .def(py::init<>())
+        .def("apply", &AutoStretch::applyRet)
+        .def("setPercentiles", &AutoStretch::setPercentiles)
+        .def("setTargetMedian", &AutoStretch::setTargetMedian)
+        .def("setSampleStep", &AutoStretch::setSampleStep)
+        .def("setAdaptRate", &AutoStretch::setAdaptRate)
+        .def("getBlackPoint", &AutoStretch::getBlackPoint)
+        .def("getWhitePoint", &AutoStretch::getWhitePoint)
+        .def("getGamma", &AutoStretch::getGamma);
 }
\ No newline at end of file